@@ -1,25 +1,81 @@
 #include "json.h"
+#include "json_internal.h"
+#include "json_simd.h"
 
-#include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/**
- * @brief Determines whether a character `ch` is whitespace
- */
-#define is_whitespace(ch) (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t')
+void json_skip_whitespace(typed(json_string) * str_ptr,
+                          typed(json_string) end) {
+  json_string_t ptr = *str_ptr;
 
-#ifdef JSON_SKIP_WHITESPACE
-void json_skip_whitespace(typed(json_string) * str_ptr) {
-  while (is_whitespace(**str_ptr))
-    (*str_ptr)++;
-}
-#else
-#define json_skip_whitespace(arg)
+  if (ptr >= end || !is_whitespace(*ptr))
+    return;
+
+  ptr++;
+  if (ptr >= end || !is_whitespace(*ptr)) {
+    *str_ptr = ptr;
+    return;
+  }
+
+#if defined(JSON_SIMD_AVX2)
+  while (end - ptr >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+    __m256i ws = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+    uint32_t other = ~(uint32_t)_mm256_movemask_epi8(ws);
+
+    if (other != 0) {
+      *str_ptr = ptr + json_simd_ctz(other);
+      return;
+    }
+    ptr += 32;
+  }
+#elif defined(JSON_SIMD_SSE2)
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+    __m128i ws =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                  _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+                     _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+                                  _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+    uint32_t other = ~(uint32_t)_mm_movemask_epi8(ws) & 0xFFFF;
+
+    if (other != 0) {
+      *str_ptr = ptr + json_simd_ctz(other);
+      return;
+    }
+    ptr += 16;
+  }
+#elif defined(JSON_SIMD_NEON)
+  while (end - ptr >= 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)ptr);
+    uint8x16_t ws =
+        vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')),
+                          vceqq_u8(v, vdupq_n_u8('\n'))),
+                 vorrq_u8(vceqq_u8(v, vdupq_n_u8('\r')),
+                          vceqq_u8(v, vdupq_n_u8('\t'))));
+    uint64_t other = ~json_simd_movemask(ws) & 0xFFFF;
+
+    if (other != 0) {
+      *str_ptr = ptr + json_simd_ctz(other);
+      return;
+    }
+    ptr += 16;
+  }
 #endif
 
+  while (ptr < end && is_whitespace(*ptr))
+    ptr++;
+
+  *str_ptr = ptr;
+}
+
 #ifdef JSON_DEBUG
 #define log(str, ...) printf(str "\n", ##__VA_ARGS__)
 void json_debug_print(typed(json_string) str, typed(size) len) {
@@ -35,78 +91,106 @@ void json_debug_print(typed(json_string) str, typed(size) len) {
 #define log(str, ...)
 #endif
 
-#define define_result_type(name)                                               \
-  result(name) result_ok(name)(typed(name) value) {                            \
-    result(name) retval = {                                                    \
-        .is_ok = _true,                                                         \
-        .inner =                                                               \
-            {                                                                  \
-                .value = value,                                                \
-            },                                                                 \
-    };                                                                         \
-    return retval;                                                             \
-  }                                                                            \
-  result(name) result_err(name)(typed(json_error) err) {                       \
-    result(name) retval = {                                                    \
-        .is_ok = _false,                                                        \
-        .inner =                                                               \
-            {                                                                  \
-                .err = err,                                                    \
-            },                                                                 \
-    };                                                                         \
-    return retval;                                                             \
-  }                                                                            \
-  typed(json_boolean) result_is_ok(name)(result(name) * result) {              \
-    return result->is_ok;                                                      \
-  }                                                                            \
-  typed(json_boolean) result_is_err(name)(result(name) * result) {             \
-    return !result->is_ok;                                                     \
-  }                                                                            \
-  typed(name) result_unwrap(name)(result(name) * result) {                     \
-    return result->inner.value;                                                \
-  }                                                                            \
-  typed(json_error) result_unwrap_err(name)(result(name) * result) {           \
-    return result->inner.err;                                                  \
-  }
+/**
+ * @brief Default size of the first arena chunk
+ */
+#define JSON_ARENA_CHUNK_SIZE 4096
+
+/**
+ * @brief Alignment of every arena allocation
+ */
+#define JSON_ARENA_ALIGN 8
+
+struct json_arena_chunk_s {
+  json_arena_chunk_t *next;
+  size_t size;
+  size_t used;
+};
+
+/**
+ * @brief Offset of the usable memory inside a chunk
+ */
+#define json_arena_chunk_header                                                \
+  ((sizeof(json_arena_chunk_t) + JSON_ARENA_ALIGN - 1) &                       \
+   ~(size_t)(JSON_ARENA_ALIGN - 1))
+
+#ifdef JSON_ALLOC_STATS
+static json_alloc_stats_t json_heap_stats;
+#define json_count(field, size)                                                \
+  do {                                                                         \
+    json_heap_stats.field++;                                                   \
+    json_heap_stats.bytes += (size);                                           \
+  } while (0)
+#else
+#define json_count(field, size)                                                \
+  do {                                                                         \
+  } while (0)
+#endif
+
+/**
+ * @brief Initial size of the scratch stack
+ */
+#define JSON_STACK_SIZE 256
+
+/**
+ * @brief Releases a parsed string on an error path. In-situ strings
+ * point into the input and are left alone
+ */
+#define json_context_free_string(ctx, view)                                    \
+  do {                                                                         \
+    if (!(ctx)->insitu)                                                        \
+      json_context_free(ctx, (void *)(view).data);                             \
+  } while (0)
+
+/**
+ * @brief Releases a parsed key on an error path. Pooled keys belong to
+ * the pool and are left alone
+ */
+#define json_context_free_key(ctx, view)                                       \
+  do {                                                                         \
+    if ((ctx)->keys == NULL)                                                   \
+      json_context_free_string(ctx, view);                                     \
+  } while (0)
 
 /**
  * @brief Allocate `count` number of items of `type` in memory
  * and return the pointer to the newly allocated memory
  */
-#define allocN(type, count) (type *)malloc((count) * sizeof(type))
+#define allocN(ctx, type, count)                                               \
+  (type *)json_context_alloc(ctx, (count) * sizeof(type))
 
 /**
  * @brief Allocate an item of `type` in memory and return the
  * pointer to the newly allocated memory
  */
-#define alloc(type) allocN(type, 1)
+#define alloc(ctx, type) allocN(ctx, type, 1)
 
 /**
- * @brief Re-allocate `count` number of items of `type` in memory
- * and return the pointer to the newly allocated memory
+ * @brief Context of DOMs built by {json_parse}, used to release them
  */
-#define reallocN(ptr, type, count) (type *)realloc(ptr, (count) * sizeof(type))
+static json_context_t json_heap = {0};
 
 /**
- * @brief Parses a JSON element {json_element_t} and moves the string
- * pointer to the end of the parsed element
+ * @brief Free memory allocated on the heap while parsing
  */
-static result(json_entry) json_parse_entry(json_string_t *);
+#define dealloc(ptr) json_context_free(&json_heap, (void *)(ptr))
 
 /**
- * @brief Guesses the element type at the start of a string
+ * @brief Parses a whole document with the allocator described by `ctx`
  */
-static result(json_element_type) json_guess_element_type(json_string_t);
+static result(json_element) json_parse_document(json_context_t *,
+                                                json_string_t);
 
 /**
- * @brief Whether a token represents a string. Like '"'
+ * @brief Parses a JSON element {json_element_t} and moves the string
+ * pointer to the end of the parsed element
  */
-static _bool json_is_string(char);
+static result(json_entry) json_parse_entry(json_context_t *, json_string_t *);
 
 /**
- * @brief Whether a token represents a number. Like '0'
+ * @brief Whether a token represents a string. Like '"'
  */
-static _bool json_is_number(char);
+static _bool json_is_string(char);
 
 /**
  * @brief Whether a token represents a object. Like '"'
@@ -134,39 +218,64 @@ static _bool json_is_null(char);
  * to end of the parsed element
  */
 static result(json_element_value)
-    json_parse_element_value(json_string_t *, json_element_type_t);
+    json_parse_element_value(json_context_t *, json_string_t *,
+                             json_element_type_t);
 
 /**
  * @brief Parses a `String` {json_string_t} and moves the string
  * pointer to the end of the parsed string
  */
-static result(json_element_value) json_parse_string(json_string_t *);
+static result(json_element_value) json_parse_string(json_context_t *,
+                                                    json_string_t *);
 
 /**
- * @brief Parses a `Number` {json_number_t} and moves the string
- * pointer to the end of the parsed number
+ * @brief Parses the key of an entry like a `String`, or takes it from
+ * the context's key pool when there is one
  */
-static result(json_element_value) json_parse_number(json_string_t *);
+static result(json_string_view) json_parse_key(json_context_t *,
+                                               json_string_t *);
 
 /**
  * @brief Parses a `Object` {json_object_t} and moves the string
  * pointer to the end of the parsed object
  */
-static result(json_element_value) json_parse_object(json_string_t *);
+static result(json_element_value) json_parse_object(json_context_t *,
+                                                    json_string_t *);
 
-static uint64_t json_key_hash(json_string_t);
+/**
+ * @brief Moves the `count` entries collected on the scratch stack at
+ * `base` into an object with a shared shape and a flat value array
+ */
+static result(json_element_value)
+    json_build_shaped_object(json_context_t *, size_t, size_t);
+
+/**
+ * @brief Releases the keys and values of the `count` entries collected
+ * on the scratch stack at `base` and pops them, when building their
+ * object fails
+ */
+static void json_discard_entries(json_context_t *, size_t, size_t);
 
 /**
  * @brief Parses a `Array` {json_array_t} and moves the string
  * pointer to the end of the parsed array
  */
-static result(json_element_value) json_parse_array(json_string_t *);
+static result(json_element_value) json_parse_array(json_context_t *,
+                                                   json_string_t *);
+
+/**
+ * @brief Parses the elements of an array up to its ']', or up to the
+ * end of the context, into an exactly sized {json_array_t}
+ */
+static result(json_element_value)
+    json_parse_array_elements(json_context_t *, json_string_t *);
 
 /**
  * @brief Parses a `Boolean` {json_boolean_t} and moves the string
  * pointer to the end of the parsed boolean
  */
-static result(json_element_value) json_parse_boolean(json_string_t *);
+static result(json_element_value) json_parse_boolean(json_context_t *,
+                                                     json_string_t *);
 
 /**
  * @brief Skips a Key-Value pair
@@ -174,16 +283,7 @@ static result(json_element_value) json_parse_boolean(json_string_t *);
  * @return true If a valid entry is skipped
  * @return false If entry was invalid (still skips)
  */
-static _bool json_skip_entry(json_string_t *);
-
-/**
- * @brief Skips an element value
- *
- * @return true If a valid element is skipped
- * @return false If element was invalid (still skips)
- */
-static _bool json_skip_element_value(json_string_t *,
-                                    json_element_type_t);
+static _bool json_skip_entry(json_string_t *, json_string_t);
 
 /**
  * @brief Skips a string value
@@ -191,7 +291,7 @@ static _bool json_skip_element_value(json_string_t *,
  * @return true If a valid string is skipped
  * @return false If string was invalid (still skips)
  */
-static _bool json_skip_string(json_string_t *);
+static _bool json_skip_string(json_string_t *, json_string_t);
 
 /**
  * @brief Skips a number value
@@ -199,7 +299,7 @@ static _bool json_skip_string(json_string_t *);
  * @return true If a valid number is skipped
  * @return false If number was invalid (still skips)
  */
-static _bool json_skip_number(json_string_t *);
+static _bool json_skip_number(json_string_t *, json_string_t);
 
 /**
  * @brief Skips an object value
@@ -207,7 +307,7 @@ static _bool json_skip_number(json_string_t *);
  * @return true If a valid object is skipped
  * @return false If object was invalid (still skips)
  */
-static _bool json_skip_object(json_string_t *);
+static _bool json_skip_object(json_string_t *, json_string_t);
 
 /**
  * @brief Skips an array value
@@ -215,7 +315,7 @@ static _bool json_skip_object(json_string_t *);
  * @return true If a valid array is skipped
  * @return false If array was invalid (still skips)
  */
-static _bool json_skip_array(json_string_t *);
+static _bool json_skip_array(json_string_t *, json_string_t);
 
 /**
  * @brief Skips a boolean value
@@ -223,126 +323,421 @@ static _bool json_skip_array(json_string_t *);
  * @return true If a valid boolean is skipped
  * @return false If boolean was invalid (still skips)
  */
-static _bool json_skip_boolean(json_string_t *);
-
-/**
- * @brief Moves a JSON string pointer beyond any whitespace
- */
-// static void json_skip_whitespace_actual(json_string_t *);
+static _bool json_skip_boolean(json_string_t *, json_string_t);
 
 /**
  * @brief Moves a JSON string pointer beyond `null` literal
  *
  */
-static void json_skip_null(json_string_t *);
+static void json_skip_null(json_string_t *, json_string_t);
 
 /**
- * @brief Prints a JSON element {json_element_t} type
+ * @brief Frees a JSON element {json_element_t}, its string values when
+ * `owns_strings` is set and its object keys when `owns_keys` is set
  */
-static void json_print_element(json_element_t *, int, int);
+static void json_free_element(json_element_t *, _bool, _bool);
 
 /**
- * @brief Prints a `String` {json_string_t} type
+ * @brief Frees a `String` (json_string_t) from memory
  */
-static void json_print_string(json_string_t);
+static void json_free_string(json_string_view_t);
 
 /**
- * @brief Prints a `Number` {json_number_t} type
+ * @brief Frees an `Object` (json_object_t) from memory
  */
-static void json_print_number(json_number_t);
+static void json_free_object(json_object_t *, _bool, _bool);
 
 /**
- * @brief Prints an `Object` {json_object_t} type
+ * @brief Frees an `Array` (json_array_t) from memory
  */
-static void json_print_object(json_object_t *, int, int);
+static void json_free_array(json_array_t *, _bool, _bool);
 
 /**
- * @brief Prints an `Array` {json_array_t} type
+ * @brief Utility function to convert an escaped string to a formatted
+ * string. In-situ parses unescape in place and return `str` itself
  */
-static void json_print_array(json_array_t *, int, int);
+static result(json_string_view)
+    json_unescape_string(json_context_t *, json_string_t, size_t);
 
 /**
- * @brief Prints a `Boolean` {json_boolean_t} type
+ * @brief Copies the bytes of `str` before the first quote or backslash,
+ * at most `len`, to `output`, which may be `str` or come before it
+ *
+ * @return The number of bytes copied
  */
-static void json_print_boolean(json_boolean_t);
+static size_t json_unescape_run(char *, json_string_t, size_t);
 
 /**
- * @brief Frees a `String` (json_string_t) from memory
+ * @brief Reads the four hex digits of a `\u` escape at `str`
  */
-static void json_free_string(json_string_t);
+static _bool json_unescape_hex(json_string_t, uint32_t *);
 
 /**
- * @brief Frees an `Object` (json_object_t) from memory
+ * @brief Writes a code point as UTF-8
+ *
+ * @return The number of bytes written, 1 to 4
  */
-static void json_free_object(json_object_t *);
+static size_t json_utf8_encode(uint32_t, char *);
 
-/**
- * @brief Frees an `Array` (json_array_t) from memory
- */
-static void json_free_array(json_array_t *);
+result(json_element) json_parse(json_string_t json_str) {
+  if (json_str == NULL) {
+    return result_err(json_element)(JSON_ERROR_EMPTY);
+  }
 
-/**
- * @brief Utility function to convert an escaped string to a formatted string
- */
-static result(json_string)
-    json_unescape_string(json_string_t, size_t);
+  return json_parse_ex(json_str, strlen(json_str), NULL);
+}
 
-/**
- * @brief Offset to the last `"` of a JSON string
- */
-static size_t json_string_len(json_string_t);
+result(json_element) json_parse_n(json_string_t json_str, size_t len) {
+  return json_parse_ex(json_str, len, NULL);
+}
 
-result(json_element) json_parse(json_string_t json_str) {
+result(json_element)
+    json_parse_arena(json_string_t json_str, json_arena_t * arena) {
   if (json_str == NULL) {
     return result_err(json_element)(JSON_ERROR_EMPTY);
   }
 
-  size_t len = strlen(json_str);
-  if (len == 0) {
+  json_parse_options_t options = {0};
+  options.arena = arena;
+
+  return json_parse_ex(json_str, strlen(json_str), &options);
+}
+
+result(json_element) json_parse_insitu(char *json_str, json_arena_t * arena) {
+  if (json_str == NULL) {
     return result_err(json_element)(JSON_ERROR_EMPTY);
   }
 
+  json_parse_options_t options = {0};
+  options.arena = arena;
+  options.insitu = _true;
+
+  return json_parse_ex(json_str, strlen(json_str), &options);
+}
+
+result(json_element) json_parse_ex(json_string_t json_str, size_t len,
+                                   const json_parse_options_t * options) {
+  json_context_t ctx;
+
+  if (json_str == NULL || len == 0) {
+    return result_err(json_element)(JSON_ERROR_EMPTY);
+  }
+
+  json_context_init(&ctx, json_str, len, options);
+
+  return json_parse_document(&ctx, json_str);
+}
+
+void json_context_init(json_context_t * ctx, json_string_t json_str,
+                       size_t len, const json_parse_options_t * options) {
+  memset(ctx, 0, sizeof(json_context_t));
+
+  ctx->start = json_str;
+  ctx->end = json_str + len;
+  if (options != NULL) {
+    ctx->arena = options->arena;
+    ctx->insitu = options->insitu;
+    ctx->shapes = options->shapes;
+    ctx->keys =
+        options->shapes != NULL ? &options->shapes->keys : options->keys;
+
+    // Falls back to scanning if the index cannot be built
+    if (options->index != NULL &&
+        json_index_build(options->index, json_str, len)) {
+      ctx->tokens = options->index->positions;
+      ctx->token_count = options->index->count;
+    }
+  }
+}
+
+void json_context_release(json_context_t * ctx) {
+  if (ctx->stack != NULL) {
+    if (ctx->arena == NULL)
+      json_count(frees, 0);
+    free(ctx->stack);
+  }
+
+  ctx->stack = NULL;
+  ctx->stack_size = 0;
+  ctx->stack_capacity = 0;
+}
+
+result(json_element)
+    json_parse_document(json_context_t * ctx, json_string_t json_str) {
+  json_context_skip_whitespace(ctx, &json_str);
+
   result_try(json_element, json_element_type, type,
-             json_guess_element_type(json_str));
-  result_try(json_element, json_element_value, value,
-             json_parse_element_value(&json_str, type));
+             json_guess_element_type(json_str, ctx->end));
+
+  result(json_element_value) value_result =
+      json_parse_element_value(ctx, &json_str, type);
+
+  // The scratch stack only lives as long as the parse
+  json_context_release(ctx);
+
+  if (result_is_err(json_element_value)(&value_result))
+    return result_map_err(json_element, json_element_value, &value_result);
 
   const json_element_t element = {
       .type = type,
-      .value = value,
+      .value = result_unwrap(json_element_value)(&value_result),
   };
 
   return result_ok(json_element)(element);
 }
 
-result(json_entry) json_parse_entry(json_string_t * str_ptr) {
-  result_try(json_entry, json_element_value, key, json_parse_string(str_ptr));
-  json_skip_whitespace(str_ptr);
+void json_arena_init(json_arena_t * arena, size_t chunk_size) {
+  arena->head = NULL;
+  arena->chunk_size = chunk_size > 0 ? chunk_size : JSON_ARENA_CHUNK_SIZE;
+  arena->allocs = 0;
+  arena->bytes = 0;
+  arena->chunks = 0;
+  arena->reserved = 0;
+}
+
+void json_arena_reset(json_arena_t * arena) {
+  json_arena_chunk_t *chunk = arena->head;
+
+  if (chunk != NULL) {
+    // Chunks grow geometrically, so the head is the largest one
+    json_arena_chunk_t *next = chunk->next;
+    while (next != NULL) {
+      json_arena_chunk_t *temp = next->next;
+      free(next);
+      next = temp;
+    }
+
+    chunk->next = NULL;
+    chunk->used = json_arena_chunk_header;
+    arena->chunks = 1;
+    arena->reserved = chunk->size;
+  }
+
+  arena->allocs = 0;
+  arena->bytes = 0;
+}
+
+void json_arena_free(json_arena_t * arena) {
+  json_arena_chunk_t *chunk = arena->head;
+  while (chunk != NULL) {
+    json_arena_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+
+  json_arena_init(arena, arena->chunk_size);
+}
+
+void json_arena_merge(json_arena_t * arena, json_arena_t * from) {
+  json_arena_chunk_t *tail = from->head;
+
+  if (tail == NULL)
+    return;
+
+  while (tail->next != NULL)
+    tail = tail->next;
+
+  // The head keeps serving allocations, the chunks of `from` go behind
+  // it and are released along with the others on reset
+  if (arena->head == NULL) {
+    arena->head = from->head;
+  } else {
+    tail->next = arena->head->next;
+    arena->head->next = from->head;
+  }
+
+  arena->allocs += from->allocs;
+  arena->bytes += from->bytes;
+  arena->chunks += from->chunks;
+  arena->reserved += from->reserved;
+
+  json_arena_init(from, from->chunk_size);
+}
+
+result(json_element_value) json_parse_elements(json_string_t start,
+                                               json_string_t end,
+                                               json_arena_t * arena) {
+  json_context_t ctx;
+  json_parse_options_t options = {0};
+  json_string_t ptr = start;
+
+  options.arena = arena;
+  json_context_init(&ctx, start, end - start, &options);
+
+  result(json_element_value) array_result =
+      json_parse_array_elements(&ctx, &ptr);
+
+  json_context_release(&ctx);
+
+  return array_result;
+}
+
+void *json_arena_alloc(json_arena_t * arena, size_t size) {
+  size = (size + JSON_ARENA_ALIGN - 1) & ~(size_t)(JSON_ARENA_ALIGN - 1);
+
+  json_arena_chunk_t *chunk = arena->head;
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    size_t chunk_size = arena->chunk_size;
+    if (chunk != NULL)
+      chunk_size = chunk->size * 2;
+    while (chunk_size - json_arena_chunk_header < size)
+      chunk_size *= 2;
+
+    chunk = (json_arena_chunk_t *)malloc(chunk_size);
+    if (chunk == NULL)
+      return NULL;
+
+    chunk->next = arena->head;
+    chunk->size = chunk_size;
+    chunk->used = json_arena_chunk_header;
+    arena->head = chunk;
+    arena->chunks++;
+    arena->reserved += chunk_size;
+  }
+
+  void *ptr = (char *)chunk + chunk->used;
+  chunk->used += size;
+  arena->allocs++;
+  arena->bytes += size;
+
+  return ptr;
+}
+
+void json_context_skip_whitespace(json_context_t * ctx,
+                                  json_string_t * str_ptr) {
+  if (ctx->tokens == NULL) {
+    json_skip_whitespace(str_ptr, ctx->end);
+    return;
+  }
+
+  // The parse only moves forward, so the cursor never goes back
+  size_t offset = *str_ptr - ctx->start;
+  while (ctx->token < ctx->token_count && ctx->tokens[ctx->token] < offset)
+    ctx->token++;
+
+  // Only whitespace follows the last token
+  if (ctx->token < ctx->token_count)
+    *str_ptr = ctx->start + ctx->tokens[ctx->token];
+  else
+    *str_ptr = ctx->end;
+}
+
+size_t json_context_string_len(json_context_t * ctx, json_string_t str) {
+  if (ctx->tokens == NULL)
+    return json_string_len(str, ctx->end);
+
+  // Nothing inside a string is indexed, so the next token after the
+  // opening quote is the closing one
+  size_t offset = str - ctx->start;
+  while (ctx->token < ctx->token_count && ctx->tokens[ctx->token] < offset)
+    ctx->token++;
+
+  if (ctx->token < ctx->token_count &&
+      ctx->start[ctx->tokens[ctx->token]] == '"')
+    return ctx->tokens[ctx->token] - offset;
+
+  return 0;
+}
+
+void *json_stack_push(json_context_t * ctx, size_t size) {
+  if (ctx->stack_capacity - ctx->stack_size < size) {
+    size_t capacity = ctx->stack_capacity > 0 ? ctx->stack_capacity * 2
+                                              : JSON_STACK_SIZE;
+    while (capacity - ctx->stack_size < size)
+      capacity *= 2;
+
+    // Arena parses leave the heap counters alone, so parses on several
+    // threads do not race on them
+    if (ctx->arena == NULL)
+      json_count(reallocs, capacity);
+    char *stack = (char *)realloc(ctx->stack, capacity);
+    if (stack == NULL)
+      return NULL;
+
+    ctx->stack = stack;
+    ctx->stack_capacity = capacity;
+  }
+
+  void *top = ctx->stack + ctx->stack_size;
+  ctx->stack_size += size;
+
+  return top;
+}
+
+void *json_context_alloc(json_context_t * ctx, size_t size) {
+  if (ctx->arena != NULL)
+    return json_arena_alloc(ctx->arena, size);
+
+  json_count(allocs, size);
+  return malloc(size);
+}
+
+void json_context_free(json_context_t * ctx, void *ptr) {
+  if (ctx->arena != NULL)
+    return;
+
+  json_count(frees, 0);
+  free(ptr);
+}
+
+void json_context_free_element(json_context_t * ctx, json_element_t * element) {
+  // Arena memory goes with the arena
+  if (ctx->arena != NULL)
+    return;
+
+  if (ctx->insitu)
+    json_free_insitu(element);
+  else if (ctx->keys != NULL)
+    json_free_interned(element);
+  else
+    json_free(element);
+}
+
+void json_alloc_stats(json_alloc_stats_t * stats) {
+#ifdef JSON_ALLOC_STATS
+  *stats = json_heap_stats;
+#else
+  memset(stats, 0, sizeof(json_alloc_stats_t));
+#endif
+}
+
+void json_alloc_stats_reset(void) {
+#ifdef JSON_ALLOC_STATS
+  memset(&json_heap_stats, 0, sizeof(json_alloc_stats_t));
+#endif
+}
+
+result(json_entry)
+    json_parse_entry(json_context_t * ctx, json_string_t * str_ptr) {
+  result_try(json_entry, json_string_view, key, json_parse_key(ctx, str_ptr));
+  json_context_skip_whitespace(ctx, str_ptr);
 
   // Skip the ':' delimiter
-  (*str_ptr)++;
+  if (*str_ptr < ctx->end)
+    (*str_ptr)++;
 
-  json_skip_whitespace(str_ptr);
+  json_context_skip_whitespace(ctx, str_ptr);
 
-  result(json_element_type) type_result = json_guess_element_type(*str_ptr);
+  result(json_element_type) type_result =
+      json_guess_element_type(*str_ptr, ctx->end);
   if (result_is_err(json_element_type)(&type_result)) {
-    free((void *)key.as_string);
+    json_context_free_key(ctx, key);
     return result_map_err(json_entry, json_element_type, &type_result);
   }
   json_element_type_t type =
       result_unwrap(json_element_type)(&type_result);
 
   result(json_element_value) value_result =
-      json_parse_element_value(str_ptr, type);
+      json_parse_element_value(ctx, str_ptr, type);
   if (result_is_err(json_element_value)(&value_result)) {
-    free((void *)key.as_string);
+    json_context_free_key(ctx, key);
     return result_map_err(json_entry, json_element_value, &value_result);
   }
   json_element_value_t value =
       result_unwrap(json_element_value)(&value_result);
 
   json_entry_t entry = {
-      .key = key.as_string,
+      .key = key,
       .element =
           {
               .type = type,
@@ -353,8 +748,9 @@ result(json_entry) json_parse_entry(json_string_t * str_ptr) {
   return result_ok(json_entry)(entry);
 }
 
-result(json_element_type) json_guess_element_type(json_string_t str) {
-  const char ch = *str;
+result(json_element_type)
+    json_guess_element_type(json_string_t str, json_string_t end) {
+  const char ch = json_peek(str, end);
   json_element_type_t type;
 
   if (json_is_string(ch))
@@ -391,40 +787,42 @@ _bool json_is_boolean(char ch) { return ch == 't' || ch == 'f'; }
 _bool json_is_null(char ch) { return ch == 'n'; }
 
 result(json_element_value)
-    json_parse_element_value(json_string_t * str_ptr,
+    json_parse_element_value(json_context_t * ctx, json_string_t * str_ptr,
                              json_element_type_t type) {
   switch (type) {
   case JSON_ELEMENT_TYPE_STRING:
-    return json_parse_string(str_ptr);
+    return json_parse_string(ctx, str_ptr);
   case JSON_ELEMENT_TYPE_NUMBER:
-    return json_parse_number(str_ptr);
+    return json_parse_number(ctx, str_ptr);
   case JSON_ELEMENT_TYPE_OBJECT:
-    return json_parse_object(str_ptr);
+    return json_parse_object(ctx, str_ptr);
   case JSON_ELEMENT_TYPE_ARRAY:
-    return json_parse_array(str_ptr);
+    return json_parse_array(ctx, str_ptr);
   case JSON_ELEMENT_TYPE_BOOLEAN:
-    return json_parse_boolean(str_ptr);
+    return json_parse_boolean(ctx, str_ptr);
   case JSON_ELEMENT_TYPE_NULL:
-    json_skip_null(str_ptr);
+    json_skip_null(str_ptr, ctx->end);
     return result_err(json_element_value)(JSON_ERROR_EMPTY);
   default:
     return result_err(json_element_value)(JSON_ERROR_INVALID_TYPE);
   }
 }
 
-result(json_element_value) json_parse_string(json_string_t * str_ptr) {
+result(json_element_value)
+    json_parse_string(json_context_t * ctx, json_string_t * str_ptr) {
   // Skip the first '"' character
   (*str_ptr)++;
 
-  size_t len = json_string_len(*str_ptr);
+  size_t len = json_context_string_len(ctx, *str_ptr);
   if (len == 0) {
     // Skip the end quote
-    (*str_ptr)++;
+    if (*str_ptr < ctx->end)
+      (*str_ptr)++;
     return result_err(json_element_value)(JSON_ERROR_EMPTY);
   }
 
-  result_try(json_element_value, json_string, output,
-             json_unescape_string(*str_ptr, len));
+  result_try(json_element_value, json_string_view, output,
+             json_unescape_string(ctx, *str_ptr, len));
 
   // Skip to beyond the string
   (*str_ptr) += len + 1;
@@ -435,140 +833,215 @@ result(json_element_value) json_parse_string(json_string_t * str_ptr) {
   return result_ok(json_element_value)(retval);
 }
 
-result(json_element_value) json_parse_number(json_string_t * str_ptr) {
-  json_string_t temp_str = *str_ptr;
-  _bool has_decimal = _false;
-
-  while (json_is_number(*temp_str)) {
-    if (*temp_str == '.') {
-      has_decimal = _true;
-    }
-
-    temp_str++;
+result(json_string_view)
+    json_parse_key(json_context_t * ctx, json_string_t * str_ptr) {
+  if (ctx->keys == NULL) {
+    result_try(json_string_view, json_element_value, key,
+               json_parse_string(ctx, str_ptr));
+    return result_ok(json_string_view)(key.as_string);
   }
 
-  json_number_t number = {0};
-  json_number_value_t val = {0};
-
-  if (has_decimal) {
-    errno = 0;
+  // Skip the first '"' character
+  (*str_ptr)++;
 
-    val.as_double = strtod(*str_ptr, (char **)str_ptr);
+  size_t len = json_context_string_len(ctx, *str_ptr);
+  if (len == 0) {
+    // Skip the end quote
+    if (*str_ptr < ctx->end)
+      (*str_ptr)++;
+    return result_err(json_string_view)(JSON_ERROR_EMPTY);
+  }
 
-    number.type = JSON_NUMBER_TYPE_DOUBLE;
-    number.value = val;
+  result(json_string_view) key_result;
 
-    if (errno == ERANGE)
-      return result_err(json_element_value)(JSON_ERROR_INVALID_VALUE);
+  if (memchr(*str_ptr, '\\', len) == NULL) {
+    key_result = json_key_pool_intern(ctx->keys, *str_ptr, len);
   } else {
-    errno = 0;
+    // Escaped keys are unescaped on the scratch stack and only copied
+    // into the pool if it does not have them yet
+    const size_t base = ctx->stack_size;
+    char *scratch = (char *)json_stack_push(ctx, len + 1);
+    if (scratch == NULL)
+      return result_err(json_string_view)(JSON_ERROR_INVALID_VALUE);
+
+    result(size) length_result = json_unescape_into(scratch, *str_ptr, len);
+    if (result_is_ok(size)(&length_result))
+      key_result = json_key_pool_intern(
+          ctx->keys, scratch, result_unwrap(size)(&length_result));
+    else
+      key_result = result_map_err(json_string_view, size, &length_result);
+
+    ctx->stack_size = base;
+  }
 
-    val.as_long = strtol(*str_ptr, (char **)str_ptr, 10);
+  // Skip to beyond the string
+  (*str_ptr) += len + 1;
 
-    number.type = JSON_NUMBER_TYPE_LONG;
-    number.value = val;
+  return key_result;
+}
 
-    if (errno == ERANGE)
-      return result_err(json_element_value)(JSON_ERROR_INVALID_VALUE);
+result(json_element_value)
+    json_parse_number(json_context_t * ctx, json_string_t * str_ptr) {
+  result(json_number) number_result = json_number_parse(str_ptr, ctx->end);
+
+  if (result_is_err(json_number)(&number_result)) {
+    // Drop the whole token, the lenient loops would otherwise resume
+    // inside it and read its tail as another number
+    json_skip_number(str_ptr, ctx->end);
+    return result_map_err(json_element_value, json_number, &number_result);
   }
 
   json_element_value_t retval = {0};
-  retval.as_number = number;
+  retval.as_number = result_unwrap(json_number)(&number_result);
 
   return result_ok(json_element_value)(retval);
 }
 
-result(json_element_value) json_parse_object(json_string_t * str_ptr) {
-  json_string_t temp_str = *str_ptr;
-
-  // ******* First find the number of valid entries *******
+result(json_element_value)
+    json_parse_object(json_context_t * ctx, json_string_t * str_ptr) {
   // Skip the first '{' character
-  temp_str++;
+  (*str_ptr)++;
 
-  json_skip_whitespace(&temp_str);
+  json_context_skip_whitespace(ctx, str_ptr);
 
-  if (*temp_str == '}') {
-    // Skip the end '}' in the actual pointer
-    (*str_ptr) = temp_str + 1;
+  if (json_peek(*str_ptr, ctx->end) == '}') {
+    // Skip the end '}'
+    (*str_ptr)++;
     return result_err(json_element_value)(JSON_ERROR_EMPTY);
   }
 
+  // ******* Collect the entries on the scratch stack *******
+  // Nested objects push their own entries above ours, so every byte
+  // is visited once no matter how deep the document is
+  size_t base = ctx->stack_size;
   size_t count = 0;
 
-  while (*temp_str != '\0') {
+  while (json_peek(*str_ptr, ctx->end) != '\0') {
     // Skip any accidental whitespace
-    json_skip_whitespace(&temp_str);
+    json_context_skip_whitespace(ctx, str_ptr);
+    result(json_entry) entry_result = json_parse_entry(ctx, str_ptr);
+
+    if (result_is_ok(json_entry)(&entry_result)) {
+      json_entry_t *slot =
+          (json_entry_t *)json_stack_push(ctx, sizeof(json_entry_t));
+      json_entry_t entry = result_unwrap(json_entry)(&entry_result);
 
-    // If the entry could be skipped
-    if (json_skip_entry(&temp_str)) {
-      count++;
+      if (slot != NULL) {
+        *slot = entry;
+        count++;
+      } else {
+        json_context_free_key(ctx, entry.key);
+        json_context_free_element(ctx, &entry.element);
+      }
     }
 
     // Skip any accidental whitespace
-    json_skip_whitespace(&temp_str);
+    json_context_skip_whitespace(ctx, str_ptr);
 
-    if (*temp_str == '}')
+    if (json_peek(*str_ptr, ctx->end) == '}')
       break;
 
     // Skip the ',' to move to the next entry
-    temp_str++;
+    if (*str_ptr < ctx->end)
+      (*str_ptr)++;
   }
 
-  if (count == 0)
+  // Skip the '}' closing brace
+  if (*str_ptr < ctx->end)
+    (*str_ptr)++;
+
+  if (count == 0) {
+    ctx->stack_size = base;
     return result_err(json_element_value)(JSON_ERROR_EMPTY);
+  }
 
-  // ******* Initialize the hash map *******
-  // Now we have a perfectly sized hash map
-  json_entry_t **entries = allocN(json_entry_t *, count);
-  size_t i;
-  for (i = 0; i < count; i++)
-    entries[i] = NULL;
+  return json_build_object(ctx, base, count);
+}
 
-  // Skip the first '{' character
-  (*str_ptr)++;
+result(json_element_value)
+    json_build_object(json_context_t * ctx, size_t base, size_t count) {
+  if (ctx->shapes != NULL)
+    return json_build_shaped_object(ctx, base, count);
+
+  // ******* Index the entries *******
+  // A power of two turns the modulo into a mask, and keeping a quarter
+  // of it free keeps the probes short
+  size_t capacity = 4;
+  while (3 * capacity < 4 * count)
+    capacity *= 2;
+
+  json_entry_t *entries = allocN(ctx, json_entry_t, count);
+  json_object_slot_t *slots = allocN(ctx, json_object_slot_t, capacity);
+  json_object_t *object = alloc(ctx, json_object_t);
+
+  if (entries == NULL || slots == NULL || object == NULL) {
+    json_discard_entries(ctx, base, count);
+    json_context_free(ctx, entries);
+    json_context_free(ctx, slots);
+    json_context_free(ctx, object);
+    return result_err(json_element_value)(JSON_ERROR_INVALID_VALUE);
+  }
 
-  json_skip_whitespace(str_ptr);
+  memcpy(entries, json_stack_at(ctx, json_entry_t, base),
+         count * sizeof(json_entry_t));
+  memset(slots, 0, capacity * sizeof(json_object_slot_t));
 
-  while (**str_ptr != '\0') {
-    // Skip any accidental whitespace
-    json_skip_whitespace(str_ptr);
-    result(json_entry) entry_result = json_parse_entry(str_ptr);
+  size_t i;
+  for (i = 0; i < count; i++) {
+    const uint64_t hash =
+        json_key_hash(entries[i].key.data, entries[i].key.length);
+    size_t slot = hash & (capacity - 1);
 
-    if (result_is_ok(json_entry)(&entry_result)) {
-      json_entry_t entry = result_unwrap(json_entry)(&entry_result);
-      uint64_t bucket = json_key_hash(entry.key) % count;
-
-      // Bucket size is exactly count. So there will be at max
-      // count misses in the worst case
-      size_t i;
-      for (i = 0; i < count; i++) {
-        if (entries[bucket] == NULL) {
-          json_entry_t *temp_entry = alloc(json_entry_t);
-          memcpy(temp_entry, &entry, sizeof(json_entry_t));
-          entries[bucket] = temp_entry;
-          break;
-        }
+    while (slots[slot].entry != NULL)
+      slot = (slot + 1) & (capacity - 1);
 
-        bucket = (bucket + 1) % count;
-      }
-    }
+    slots[slot].hash = hash;
+    slots[slot].entry = &entries[i];
+  }
 
-    // Skip any accidental whitespace
-    json_skip_whitespace(str_ptr);
+  ctx->stack_size = base;
 
-    if (**str_ptr == '}')
-      break;
+  object->count = count;
+  object->entries = entries;
+  object->slots = slots;
+  object->capacity = capacity;
+  object->shape = NULL;
+  object->values = NULL;
 
-    // Skip the ',' to move to the next entry
-    (*str_ptr)++;
+  json_element_value_t retval = {0};
+  retval.as_object = object;
+
+  return result_ok(json_element_value)(retval);
+}
+
+result(json_element_value)
+    json_build_shaped_object(json_context_t * ctx, size_t base,
+                             size_t count) {
+  const json_entry_t *collected = json_stack_at(ctx, json_entry_t, base);
+
+  json_shape_t *shape = json_shape_intern(ctx->shapes, collected, count);
+  json_element_t *values = allocN(ctx, json_element_t, count);
+  json_object_t *object = alloc(ctx, json_object_t);
+
+  if (shape == NULL || values == NULL || object == NULL) {
+    json_discard_entries(ctx, base, count);
+    json_context_free(ctx, values);
+    json_context_free(ctx, object);
+    return result_err(json_element_value)(JSON_ERROR_INVALID_VALUE);
   }
 
-  // Skip the '}' closing brace
-  (*str_ptr)++;
+  size_t i;
+  for (i = 0; i < count; i++)
+    values[i] = collected[i].element;
+
+  ctx->stack_size = base;
 
-  json_object_t *object = alloc(json_object_t);
   object->count = count;
-  object->entries = entries;
+  object->entries = NULL;
+  object->slots = NULL;
+  object->capacity = 0;
+  object->shape = shape;
+  object->values = values;
 
   json_element_value_t retval = {0};
   retval.as_object = object;
@@ -576,71 +1049,151 @@ result(json_element_value) json_parse_object(json_string_t * str_ptr) {
   return result_ok(json_element_value)(retval);
 }
 
-uint64_t json_key_hash(json_string_t str) {
-  uint64_t hash = 0;
+void json_discard_entries(json_context_t * ctx, size_t base, size_t count) {
+  json_entry_t *collected = json_stack_at(ctx, json_entry_t, base);
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    json_context_free_key(ctx, collected[i].key);
+    json_context_free_element(ctx, &collected[i].element);
+  }
+
+  ctx->stack_size = base;
+}
+
+uint64_t json_key_hash(json_string_t str, size_t len) {
+  uint64_t hash = 0x9E3779B97F4A7C15ULL ^ len;
+  uint64_t word = 0;
+  uint32_t half;
+
+  // Whole words are folded in with a multiply. The tail is read with
+  // loads that may overlap what was already read, never byte by byte
+  if (len > 8) {
+    json_string_t last = str + len - 8;
+
+    for (; str < last; str += 8) {
+      memcpy(&word, str, 8);
+      hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+      hash ^= hash >> 32;
+    }
+    memcpy(&word, last, 8);
+  } else if (len >= 4) {
+    memcpy(&half, str, 4);
+    word = half;
+    memcpy(&half, str + len - 4, 4);
+    word |= (uint64_t)half << 32;
+  } else if (len > 0) {
+    word = (uint64_t)(unsigned char)str[0] << 16 |
+           (uint64_t)(unsigned char)str[len / 2] << 8 |
+           (unsigned char)str[len - 1];
+  }
+
+  hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
 
-  while (*str != '\0')
-    hash += (hash * 31) + *str++;
+  // Spread the high bits down, slots are picked by the low ones
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
 
   return hash;
 }
 
-result(json_element_value) json_parse_array(json_string_t * str_ptr) {
+result(json_element_value)
+    json_parse_array(json_context_t * ctx, json_string_t * str_ptr) {
   // Skip the starting '[' character
   (*str_ptr)++;
 
-  json_skip_whitespace(str_ptr);
+  json_context_skip_whitespace(ctx, str_ptr);
 
   // Unfortunately the array is empty
-  if (**str_ptr == ']') {
+  if (json_peek(*str_ptr, ctx->end) == ']') {
     // Skip the end ']'
     (*str_ptr)++;
     return result_err(json_element_value)(JSON_ERROR_EMPTY);
   }
 
+  result(json_element_value) array_result =
+      json_parse_array_elements(ctx, str_ptr);
+
+  // Skip the ']' closing array
+  if (*str_ptr < ctx->end)
+    (*str_ptr)++;
+
+  return array_result;
+}
+
+result(json_element_value)
+    json_parse_array_elements(json_context_t * ctx, json_string_t * str_ptr) {
+  // Collect the elements on the scratch stack and copy them once into
+  // an exactly sized array when the ']' is reached
+  size_t base = ctx->stack_size;
   size_t count = 0;
-  json_element_t *elements = NULL;
 
-  while (**str_ptr != '\0') {
-    json_skip_whitespace(str_ptr);
+  while (json_peek(*str_ptr, ctx->end) != '\0') {
+    json_context_skip_whitespace(ctx, str_ptr);
 
     // Guess the type
-    result(json_element_type) type_result = json_guess_element_type(*str_ptr);
+    result(json_element_type) type_result =
+        json_guess_element_type(*str_ptr, ctx->end);
     if (result_is_ok(json_element_type)(&type_result)) {
       json_element_type_t type =
           result_unwrap(json_element_type)(&type_result);
 
       // Parse the value based on guessed type
       result(json_element_value) value_result =
-          json_parse_element_value(str_ptr, type);
+          json_parse_element_value(ctx, str_ptr, type);
       if (result_is_ok(json_element_value)(&value_result)) {
-        json_element_value_t value =
-            result_unwrap(json_element_value)(&value_result);
-
-        count++;
-        elements = reallocN(elements, json_element_t, count);
-        elements[count - 1].type = type;
-        elements[count - 1].value = value;
+        json_element_t *slot =
+            (json_element_t *)json_stack_push(ctx, sizeof(json_element_t));
+        json_element_t element;
+        element.type = type;
+        element.value = result_unwrap(json_element_value)(&value_result);
+
+        if (slot != NULL) {
+          *slot = element;
+          count++;
+        } else {
+          json_context_free_element(ctx, &element);
+        }
       }
 
-      json_skip_whitespace(str_ptr);
+      json_context_skip_whitespace(ctx, str_ptr);
     }
 
     // Reached the end
-    if (**str_ptr == ']')
+    if (json_peek(*str_ptr, ctx->end) == ']')
       break;
 
     // Skip the ','
-    (*str_ptr)++;
+    if (*str_ptr < ctx->end)
+      (*str_ptr)++;
   }
 
-  // Skip the ']' closing array
-  (*str_ptr)++;
-
-  if (count == 0)
+  if (count == 0) {
+    ctx->stack_size = base;
     return result_err(json_element_value)(JSON_ERROR_EMPTY);
+  }
+
+  json_element_t *elements = allocN(ctx, json_element_t, count);
+  json_array_t *array = alloc(ctx, json_array_t);
+
+  if (elements == NULL || array == NULL) {
+    json_element_t *collected = json_stack_at(ctx, json_element_t, base);
+    size_t i;
+
+    for (i = 0; i < count; i++)
+      json_context_free_element(ctx, &collected[i]);
+
+    ctx->stack_size = base;
+    json_context_free(ctx, elements);
+    json_context_free(ctx, array);
+    return result_err(json_element_value)(JSON_ERROR_INVALID_VALUE);
+  }
+
+  memcpy(elements, json_stack_at(ctx, json_element_t, base),
+         count * sizeof(json_element_t));
+  ctx->stack_size = base;
 
-  json_array_t *array = alloc(json_array_t);
   array->count = count;
   array->elements = elements;
 
@@ -650,21 +1203,21 @@ result(json_element_value) json_parse_array(json_string_t * str_ptr) {
   return result_ok(json_element_value)(retval);
 }
 
-result(json_element_value) json_parse_boolean(json_string_t * str_ptr) {
+result(json_element_value)
+    json_parse_boolean(json_context_t * ctx, json_string_t * str_ptr) {
   json_boolean_t output;
+  size_t left = ctx->end - *str_ptr;
 
-  switch (**str_ptr) {
-  case 't':
+  if (left >= 4 && memcmp(*str_ptr, "true", 4) == 0) {
     output = _true;
     (*str_ptr) += 4;
-    break;
-
-  case 'f':
+  } else if (left >= 5 && memcmp(*str_ptr, "false", 5) == 0) {
     output = _false;
     (*str_ptr) += 5;
-    break;
+  } else {
+    return result_err(json_element_value)(JSON_ERROR_INVALID_VALUE);
   }
-  
+
   json_element_value_t retval = {0};
   retval.as_boolean = output;
 
@@ -673,60 +1226,90 @@ result(json_element_value) json_parse_boolean(json_string_t * str_ptr) {
 
 result(json_element)
     json_object_find(json_object_t * obj, json_string_t key) {
-  if (key == NULL || strlen(key) == 0)
+  if (key == NULL)
+    return result_err(json_element)(JSON_ERROR_INVALID_KEY);
+
+  return json_object_find_n(obj, key, strlen(key));
+}
+
+result(json_element) json_object_find_n(json_object_t * obj,
+                                        json_string_t key, size_t len) {
+  if (key == NULL || len == 0)
+    return result_err(json_element)(JSON_ERROR_INVALID_KEY);
+
+  return json_object_find_hashed(obj, key, len, json_key_hash(key, len));
+}
+
+result(json_element) json_object_find_hashed(const json_object_t * obj,
+                                             json_string_t key, size_t len,
+                                             uint64_t hash) {
+  // Empty objects have no index to probe
+  if (obj->count == 0)
     return result_err(json_element)(JSON_ERROR_INVALID_KEY);
 
-  uint64_t bucket = json_key_hash(key) % obj->count;
+  if (obj->shape != NULL) {
+    result_try(json_element, size, index,
+               json_shape_find_hashed(obj->shape, key, len, hash));
+    return result_ok(json_element)(obj->values[index]);
+  }
 
-  // Bucket size is exactly obj->count. So there will be at max
-  // obj->count misses in the worst case
-  size_t i;
-  for (i = 0; i < obj->count; i++) {
-    json_entry_t *entry = obj->entries[bucket];
-    if (strcmp(key, entry->key) == 0)
-      return result_ok(json_element)(entry->element);
+  const size_t mask = obj->capacity - 1;
+  size_t slot = hash & mask;
 
-    bucket = (bucket + 1) % obj->count;
+  // The index always has a free slot, which ends the probe
+  while (obj->slots[slot].entry != NULL) {
+    const json_object_slot_t *candidate = &obj->slots[slot];
+
+    // Keys from the pool a document was parsed with match on their
+    // pointer alone
+    if (candidate->hash == hash && candidate->entry->key.length == len &&
+        (candidate->entry->key.data == key ||
+         memcmp(key, candidate->entry->key.data, len) == 0))
+      return result_ok(json_element)(candidate->entry->element);
+
+    slot = (slot + 1) & mask;
   }
 
   return result_err(json_element)(JSON_ERROR_INVALID_KEY);
 }
 
-_bool json_skip_entry(json_string_t * str_ptr) {
-  json_skip_string(str_ptr);
+_bool json_skip_entry(json_string_t * str_ptr, json_string_t end) {
+  json_skip_string(str_ptr, end);
 
-  json_skip_whitespace(str_ptr);
+  json_skip_whitespace(str_ptr, end);
 
   // Skip the ':' delimiter
-  (*str_ptr)++;
+  if (*str_ptr < end)
+    (*str_ptr)++;
 
-  json_skip_whitespace(str_ptr);
+  json_skip_whitespace(str_ptr, end);
 
-  result(json_element_type) type_result = json_guess_element_type(*str_ptr);
+  result(json_element_type) type_result =
+      json_guess_element_type(*str_ptr, end);
   if (result_is_err(json_element_type)(&type_result))
     return _false;
 
   json_element_type_t type =
       result_unwrap(json_element_type)(&type_result);
 
-  return json_skip_element_value(str_ptr, type);
+  return json_skip_element_value(str_ptr, end, type);
 }
 
-_bool json_skip_element_value(json_string_t * str_ptr,
+_bool json_skip_element_value(json_string_t * str_ptr, json_string_t end,
                              json_element_type_t type) {
   switch (type) {
   case JSON_ELEMENT_TYPE_STRING:
-    return json_skip_string(str_ptr);
+    return json_skip_string(str_ptr, end);
   case JSON_ELEMENT_TYPE_NUMBER:
-    return json_skip_number(str_ptr);
+    return json_skip_number(str_ptr, end);
   case JSON_ELEMENT_TYPE_OBJECT:
-    return json_skip_object(str_ptr);
+    return json_skip_object(str_ptr, end);
   case JSON_ELEMENT_TYPE_ARRAY:
-    return json_skip_array(str_ptr);
+    return json_skip_array(str_ptr, end);
   case JSON_ELEMENT_TYPE_BOOLEAN:
-    return json_skip_boolean(str_ptr);
+    return json_skip_boolean(str_ptr, end);
   case JSON_ELEMENT_TYPE_NULL:
-    json_skip_null(str_ptr);
+    json_skip_null(str_ptr, end);
     return _false;
 
   default:
@@ -734,229 +1317,158 @@ _bool json_skip_element_value(json_string_t * str_ptr,
   }
 }
 
-_bool json_skip_string(json_string_t * str_ptr) {
+_bool json_skip_string(json_string_t * str_ptr, json_string_t end) {
   // Skip the initial '"'
-  (*str_ptr)++;
+  if (*str_ptr < end)
+    (*str_ptr)++;
 
   // Find the length till the last '"'
-  size_t len = json_string_len(*str_ptr);
+  size_t len = json_string_len(*str_ptr, end);
 
   // Skip till the end of the string
-  (*str_ptr) += len + 1;
+  if (len > 0 || *str_ptr < end)
+    (*str_ptr) += len + 1;
 
   return len > 0;
 }
 
-_bool json_skip_number(json_string_t * str_ptr) {
-  while (json_is_number(**str_ptr)) {
+_bool json_skip_number(json_string_t * str_ptr, json_string_t end) {
+  while (*str_ptr < end && json_is_number(**str_ptr)) {
     (*str_ptr)++;
   }
 
   return _true;
 }
 
-_bool json_skip_object(json_string_t * str_ptr) {
+_bool json_skip_object(json_string_t * str_ptr, json_string_t end) {
   // Skip the first '{' character
   (*str_ptr)++;
 
-  json_skip_whitespace(str_ptr);
+  json_skip_whitespace(str_ptr, end);
 
-  if (**str_ptr == '}') {
+  if (json_peek(*str_ptr, end) == '}') {
     // Skip the end '}'
     (*str_ptr)++;
     return _false;
   }
 
-  while (**str_ptr != '\0') {
+  while (json_peek(*str_ptr, end) != '\0') {
     // Skip any accidental whitespace
-    json_skip_whitespace(str_ptr);
+    json_skip_whitespace(str_ptr, end);
 
-    json_skip_entry(str_ptr);
+    json_skip_entry(str_ptr, end);
 
     // Skip any accidental whitespace
-    json_skip_whitespace(str_ptr);
+    json_skip_whitespace(str_ptr, end);
 
-    if (**str_ptr == '}')
+    if (json_peek(*str_ptr, end) == '}')
       break;
 
     // Skip the ',' to move to the next entry
-    (*str_ptr)++;
+    if (*str_ptr < end)
+      (*str_ptr)++;
   }
 
   // Skip the '}' closing brace
-  (*str_ptr)++;
+  if (*str_ptr < end)
+    (*str_ptr)++;
 
   return _true;
 }
 
-_bool json_skip_array(json_string_t * str_ptr) {
+_bool json_skip_array(json_string_t * str_ptr, json_string_t end) {
   // Skip the starting '[' character
   (*str_ptr)++;
 
-  json_skip_whitespace(str_ptr);
+  json_skip_whitespace(str_ptr, end);
 
   // Unfortunately the array is empty
-  if (**str_ptr == ']') {
+  if (json_peek(*str_ptr, end) == ']') {
     // Skip the end ']'
     (*str_ptr)++;
     return _false;
   }
 
-  while (**str_ptr != '\0') {
-    json_skip_whitespace(str_ptr);
+  while (json_peek(*str_ptr, end) != '\0') {
+    json_skip_whitespace(str_ptr, end);
 
     // Guess the type
-    result(json_element_type) type_result = json_guess_element_type(*str_ptr);
+    result(json_element_type) type_result =
+        json_guess_element_type(*str_ptr, end);
     if (result_is_ok(json_element_type)(&type_result)) {
       json_element_type_t type =
           result_unwrap(json_element_type)(&type_result);
 
       // Parse the value based on guessed type
-      json_skip_element_value(str_ptr, type);
+      json_skip_element_value(str_ptr, end, type);
 
-      json_skip_whitespace(str_ptr);
+      json_skip_whitespace(str_ptr, end);
     }
 
     // Reached the end
-    if (**str_ptr == ']')
+    if (json_peek(*str_ptr, end) == ']')
       break;
 
     // Skip the ','
-    (*str_ptr)++;
+    if (*str_ptr < end)
+      (*str_ptr)++;
   }
 
   // Skip the ']' closing array
-  (*str_ptr)++;
+  if (*str_ptr < end)
+    (*str_ptr)++;
 
   return _true;
 }
 
-_bool json_skip_boolean(json_string_t * str_ptr) {
-  switch (**str_ptr) {
+_bool json_skip_boolean(json_string_t * str_ptr, json_string_t end) {
+  size_t left = end - *str_ptr;
+
+  switch (json_peek(*str_ptr, end)) {
   case 't':
-    (*str_ptr) += 4;
-    return _true;
+    (*str_ptr) += left < 4 ? left : 4;
+    return left >= 4;
 
   case 'f':
-    (*str_ptr) += 5;
-    return _true;
+    (*str_ptr) += left < 5 ? left : 5;
+    return left >= 5;
   }
 
   return _false;
 }
 
-void json_skip_null(json_string_t * str_ptr) { (*str_ptr) += 4; }
+void json_skip_null(json_string_t * str_ptr, json_string_t end) {
+  size_t left = end - *str_ptr;
 
-void json_print(json_element_t * element, int indent) {
-  json_print_element(element, indent, 0);
+  (*str_ptr) += left < 4 ? left : 4;
 }
 
-void json_print_element(json_element_t * element, int indent,
-                        int indent_level) {
-
-  switch (element->type) {
-  case JSON_ELEMENT_TYPE_STRING:
-    json_print_string(element->value.as_string);
-    break;
-  case JSON_ELEMENT_TYPE_NUMBER:
-    json_print_number(element->value.as_number);
-    break;
-  case JSON_ELEMENT_TYPE_OBJECT:
-    json_print_object(element->value.as_object, indent, indent_level);
-    break;
-  case JSON_ELEMENT_TYPE_ARRAY:
-    json_print_array(element->value.as_array, indent, indent_level);
-    break;
-  case JSON_ELEMENT_TYPE_BOOLEAN:
-    json_print_boolean(element->value.as_boolean);
-    break;
-  case JSON_ELEMENT_TYPE_NULL:
-    break;
-    // Do nothing
-  }
-}
-
-void json_print_string(json_string_t string) { printf("\"%s\"", string); }
-
-void json_print_number(json_number_t number) {
-  switch (number.type) {
-  case JSON_NUMBER_TYPE_DOUBLE:
-    printf("%f", number.value.as_double);
-    break;
-
-  case JSON_NUMBER_TYPE_LONG:
-    printf("%ld", number.value.as_long);
-    break;
-  }
+void json_free(json_element_t * element) {
+  json_free_element(element, _true, _true);
 }
 
-void json_print_object(json_object_t * object, int indent,
-                       int indent_level) {
-  printf("{\n");
-
-  size_t i;
-  for (i = 0; i < object->count; i++) {
-  	int j;
-    for (j = 0; j < indent * (indent_level + 1); j++)
-      printf(" ");
-
-    json_entry_t *entry = object->entries[i];
-
-    json_print_string(entry->key);
-    printf(": ");
-    json_print_element(&entry->element, indent, indent_level + 1);
-
-    if (i != object->count - 1)
-      printf(",");
-    printf("\n");
-  }
-
-  int j;
-  for (j = 0; j < indent * indent_level; j++)
-    printf(" ");
-  printf("}");
-}
-
-void json_print_array(json_array_t * array, int indent, int indent_level) {
-  printf("[\n");
-
-  {
-	  size_t i;
-	  for (i = 0; i < array->count; i++) {
-	    json_element_t element = array->elements[i];
-		int j;
-	    for (j = 0; j < indent * (indent_level + 1); j++)
-	      printf(" ");
-	    json_print_element(&element, indent, indent_level + 1);
-
-	    if (i != array->count - 1)
-	      printf(",");
-	    printf("\n");
-	  }
-  }
-
-  int i;
-  for (i = 0; i < indent * indent_level; i++)
-    printf(" ");
-  printf("]");
+void json_free_insitu(json_element_t * element) {
+  json_free_element(element, _false, _false);
 }
 
-void json_print_boolean(json_boolean_t boolean) {
-  printf("%s", boolean ? "true" : "false");
+void json_free_interned(json_element_t * element) {
+  json_free_element(element, _true, _false);
 }
 
-void json_free(json_element_t * element) {
+void json_free_element(json_element_t * element, _bool owns_strings,
+                       _bool owns_keys) {
   switch (element->type) {
   case JSON_ELEMENT_TYPE_STRING:
-    json_free_string(element->value.as_string);
+    if (owns_strings)
+      json_free_string(element->value.as_string);
     break;
 
   case JSON_ELEMENT_TYPE_OBJECT:
-    json_free_object(element->value.as_object);
+    json_free_object(element->value.as_object, owns_strings, owns_keys);
     break;
 
   case JSON_ELEMENT_TYPE_ARRAY:
-    json_free_array(element->value.as_array);
+    json_free_array(element->value.as_array, owns_strings, owns_keys);
     break;
 
   case JSON_ELEMENT_TYPE_NUMBER:
@@ -967,51 +1479,63 @@ void json_free(json_element_t * element) {
   }
 }
 
-void json_free_string(json_string_t string) { free((void *)string); }
+void json_free_string(json_string_view_t string) { dealloc(string.data); }
 
-void json_free_object(json_object_t * object) {
+void json_free_object(json_object_t * object, _bool owns_strings,
+                      _bool owns_keys) {
   if (object == NULL)
     return;
 
   if (object->count == 0) {
-    free(object);
+    dealloc(object);
     return;
   }
-
+
   size_t i;
+
+  // Shaped objects only own their values, the keys are the shape's
+  if (object->shape != NULL) {
+    for (i = 0; i < object->count; i++)
+      json_free_element(&object->values[i], owns_strings, owns_keys);
+
+    dealloc(object->values);
+    dealloc(object);
+    return;
+  }
+
   for (i = 0; i < object->count; i++) {
-    json_entry_t *entry = object->entries[i];
+    json_entry_t *entry = &object->entries[i];
 
-    if (entry != NULL) {
-      free((void *)entry->key);
-      json_free(&entry->element);
-      free(entry);
-    }
+    if (owns_keys)
+      dealloc(entry->key.data);
+    json_free_element(&entry->element, owns_strings, owns_keys);
   }
 
-  free(object->entries);
-  free(object);
+  dealloc(object->entries);
+  dealloc(object->slots);
+  dealloc(object);
 }
 
-void json_free_array(json_array_t * array) {
+void json_free_array(json_array_t * array, _bool owns_strings,
+                     _bool owns_keys) {
   if (array == NULL)
     return;
 
   if (array->count == 0) {
-    free(array);
+    dealloc(array);
     return;
   }
 
-  // Recursively free each element in the array
+  // Recursively free each element in the array
   size_t i;
   for (i = 0; i < array->count; i++) {
     json_element_t element = array->elements[i];
-    json_free(&element);
+    json_free_element(&element, owns_strings, owns_keys);
   }
 
   // Lastly free
-  free(array->elements);
-  free(array);
+  dealloc(array->elements);
+  dealloc(array);
 }
 
 json_string_t json_error_to_string(json_error_t error) {
@@ -1024,87 +1548,290 @@ json_string_t json_error_to_string(json_error_t error) {
     return "Invalid type";
   case JSON_ERROR_INVALID_VALUE:
     return "Invalid value";
+  case JSON_ERROR_ABORTED:
+    return "Aborted";
 
   default:
     return "Unknown error";
   }
 }
 
-size_t json_string_len(json_string_t str) {
-  size_t len = 0;
+#if defined(JSON_SIMD_AVX2)
+
+/**
+ * @brief Bytes looked at by one vector of the string scanners
+ */
+#define JSON_STRING_VECTOR 32
+
+/**
+ * @brief Bitmask of the quotes and backslashes of the vector at `str`
+ */
+static inline uint64_t json_string_special(json_string_t str) {
+  __m256i v = _mm256_loadu_si256((const __m256i *)str);
+
+  return (uint32_t)_mm256_movemask_epi8(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))));
+}
 
+/**
+ * @brief Copies the vector at `str` to `output`
+ */
+static inline void json_string_copy(char *output, json_string_t str) {
+  _mm256_storeu_si256((__m256i *)output,
+                      _mm256_loadu_si256((const __m256i *)str));
+}
+
+#elif defined(JSON_SIMD_SSE2)
+
+#define JSON_STRING_VECTOR 16
+
+static inline uint64_t json_string_special(json_string_t str) {
+  __m128i v = _mm_loadu_si128((const __m128i *)str);
+
+  return (uint32_t)_mm_movemask_epi8(
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+}
+
+static inline void json_string_copy(char *output, json_string_t str) {
+  _mm_storeu_si128((__m128i *)output, _mm_loadu_si128((const __m128i *)str));
+}
+
+#elif defined(JSON_SIMD_NEON)
+
+#define JSON_STRING_VECTOR 16
+
+static inline uint64_t json_string_special(json_string_t str) {
+  uint8x16_t v = vld1q_u8((const uint8_t *)str);
+
+  return json_simd_movemask(
+      vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\'))));
+}
+
+static inline void json_string_copy(char *output, json_string_t str) {
+  vst1q_u8((uint8_t *)output, vld1q_u8((const uint8_t *)str));
+}
+
+#endif
+
+size_t json_string_len(json_string_t str, json_string_t end) {
   json_string_t iter = str;
-  while (*iter != '\0') {
-    if (*iter == '\\')
-      iter += 2;
 
-    if (*iter == '"') {
-      len = iter - str;
-      break;
+  while (iter < end) {
+#if defined(JSON_STRING_VECTOR)
+    if (end - iter >= JSON_STRING_VECTOR) {
+      uint64_t special = json_string_special(iter);
+      if (special == 0) {
+        iter += JSON_STRING_VECTOR;
+        continue;
+      }
+      iter += json_simd_ctz(special);
+    }
+#endif
+
+    if (*iter == '\\') {
+      iter += 2;
+      continue;
     }
 
+    if (*iter == '"')
+      return iter - str;
+
     iter++;
   }
 
-  return len;
+  return 0;
 }
 
-result(json_string)
-    json_unescape_string(json_string_t str, size_t len) {
-  size_t count = 0;
-  json_string_t iter = str;
+result(json_string_view)
+    json_unescape_string(json_context_t * ctx, json_string_t str, size_t len) {
+  char *output;
 
-  while ((size_t)(iter - str) < len) {
-    if (*iter == '\\')
-      iter++;
+  if (ctx->insitu) {
+    // The unescaped string is never longer than the escaped one, so it
+    // can be written over itself. The closing quote becomes the '\0'
+    output = (char *)str;
+  } else {
+    // For the same reason the escaped length is enough, without
+    // counting the unescaped one first
+    output = allocN(ctx, char, len + 1);
+    if (output == NULL)
+      return result_err(json_string_view)(JSON_ERROR_INVALID_VALUE);
+  }
 
-    count++;
-    iter++;
+  result(size) length_result = json_unescape_into(output, str, len);
+  if (result_is_err(size)(&length_result)) {
+    if (!ctx->insitu)
+      json_context_free(ctx, output);
+    return result_map_err(json_string_view, size, &length_result);
+  }
+
+  json_string_view_t view = {0};
+  view.data = output;
+  view.length = result_unwrap(size)(&length_result);
+
+  return result_ok(json_string_view)(view);
+}
+
+size_t json_unescape_run(char *output, json_string_t str, size_t len) {
+  size_t copied = 0;
+
+#if defined(JSON_STRING_VECTOR)
+  // A vector is only stored whole when it has no escape, so in place the
+  // bytes it overwrites have all been read
+  while (len - copied >= JSON_STRING_VECTOR) {
+    uint64_t special = json_string_special(str + copied);
+    if (special != 0) {
+      size_t run = json_simd_ctz(special);
+      memmove(output + copied, str + copied, run);
+      return copied + run;
+    }
+
+    json_string_copy(output + copied, str + copied);
+    copied += JSON_STRING_VECTOR;
+  }
+#endif
+
+  while (copied < len && str[copied] != '"' && str[copied] != '\\') {
+    output[copied] = str[copied];
+    copied++;
+  }
+
+  return copied;
+}
+
+_bool json_unescape_hex(json_string_t str, uint32_t *code) {
+  int i;
+
+  *code = 0;
+  for (i = 0; i < 4; i++) {
+    char ch = str[i];
+
+    if (ch >= '0' && ch <= '9')
+      *code = *code << 4 | (uint32_t)(ch - '0');
+    else if (ch >= 'a' && ch <= 'f')
+      *code = *code << 4 | (uint32_t)(ch - 'a' + 10);
+    else if (ch >= 'A' && ch <= 'F')
+      *code = *code << 4 | (uint32_t)(ch - 'A' + 10);
+    else
+      return _false;
+  }
+
+  return _true;
+}
+
+size_t json_utf8_encode(uint32_t code, char *output) {
+  if (code < 0x80) {
+    output[0] = (char)code;
+    return 1;
   }
 
-  char *output = allocN(char, count + 1);
+  if (code < 0x800) {
+    output[0] = (char)(0xC0 | code >> 6);
+    output[1] = (char)(0x80 | (code & 0x3F));
+    return 2;
+  }
+
+  if (code < 0x10000) {
+    output[0] = (char)(0xE0 | code >> 12);
+    output[1] = (char)(0x80 | (code >> 6 & 0x3F));
+    output[2] = (char)(0x80 | (code & 0x3F));
+    return 3;
+  }
+
+  output[0] = (char)(0xF0 | code >> 18);
+  output[1] = (char)(0x80 | (code >> 12 & 0x3F));
+  output[2] = (char)(0x80 | (code >> 6 & 0x3F));
+  output[3] = (char)(0x80 | (code & 0x3F));
+  return 4;
+}
+
+result(size) json_unescape_into(char *output, json_string_t str, size_t len) {
+  size_t in = 0;
   size_t offset = 0;
-  iter = str;
 
-  while ((size_t)(iter - str) < len) {
-    if (*iter == '\\') {
-      iter++;
-
-      switch (*iter) {
-      case 'b':
-        output[offset] = '\b';
-        break;
-      case 'f':
-        output[offset] = '\f';
-        break;
-      case 'n':
-        output[offset] = '\n';
-        break;
-      case 'r':
-        output[offset] = '\r';
-        break;
-      case 't':
-        output[offset] = '\t';
-        break;
-      case '"':
-        output[offset] = '"';
-        break;
-      case '\\':
-        output[offset] = '\\';
-        break;
-      default:
-        return result_err(json_string)(JSON_ERROR_INVALID_VALUE);
+  while (in < len) {
+    size_t run = json_unescape_run(output + offset, str + in, len - in);
+    in += run;
+    offset += run;
+
+    if (in == len)
+      break;
+
+    // A stray quote is kept as it is, only backslashes start escapes
+    if (str[in] != '\\') {
+      output[offset++] = str[in++];
+      continue;
+    }
+
+    if (++in == len)
+      return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+    switch (str[in]) {
+    case 'b':
+      output[offset] = '\b';
+      break;
+    case 'f':
+      output[offset] = '\f';
+      break;
+    case 'n':
+      output[offset] = '\n';
+      break;
+    case 'r':
+      output[offset] = '\r';
+      break;
+    case 't':
+      output[offset] = '\t';
+      break;
+    case '"':
+      output[offset] = '"';
+      break;
+    case '\\':
+      output[offset] = '\\';
+      break;
+    case '/':
+      output[offset] = '/';
+      break;
+
+    case 'u': {
+      uint32_t code, low;
+
+      if (len - in < 5 || !json_unescape_hex(str + in + 1, &code))
+        return result_err(size)(JSON_ERROR_INVALID_VALUE);
+      in += 5;
+
+      // Code points past U+FFFF are a high surrogate followed by a low
+      // one, neither of which may appear alone
+      if (code >= 0xD800 && code <= 0xDBFF) {
+        if (len - in < 6 || str[in] != '\\' || str[in + 1] != 'u' ||
+            !json_unescape_hex(str + in + 2, &low) || low < 0xDC00 ||
+            low > 0xDFFF)
+          return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        in += 6;
+      } else if (code >= 0xDC00 && code <= 0xDFFF) {
+        return result_err(size)(JSON_ERROR_INVALID_VALUE);
       }
-    } else {
-      output[offset] = *iter;
+
+      // The 6 or 12 bytes of the escape are read before the 1 to 4 of
+      // the code point are written over them
+      offset += json_utf8_encode(code, output + offset);
+      continue;
+    }
+
+    default:
+      return result_err(size)(JSON_ERROR_INVALID_VALUE);
     }
 
     offset++;
-    iter++;
+    in++;
   }
 
   output[offset] = '\0';
-  return result_ok(json_string)((json_string_t)output);
+
+  return result_ok(size)(offset);
 }
 
 define_result_type(json_element_type)
@@ -1112,5 +1839,8 @@ define_result_type(json_element_value)
 define_result_type(json_element)
 define_result_type(json_entry)
 define_result_type(json_string)
+define_result_type(json_string_view)
 define_result_type(size)
+define_result_type(json_number)
+define_result_type(json_boolean)
 
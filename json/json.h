@@ -18,6 +18,7 @@ typedef char int8_t;
 typedef short int int16_t;
 typedef int int32_t;
 typedef long long int int64_t;
+typedef size_t uintptr_t;
 #else
 #include <stdint.h>
 #endif
@@ -25,6 +26,7 @@ typedef long long int int64_t;
 #define typed(name) name##_t
 
 typedef const char *json_string_t;
+typedef struct json_string_view_s json_string_view_t;
 typedef _bool json_boolean_t;
 
 typedef union json_number_value_u json_number_value_t;
@@ -35,7 +37,32 @@ typedef union json_element_value_u json_element_value_t;
 typedef struct json_element_s json_element_t;
 typedef struct json_entry_s json_entry_t;
 typedef struct json_object_s json_object_t;
+typedef struct json_object_slot_s json_object_slot_t;
 typedef struct json_array_s json_array_t;
+typedef struct json_arena_chunk_s json_arena_chunk_t;
+typedef struct json_arena_s json_arena_t;
+typedef struct json_alloc_stats_s json_alloc_stats_t;
+typedef struct json_parse_options_s json_parse_options_t;
+typedef struct json_index_s json_index_t;
+typedef struct json_tape_s json_tape_t;
+typedef struct json_tape_ref_s json_tape_ref_t;
+typedef struct json_document_s json_document_t;
+typedef struct json_value_s json_value_t;
+typedef struct json_sax_handler_s json_sax_handler_t;
+typedef struct json_parser_s json_parser_t;
+typedef struct json_ndjson_options_s json_ndjson_options_t;
+typedef struct json_writer_s json_writer_t;
+typedef struct json_key_slot_s json_key_slot_t;
+typedef struct json_key_pool_s json_key_pool_t;
+typedef struct json_shape_slot_s json_shape_slot_t;
+typedef struct json_shape_s json_shape_t;
+typedef struct json_shape_table_s json_shape_table_t;
+typedef struct json_path_step_s json_path_step_t;
+typedef struct json_path_s json_path_t;
+typedef struct json_fields_s json_fields_t;
+typedef struct json_field_s json_field_t;
+typedef struct json_image_s json_image_t;
+typedef struct json_image_ref_s json_image_ref_t;
 
 #define result(name) name##_result_t
 #define result_ok(name) name##_result_ok
@@ -80,6 +107,15 @@ typedef enum json_number_type_e {
   JSON_NUMBER_TYPE_DOUBLE,
 } json_number_type_t;
 
+/**
+ * @brief A length-delimited string. Parsed strings are also
+ * NUL-terminated, but `length` is authoritative
+ */
+struct json_string_view_s {
+  json_string_t data;
+  size_t length;
+};
+
 union json_number_value_u {
   json_number_long_t as_long;
   json_number_double_t as_double;
@@ -91,7 +127,7 @@ struct json_number_s {
 };
 
 union json_element_value_u {
-  json_string_t as_string;
+  json_string_view_t as_string;
   json_number_t as_number;
   json_object_t * as_object;
   json_array_t * as_array;
@@ -104,13 +140,31 @@ struct json_element_s {
 };
 
 struct json_entry_s {
-  json_string_t key;
+  json_string_view_t key;
   json_element_t element;
 };
 
+/**
+ * @brief A slot of the key index of an object: the full hash of a key
+ * next to its entry, which is NULL for a free slot
+ */
+struct json_object_slot_s {
+  uint64_t hash;
+  json_entry_t *entry;
+};
+
 struct json_object_s {
   size_t count;
-  json_entry_t * *entries;
+  /* The entries in document order */
+  json_entry_t *entries;
+  /* Linear probing index over the entries. `capacity` is a power of
+     two and at least a quarter of the slots are free */
+  json_object_slot_t *slots;
+  size_t capacity;
+  /* Objects parsed with a shape table have neither entries nor an
+     index of their own. Value `i` belongs to key `i` of the shape */
+  json_shape_t *shape;
+  json_element_t *values;
 };
 
 struct json_array_s {
@@ -118,19 +172,356 @@ struct json_array_s {
   json_element_t * elements;
 };
 
+/**
+ * @brief Bump allocator backing a parsed document. Every node, entry,
+ * key and element array is carved out of a chunk, and the whole
+ * document is released at once with {json_arena_reset}
+ */
+struct json_arena_s {
+  json_arena_chunk_t * head;
+  size_t chunk_size;
+  size_t allocs;
+  size_t bytes;
+  size_t chunks;
+  size_t reserved;
+};
+
+/**
+ * @brief Allocation counters of the `malloc` backed parse path. Only
+ * updated when the library is built with `JSON_ALLOC_STATS`
+ */
+struct json_alloc_stats_s {
+  size_t allocs;
+  size_t reallocs;
+  size_t frees;
+  size_t bytes;
+};
+
+/**
+ * @brief Structural index of a document: the offset of every
+ * structural character, quote and scalar start, in input order
+ */
+struct json_index_s {
+  uint32_t *positions;
+  size_t count;
+  size_t capacity;
+};
+
+/**
+ * @brief A key of a {json_key_pool_t} and its full hash. Free slots
+ * have a NULL key
+ */
+struct json_key_slot_s {
+  uint64_t hash;
+  json_string_view_t key;
+};
+
+/**
+ * @brief Object keys stored once each. Every parse given the pool
+ * points its entries at the pooled copy of a key instead of allocating
+ * one, so equal keys have equal pointers across all those documents.
+ * The keys live until {json_key_pool_free}. Not safe to share between
+ * parses running at the same time
+ */
+struct json_key_pool_s {
+  /* The key bytes, NUL-terminated */
+  json_arena_t arena;
+  /* Linear probing table over the keys, a power of two at most three
+     quarters full */
+  json_key_slot_t *slots;
+  size_t count;
+  size_t capacity;
+};
+
+/**
+ * @brief A slot of the key index of a shape: the full hash of a key
+ * next to the key, which is NULL for a free slot
+ */
+struct json_shape_slot_s {
+  uint64_t hash;
+  const json_string_view_t *key;
+};
+
+/**
+ * @brief The keys of an object in order, shared by every object with
+ * the same keys in the same order
+ */
+struct json_shape_s {
+  size_t count;
+  /* Pooled keys in document order */
+  json_string_view_t *keys;
+  /* Linear probing index over the keys, laid out like the index of an
+     object */
+  json_shape_slot_t *slots;
+  size_t capacity;
+  /* Hash of the key pointers, which tells shapes apart */
+  uint64_t hash;
+};
+
+/**
+ * @brief The shapes of the objects of every document parsed with the
+ * table. Record-shaped documents need a handful, however many records
+ * they hold. The shapes live until {json_shape_table_free}. Not safe
+ * to share between parses running at the same time
+ */
+struct json_shape_table_s {
+  /* Every key of every shape */
+  json_key_pool_t keys;
+  /* The shapes, their key lists and their indexes */
+  json_arena_t arena;
+  /* Linear probing table over the shapes, a power of two at most three
+     quarters full */
+  json_shape_t **slots;
+  size_t count;
+  size_t capacity;
+};
+
+/**
+ * @brief How {json_parse_ex} allocates and where strings live
+ */
+struct json_parse_options_s {
+  /* Arena for the DOM, NULL to use the heap */
+  json_arena_t *arena;
+  /* Unescape strings in place, the input must be writable */
+  json_boolean_t insitu;
+  /* Build a structural index into this buffer first and drive the
+     parse from it, NULL to scan byte by byte */
+  json_index_t *index;
+  /* Take object keys from this pool, NULL to copy every key into the
+     DOM. Heap DOMs are then released with {json_free_interned} */
+  json_key_pool_t *keys;
+  /* Give objects a shared shape from this table and only store their
+     values, NULL for objects with their own entries. The keys then
+     come from the table and `keys` is ignored. Heap DOMs are released
+     with {json_free_interned} */
+  json_shape_table_t *shapes;
+};
+
+/**
+ * @brief A document flattened into one array of 64-bit words in
+ * document order, with the string bytes in a side buffer. Containers
+ * store the index past their closing word, so a whole subtree is
+ * skipped in one step. Both buffers are kept for the next parse
+ */
+struct json_tape_s {
+  uint64_t *words;
+  size_t count;
+  size_t capacity;
+  char *strings;
+  size_t strings_size;
+  size_t strings_capacity;
+};
+
+/**
+ * @brief A value on a tape, addressed by the index of its first word
+ */
+struct json_tape_ref_s {
+  const json_tape_t *tape;
+  size_t index;
+};
+
+/**
+ * @brief A document read on demand. Nothing is parsed up front, values
+ * are scanned in place when they are accessed through a {json_value_t}
+ */
+struct json_document_s {
+  json_string_t start;
+  json_string_t end;
+  /* Strings with escapes are unescaped into here */
+  json_arena_t strings;
+};
+
+/**
+ * @brief A cursor at the first byte of a value of an on-demand document
+ */
+struct json_value_s {
+  json_document_t *document;
+  json_string_t ptr;
+};
+
+/**
+ * @brief Index of a path step whose key is not a number
+ */
+#define JSON_PATH_NO_INDEX ((size_t)-1)
+
+/**
+ * @brief One step of a compiled path. Objects are entered by the key,
+ * arrays by the index the key spells
+ */
+struct json_path_step_s {
+  json_string_view_t key;
+  /* {json_object_find_n} hashes keys this way on every call */
+  uint64_t hash;
+  /* {JSON_PATH_NO_INDEX} when the key is not a number */
+  size_t index;
+};
+
+/**
+ * @brief A JSON Pointer or dotted path compiled by {json_path_compile},
+ * to be run against any number of documents
+ */
+struct json_path_s {
+  size_t count;
+  json_path_step_t *steps;
+  /* The unescaped keys of the steps, each NUL-terminated */
+  char *keys;
+};
+
+/**
+ * @brief Fields compiled once by {json_fields_compile} and read out of
+ * any number of records by {json_extract}. Holds the scratch memory of
+ * the scan, so one set must not be used by two threads at a time
+ */
+struct json_fields_s {
+  size_t count;
+  json_path_t *paths;
+  /* Paths still followed at each depth, and where each one ended */
+  size_t *active;
+  json_value_t *values;
+  /* Escaped strings are unescaped into here, reused by every extract */
+  char *strings;
+  size_t strings_capacity;
+};
+
 typedef enum json_error_e {
   JSON_ERROR_EMPTY = 0,
   JSON_ERROR_INVALID_TYPE,
   JSON_ERROR_INVALID_KEY,
-  JSON_ERROR_INVALID_VALUE
+  JSON_ERROR_INVALID_VALUE,
+  JSON_ERROR_ABORTED
 } json_error_t;
 
+/**
+ * @brief Callbacks of {json_sax_parse}. Any of them may be NULL to
+ * ignore the event, and returning false from one stops the parse
+ */
+struct json_sax_handler_s {
+  json_boolean_t (*start_object)(void *user);
+  json_boolean_t (*end_object)(void *user);
+  json_boolean_t (*start_array)(void *user);
+  json_boolean_t (*end_array)(void *user);
+  /* Keys and strings only live until the callback returns, and are
+     not NUL-terminated */
+  json_boolean_t (*key)(void *user, json_string_view_t key);
+  json_boolean_t (*string)(void *user, json_string_view_t value);
+  json_boolean_t (*number)(void *user, json_number_t value);
+  json_boolean_t (*boolean)(void *user, json_boolean_t value);
+  json_boolean_t (*null)(void *user);
+};
+
+/**
+ * @brief Incremental event parser, fed the input in chunks of any
+ * size. A token cut by a chunk boundary is kept until it completes,
+ * so memory is bounded by the nesting depth and the longest token
+ */
+struct json_parser_s {
+  const json_sax_handler_t *handler;
+  void *user;
+  /* Where the parser is, private to the implementation */
+  int state;
+  json_error_t error;
+  /* Kind of every open container, one byte per level */
+  char *stack;
+  size_t depth;
+  size_t stack_capacity;
+  /* The bytes of a token cut by a chunk boundary */
+  char *token;
+  size_t token_size;
+  size_t token_capacity;
+  json_boolean_t token_is_key;
+  json_boolean_t escaped;
+  /* Strings with escapes are unescaped into here */
+  char *strings;
+  size_t strings_capacity;
+  size_t offset;
+};
+
+/**
+ * @brief How {json_ndjson_parse} spreads the records over threads
+ */
+struct json_ndjson_options_s {
+  /* Worker threads including the caller, 0 for one per online core */
+  size_t threads;
+  /* Deliver the records in input order, otherwise as they are parsed */
+  json_boolean_t ordered;
+  /* Bytes of input a worker claims at a time, 0 for the default */
+  size_t batch_size;
+};
+
+/**
+ * @brief Receives the next `len` bytes of output of {json_serialize}.
+ * Return false to stop the serializer
+ */
+typedef json_boolean_t (*json_writer_flush_t)(void *user, json_string_t data,
+                                              size_t len);
+
+/**
+ * @brief Where {json_serialize} puts its output. Without a `flush`
+ * callback everything is kept in `data`, which grows as needed and can
+ * be reused by setting `size` back to 0. With one, `data` is a fixed
+ * buffer handed to the callback whenever it fills up
+ */
+struct json_writer_s {
+  char *data;
+  size_t size;
+  size_t capacity;
+  json_writer_flush_t flush;
+  void *user;
+};
+
+/**
+ * @brief A frozen document image written by {json_image_write}, opened
+ * over the bytes by {json_image_open}. The image only views them, so a
+ * mapped file can be opened without copying or decoding anything
+ */
+struct json_image_s {
+  json_string_t data;
+  size_t size;
+};
+
+/**
+ * @brief A value in an image, addressed by the offset of its node
+ */
+struct json_image_ref_s {
+  const json_image_t *image;
+  size_t offset;
+};
+
 declare_result_type(json_element_type)
 declare_result_type(json_element_value)
 declare_result_type(json_element)
 declare_result_type(json_entry)
 declare_result_type(json_string)
+declare_result_type(json_string_view)
 declare_result_type(size)
+declare_result_type(json_tape_ref)
+declare_result_type(json_number)
+declare_result_type(json_boolean)
+declare_result_type(json_value)
+declare_result_type(json_path)
+declare_result_type(json_fields)
+declare_result_type(json_image_ref)
+
+/**
+ * @brief A field read by {json_extract}. Strings without escapes point
+ * into the input and escaped ones into the {json_fields_t}, until its
+ * next extract. Objects and arrays are not parsed, `as_string` holds
+ * their raw text
+ */
+struct json_field_s {
+  json_boolean_t found;
+  json_element_type_t type;
+  json_element_value_t value;
+};
+
+/**
+ * @brief Receives a record of {json_ndjson_parse}: the offset of its
+ * line in the input and either its root element or why it failed. The
+ * element lives in the arena of a worker, only until the call returns.
+ * Return false to stop the parse
+ */
+typedef json_boolean_t (*json_ndjson_callback_t)(void *user, size_t offset,
+                                                 result(json_element) record);
 
 /**
  * @brief Parses a JSON string into a JSON element {json_element_t}
@@ -141,6 +532,154 @@ declare_result_type(size)
  */
 result(json_element) json_parse(json_string_t json_str);
 
+/**
+ * @brief Parses exactly `len` bytes of JSON. The input does not need
+ * to be NUL-terminated, so it can point into a mapped file
+ *
+ * @param json_str The raw JSON bytes
+ * @param len The number of bytes to parse
+ * @return The parsed {json_element_t} wrapped in a `result` type
+ */
+result(json_element) json_parse_n(json_string_t json_str, size_t len);
+
+/**
+ * @brief Parses exactly `len` bytes of JSON as described by `options`.
+ * {json_parse}, {json_parse_arena} and {json_parse_insitu} are
+ * shorthands for it
+ *
+ * @param json_str The raw JSON bytes, writable for in-situ parses
+ * @param len The number of bytes to parse
+ * @param options The parse options, or NULL for the defaults
+ * @return The parsed {json_element_t} wrapped in a `result` type
+ */
+result(json_element) json_parse_ex(json_string_t json_str, size_t len,
+                                   const json_parse_options_t * options);
+
+/**
+ * @brief Parses a JSON string like {json_parse}, but takes all the DOM
+ * memory from `arena`. The result must not be passed to {json_free},
+ * release it with {json_arena_reset} or {json_arena_free} instead
+ *
+ * @param json_str The raw JSON string
+ * @param arena An arena set up with {json_arena_init}
+ * @return The parsed {json_element_t} wrapped in a `result` type
+ */
+result(json_element)
+    json_parse_arena(json_string_t json_str, json_arena_t * arena);
+
+/**
+ * @brief Parses a mutable JSON buffer in place. Strings are unescaped
+ * inside `json_str` and the DOM points straight into it, so no string
+ * is copied. The buffer is modified and must outlive the DOM
+ *
+ * @param json_str The raw JSON string, overwritten while parsing
+ * @param arena Arena for the containers, or NULL to use the heap and
+ * release them with {json_free_insitu}
+ * @return The parsed {json_element_t} wrapped in a `result` type
+ */
+result(json_element) json_parse_insitu(char *json_str, json_arena_t * arena);
+
+/**
+ * @brief Parses `len` bytes of JSON whose root is a large array on
+ * several threads, each taking a slice of the elements. Any other
+ * document, or one too small to split, is parsed on the calling thread.
+ * For well-formed input the DOM is the one {json_parse_arena} builds
+ *
+ * @param json_str The raw JSON bytes
+ * @param len The number of bytes
+ * @param arena Arena that receives the whole DOM
+ * @param threads The number of threads, 0 for one per online core
+ * @return The parsed {json_element_t} wrapped in a `result` type
+ */
+result(json_element) json_parse_parallel(json_string_t json_str, size_t len,
+                                         json_arena_t * arena,
+                                         size_t threads);
+
+/**
+ * @brief Sets up an empty arena. No memory is reserved until the
+ * first allocation
+ *
+ * @param arena The arena to initialize
+ * @param chunk_size Size in bytes of the first chunk, 0 for the default
+ */
+void json_arena_init(json_arena_t * arena, size_t chunk_size);
+
+/**
+ * @brief Releases every document allocated from `arena` at once. The
+ * newest (largest) chunk is kept for reuse by the next parse
+ *
+ * @param arena The arena to reset
+ */
+void json_arena_reset(json_arena_t * arena);
+
+/**
+ * @brief Returns all memory held by `arena` to the system
+ *
+ * @param arena The arena to free
+ */
+void json_arena_free(json_arena_t * arena);
+
+/**
+ * @brief Copies the heap allocation counters of the `malloc` backed
+ * parse path ({json_parse} and {json_free}) into `stats`
+ *
+ * @param stats Receives the counters, all zero without `JSON_ALLOC_STATS`
+ */
+void json_alloc_stats(json_alloc_stats_t * stats);
+
+/**
+ * @brief Zeroes the heap allocation counters
+ */
+void json_alloc_stats_reset(void);
+
+/**
+ * @brief Builds the structural index of `len` bytes of JSON, reusing
+ * the buffer of `index`. Uses AVX2, SSE2 or NEON when available
+ *
+ * @param index An index zero initialized or reused from a previous build
+ * @param json_str The raw JSON bytes
+ * @param len The number of bytes to index
+ * @return Whether the index was built, false when out of memory or
+ * when the input is larger than 4 GiB
+ */
+json_boolean_t json_index_build(json_index_t * index, json_string_t json_str,
+                                size_t len);
+
+/**
+ * @brief Releases the buffer of a structural index
+ *
+ * @param index The index to free
+ */
+void json_index_free(json_index_t * index);
+
+/**
+ * @brief Name of the instruction set {json_index_build} was compiled for
+ *
+ * @return "avx2", "sse2", "neon" or "scalar"
+ */
+json_string_t json_index_kernel(void);
+
+/**
+ * @brief Deepest nesting of containers {json_validate} accepts
+ */
+#define JSON_VALIDATE_MAX_DEPTH 4096
+
+/**
+ * @brief Checks that `len` bytes are a single JSON value surrounded by
+ * whitespace, following RFC 8259, with strings of valid UTF-8. `\u`
+ * escapes of surrogates must pair up, as the parsers decode them to
+ * UTF-8. Nothing is built or allocated, the input is scanned once with
+ * the kernels of {json_index_build}
+ *
+ * @param json_str The raw JSON bytes
+ * @param len The number of bytes
+ * @param error_offset Receives the offset of the first byte found to be
+ * wrong, or `len` when the input ends early. May be NULL
+ * @return Whether the input is valid JSON
+ */
+json_boolean_t json_validate(json_string_t json_str, size_t len,
+                             size_t *error_offset);
+
 /**
  * @brief Tries to get the element by key. If not found, returns
  * a {JSON_ERROR_INVALID_KEY} error
@@ -152,6 +691,18 @@ result(json_element) json_parse(json_string_t json_str);
 result(json_element)
     json_object_find(json_object_t * object, json_string_t key);
 
+/**
+ * @brief Like {json_object_find}, but the key is `len` bytes long and
+ * does not need to be NUL-terminated
+ *
+ * @param object The object to find the key in
+ * @param key The key of the element to be found
+ * @param len The length of the key in bytes
+ * @return Either a {json_element_t} or {json_error_t}
+ */
+result(json_element) json_object_find_n(json_object_t * object,
+                                        json_string_t key, size_t len);
+
 /**
  * @brief Prints a JSON element {json_element_t} with proper
  * indentation
@@ -160,6 +711,164 @@ result(json_element)
  */
 void json_print(json_element_t * element, int indent);
 
+/**
+ * @brief Sets up a writer for {json_serialize}
+ *
+ * @param flush Receives the output as it is produced, NULL to collect
+ * it in `writer->data`
+ * @param user Passed to `flush`
+ */
+void json_writer_init(json_writer_t * writer, json_writer_flush_t flush,
+                      void *user);
+
+/**
+ * @brief Releases the buffer of a writer
+ */
+void json_writer_free(json_writer_t * writer);
+
+/**
+ * @brief Writes a JSON element {json_element_t} as JSON text. Strings
+ * are escaped and doubles get the fewest digits that read back to the
+ * same value. With a `flush` callback everything written is flushed
+ * before returning
+ *
+ * @param indent The number of spaces to indent each level by, 0 for
+ * compact output on one line
+ * @return The number of bytes written, or why the output is incomplete:
+ * `JSON_ERROR_ABORTED` if the callback stopped it,
+ * `JSON_ERROR_INVALID_VALUE` for an infinite or NaN double or when out
+ * of memory
+ */
+result(size) json_serialize(const json_element_t * element,
+                            json_writer_t * writer, int indent);
+
+/**
+ * @brief Writes a JSON element {json_element_t} in the binary encoding
+ * {json_decode} reads back. Numbers keep their exact value and type,
+ * and strings their length, so decoding does no text processing at all
+ *
+ * @return The number of bytes written, `JSON_ERROR_ABORTED` if the
+ * flush callback stopped it or `JSON_ERROR_INVALID_VALUE` when out of
+ * memory
+ */
+result(size) json_encode(const json_element_t * element,
+                         json_writer_t * writer);
+
+/**
+ * @brief Rebuilds a DOM from `len` bytes written by {json_encode}. The
+ * options are those of {json_parse_ex}: the DOM goes to an arena or the
+ * heap, keys may come from a pool or shapes from a table, and `insitu`
+ * makes strings point into `data` instead of being copied, so `data`
+ * has to outlive the DOM. The structural index does not apply
+ *
+ * @return Either the root {json_element_t}, or `JSON_ERROR_INVALID_VALUE`
+ * if `data` is not a complete encoding
+ */
+result(json_element) json_decode(const void *data, size_t len,
+                                 const json_parse_options_t * options);
+
+/**
+ * @brief Writes a JSON element {json_element_t} as a frozen image. All
+ * links are offsets from the start of the image, so the bytes can be
+ * saved once and read in place by {json_image_open} wherever they are
+ * loaded or mapped. Objects with the same shape share one key index
+ *
+ * @return The number of bytes written, `JSON_ERROR_ABORTED` if the
+ * flush callback stopped it or `JSON_ERROR_INVALID_VALUE` when out of
+ * memory or for strings and containers past 4 GB or 2^32 children
+ */
+result(size) json_image_write(const json_element_t * element,
+                              json_writer_t * writer);
+
+/**
+ * @brief Opens an image for reading in place. Only the header and
+ * trailer are checked, so this takes the same time for any size, and
+ * nothing is allocated. Every access after it checks the offsets it
+ * follows, so a corrupt image gives errors rather than bad reads
+ *
+ * @param image The image to set up, it must outlive the values read
+ * @param data The bytes of the image, aligned to 8 like those of a
+ * mapping or `malloc`, which must outlive `image`
+ * @param size The number of bytes
+ * @return The root value, or `JSON_ERROR_INVALID_VALUE` if `data` is
+ * not an image written for this byte order
+ */
+result(json_image_ref) json_image_open(json_image_t * image,
+                                       const void *data, size_t size);
+
+/**
+ * @brief The type of a value in an image
+ */
+json_element_type_t json_image_type(json_image_ref_t ref);
+
+/**
+ * @brief The number of entries of an object or elements of an array,
+ * 0 for other values
+ */
+size_t json_image_count(json_image_ref_t ref);
+
+/**
+ * @brief The element at position `i` of an array. Returns a
+ * {JSON_ERROR_INVALID_KEY} error when `i` is out of bounds and
+ * {JSON_ERROR_INVALID_TYPE} if `array` is not an array
+ */
+result(json_image_ref) json_image_array_get(json_image_ref_t array,
+                                            size_t i);
+
+/**
+ * @brief Tries to get the value of an object by key, like
+ * {json_object_find}, with one hashed lookup. If not found, returns a
+ * {JSON_ERROR_INVALID_KEY} error, and {JSON_ERROR_INVALID_TYPE} if
+ * `object` is not an object
+ */
+result(json_image_ref) json_image_object_find(json_image_ref_t object,
+                                              json_string_t key);
+
+/**
+ * @brief Like {json_image_object_find}, but the key is `len` bytes long
+ * and does not need to be NUL-terminated
+ */
+result(json_image_ref) json_image_object_find_n(json_image_ref_t object,
+                                                json_string_t key,
+                                                size_t len);
+
+/**
+ * @brief The key of entry `i` of an object, in document order. It points
+ * into the image and is NUL-terminated
+ */
+result(json_string_view) json_image_object_key(json_image_ref_t object,
+                                               size_t i);
+
+/**
+ * @brief The value of entry `i` of an object, in document order
+ */
+result(json_image_ref) json_image_object_value(json_image_ref_t object,
+                                               size_t i);
+
+/**
+ * @brief Reads a string. It points into the image and is NUL-terminated
+ */
+result(json_string_view) json_image_get_string(json_image_ref_t ref);
+
+/**
+ * @brief Reads a number
+ */
+result(json_number) json_image_get_number(json_image_ref_t ref);
+
+/**
+ * @brief Reads a boolean
+ */
+result(json_boolean) json_image_get_boolean(json_image_ref_t ref);
+
+/**
+ * @brief Follows a compiled path through an image, reusing the hashes
+ * of its keys
+ *
+ * @return The value at the path, with the errors of {json_path_find}
+ */
+result(json_image_ref) json_image_path_find(json_image_ref_t root,
+                                            const json_path_t * path);
+
 /**
  * @brief Frees a JSON element {json_element_t} from memory
  *
@@ -167,6 +876,395 @@ void json_print(json_element_t * element, int indent);
  */
 void json_free(json_element_t * element);
 
+/**
+ * @brief Frees a JSON element {json_element_t} returned by
+ * {json_parse_insitu} without an arena. The strings belong to the
+ * parsed buffer and are left alone
+ *
+ * @param element The JSON element {json_element_t} to free
+ */
+void json_free_insitu(json_element_t * element);
+
+/**
+ * @brief Frees a JSON element {json_element_t} parsed with a key pool
+ * {json_key_pool_t} or a shape table {json_shape_table_t} and without
+ * an arena. The keys belong to the pool or table and are left alone
+ *
+ * @param element The JSON element {json_element_t} to free
+ */
+void json_free_interned(json_element_t * element);
+
+/**
+ * @brief Sets up an empty key pool
+ */
+void json_key_pool_init(json_key_pool_t * pool);
+
+/**
+ * @brief Releases a key pool and every key in it. Documents parsed
+ * with the pool must not be used afterwards
+ */
+void json_key_pool_free(json_key_pool_t * pool);
+
+/**
+ * @brief Looks up the pooled copy of a key. Passing its pointer to
+ * {json_object_find_n} matches an entry of a document parsed with the
+ * pool on a pointer compare
+ *
+ * @return The pooled key, or `JSON_ERROR_INVALID_KEY` if no document
+ * parsed with the pool had it
+ */
+result(json_string_view) json_key_pool_find(const json_key_pool_t * pool,
+                                            json_string_t key, size_t len);
+
+/**
+ * @brief Sets up an empty shape table
+ */
+void json_shape_table_init(json_shape_table_t * table);
+
+/**
+ * @brief Releases a shape table, its shapes and their keys. Documents
+ * parsed with the table must not be used afterwards
+ */
+void json_shape_table_free(json_shape_table_t * table);
+
+/**
+ * @brief Looks up the position of a key in a shape. Every object with
+ * that shape holds the key's value at the same position, so a field of
+ * many records is read by comparing `object->shape` with a shape looked
+ * up once and loading `object->values[index]`
+ *
+ * @return The position of the key, or `JSON_ERROR_INVALID_KEY` if the
+ * shape does not have it
+ */
+result(size) json_shape_find(const json_shape_t * shape, json_string_t key,
+                             size_t len);
+
+/**
+ * @brief Parses exactly `len` bytes of JSON onto `tape`, replacing the
+ * document it held. Unlike the DOM, the tape keeps `null`, empty
+ * strings and empty containers
+ *
+ * @param tape A tape zero initialized or reused from a previous parse
+ * @param json_str The raw JSON bytes
+ * @param len The number of bytes to parse
+ * @return The root value wrapped in a `result` type
+ */
+result(json_tape_ref) json_tape_parse(json_tape_t * tape,
+                                      json_string_t json_str, size_t len);
+
+/**
+ * @brief Releases the buffers of a tape
+ *
+ * @param tape The tape to free
+ */
+void json_tape_free(json_tape_t * tape);
+
+/**
+ * @brief The type of a value on a tape
+ */
+json_element_type_t json_tape_type(json_tape_ref_t ref);
+
+/**
+ * @brief The number of entries of an object or elements of an array
+ */
+size_t json_tape_count(json_tape_ref_t ref);
+
+/**
+ * @brief The first child of an object or array. The children of an
+ * object alternate between key strings and values
+ */
+json_tape_ref_t json_tape_first(json_tape_ref_t ref);
+
+/**
+ * @brief The value following `ref`, past all of its children
+ */
+json_tape_ref_t json_tape_next(json_tape_ref_t ref);
+
+/**
+ * @brief Whether iterating with {json_tape_next} reached the end of
+ * the enclosing object or array
+ */
+json_boolean_t json_tape_is_end(json_tape_ref_t ref);
+
+/**
+ * @brief Tries to get the value of an object by key, like
+ * {json_object_find}. If not found, returns a {JSON_ERROR_INVALID_KEY}
+ * error, and {JSON_ERROR_INVALID_TYPE} if `object` is not an object
+ *
+ * @param object The object to find the key in
+ * @param key The key of the value to be found
+ * @return Either a {json_tape_ref_t} or {json_error_t}
+ */
+result(json_tape_ref) json_tape_object_find(json_tape_ref_t object,
+                                            json_string_t key);
+
+/**
+ * @brief Like {json_tape_object_find}, but the key is `len` bytes long
+ * and does not need to be NUL-terminated
+ */
+result(json_tape_ref) json_tape_object_find_n(json_tape_ref_t object,
+                                              json_string_t key, size_t len);
+
+/**
+ * @brief The element at position `i` of an array. Returns a
+ * {JSON_ERROR_INVALID_KEY} error when `i` is out of bounds and
+ * {JSON_ERROR_INVALID_TYPE} if `array` is not an array
+ */
+result(json_tape_ref) json_tape_array_get(json_tape_ref_t array, size_t i);
+
+/**
+ * @brief The string at `ref`, which must be a string
+ */
+json_string_view_t json_tape_get_string(json_tape_ref_t ref);
+
+/**
+ * @brief The number at `ref`, which must be a number
+ */
+json_number_t json_tape_get_number(json_tape_ref_t ref);
+
+/**
+ * @brief The boolean at `ref`, which must be a boolean
+ */
+json_boolean_t json_tape_get_boolean(json_tape_ref_t ref);
+
+/**
+ * @brief Opens `len` bytes of JSON for on-demand access. Only the
+ * leading whitespace is scanned, and the input must outlive `document`
+ *
+ * @param document The document to set up
+ * @param json_str The raw JSON bytes
+ * @param len The number of bytes
+ * @return The root value wrapped in a `result` type
+ */
+result(json_value) json_document_init(json_document_t * document,
+                                      json_string_t json_str, size_t len);
+
+/**
+ * @brief Releases the strings unescaped while reading `document`
+ *
+ * @param document The document to free
+ */
+void json_document_free(json_document_t * document);
+
+/**
+ * @brief The type of a value, from its first byte
+ */
+result(json_element_type) json_value_type(json_value_t value);
+
+/**
+ * @brief The first child of an object or array, {JSON_ERROR_EMPTY} if
+ * it has none. The children of an object alternate between key strings
+ * and values
+ */
+result(json_value) json_value_first(json_value_t value);
+
+/**
+ * @brief The value following `value` in its object or array, skipping
+ * over it unparsed. {JSON_ERROR_EMPTY} once the end is reached
+ */
+result(json_value) json_value_next(json_value_t value);
+
+/**
+ * @brief Tries to get the value of an object by key, like
+ * {json_object_find}. Entries before it are skipped without being
+ * parsed. If not found, returns a {JSON_ERROR_INVALID_KEY} error
+ *
+ * @param object The object to find the key in
+ * @param key The key of the value to be found
+ * @return Either a {json_value_t} or {json_error_t}
+ */
+result(json_value) json_value_find(json_value_t object, json_string_t key);
+
+/**
+ * @brief Like {json_value_find}, but the key is `len` bytes long and
+ * does not need to be NUL-terminated
+ */
+result(json_value) json_value_find_n(json_value_t object, json_string_t key,
+                                     size_t len);
+
+/**
+ * @brief The element at position `i` of an array, skipping the ones
+ * before it. Returns a {JSON_ERROR_INVALID_KEY} error when out of bounds
+ */
+result(json_value) json_value_at(json_value_t array, size_t i);
+
+/**
+ * @brief Reads a string. Strings without escapes point into the input
+ * and are not NUL-terminated, the others are unescaped into the
+ * document and live until {json_document_free}
+ */
+result(json_string_view) json_value_get_string(json_value_t value);
+
+/**
+ * @brief Reads a number
+ */
+result(json_number) json_value_get_number(json_value_t value);
+
+/**
+ * @brief Reads a boolean
+ */
+result(json_boolean) json_value_get_boolean(json_value_t value);
+
+/**
+ * @brief Whether a value is `null`
+ */
+json_boolean_t json_value_is_null(json_value_t value);
+
+/**
+ * @brief Compiles a path once for {json_path_find} and
+ * {json_path_find_value}. A path starting with '/', or the empty path,
+ * is an RFC 6901 JSON Pointer like `/friends/2/name`, where `~1`
+ * stands for '/' and `~0` for '~'. Any other path is dotted, like
+ * `friends.2.name` or `friends[2].name`
+ *
+ * @return Either a {json_path_t} or `JSON_ERROR_INVALID_KEY` for a
+ * malformed path
+ */
+result(json_path) json_path_compile(json_string_t path);
+
+/**
+ * @brief Releases a compiled path
+ */
+void json_path_free(json_path_t * path);
+
+/**
+ * @brief Follows a compiled path through a DOM
+ *
+ * @return The element at the path, `JSON_ERROR_INVALID_KEY` if a key
+ * or index is missing and `JSON_ERROR_INVALID_TYPE` if a step runs into
+ * a value that is not a container
+ */
+result(json_element) json_path_find(const json_element_t * root,
+                                    const json_path_t * path);
+
+/**
+ * @brief Follows a compiled path through the raw text of an on-demand
+ * document, skipping every value off the path without parsing it
+ *
+ * @return The value at the path, with the errors of {json_path_find}
+ */
+result(json_value) json_path_find_value(json_value_t root,
+                                        const json_path_t * path);
+
+/**
+ * @brief Follows `count` compiled paths through the raw text of an
+ * on-demand document in a single pass. Each container on one of the
+ * paths is scanned once for all of them, and the scan stops as soon
+ * as every path is resolved
+ *
+ * @param values Receives the value at each path, with a NULL `ptr`
+ * where the path does not lead anywhere
+ * @return The number of paths found, or `JSON_ERROR_INVALID_VALUE` for
+ * malformed input
+ */
+result(size) json_path_find_values(json_value_t root,
+                                   const json_path_t * paths, size_t count,
+                                   json_value_t * values);
+
+/**
+ * @brief Compiles the fields {json_extract} reads. Each name is a path
+ * of {json_path_compile}, a plain key like `balance` reads a top-level
+ * field
+ *
+ * @return Either a {json_fields_t} or the error of the first path that
+ * does not compile
+ */
+result(json_fields) json_fields_compile(const json_string_t * names,
+                                        size_t count);
+
+/**
+ * @brief Releases compiled fields
+ */
+void json_fields_free(json_fields_t * fields);
+
+/**
+ * @brief Reads the compiled fields out of `len` bytes of JSON in a
+ * single scan, without building a DOM. Values no field asks for are
+ * skipped, and only the values found are decoded, into `out`. Nothing
+ * is allocated unless an escaped string outgrows the buffer of
+ * `fields`
+ *
+ * @param out One {json_field_t} per field, with `found` cleared for
+ * the fields the record does not have
+ * @return The number of fields found, or `JSON_ERROR_INVALID_VALUE`
+ * for malformed input
+ */
+result(size) json_extract(json_string_t json_str, size_t len,
+                          json_fields_t * fields, json_field_t * out);
+
+/**
+ * @brief Parses `len` bytes of JSON into a stream of events, without
+ * building a DOM. Memory use grows with the nesting depth and the
+ * longest escaped string, not with the size of the document
+ *
+ * @param json_str The raw JSON bytes
+ * @param len The number of bytes
+ * @param handler The callbacks to invoke
+ * @param user Passed to every callback
+ * @return The offset just past the root value, or a {json_error_t}.
+ * {JSON_ERROR_ABORTED} when a callback returned false
+ */
+result(size) json_sax_parse(json_string_t json_str, size_t len,
+                            const json_sax_handler_t * handler, void *user);
+
+/**
+ * @brief Sets up an incremental parser. The events are the same as
+ * {json_sax_parse}'s, emitted as soon as their input arrives
+ *
+ * @param parser The parser to initialize
+ * @param handler The callbacks to invoke
+ * @param user Passed to every callback
+ */
+void json_parser_init(json_parser_t * parser,
+                      const json_sax_handler_t * handler, void *user);
+
+/**
+ * @brief Parses the next `len` bytes of the input. Errors are sticky,
+ * once one is returned every later call returns it too
+ *
+ * @param parser The parser
+ * @param chunk The next bytes of the input
+ * @param len The number of bytes, may be 0
+ * @return The number of bytes consumed, or a {json_error_t}
+ */
+result(size) json_parser_feed(json_parser_t * parser, json_string_t chunk,
+                              size_t len);
+
+/**
+ * @brief Ends the input. A number or literal at the very end of the
+ * input is only complete once this is called
+ *
+ * @param parser The parser
+ * @return The total number of bytes fed, or a {json_error_t} if the
+ * document is incomplete
+ */
+result(size) json_parser_finish(json_parser_t * parser);
+
+/**
+ * @brief Releases the buffers of a parser
+ *
+ * @param parser The parser to free
+ */
+void json_parser_free(json_parser_t * parser);
+
+/**
+ * @brief Parses newline-delimited JSON, one document per line, on a
+ * pool of threads. Workers claim batches of lines and parse them into
+ * an arena of their own. `callback` is never invoked concurrently, and
+ * blank lines are skipped
+ *
+ * @param json_str The raw NDJSON bytes
+ * @param len The number of bytes
+ * @param options The threading options, or NULL for the defaults
+ * @param callback Invoked for every record
+ * @param user Passed to every call of `callback`
+ * @return The number of records delivered, or a {json_error_t}.
+ * {JSON_ERROR_ABORTED} when the callback returned false
+ */
+result(size) json_ndjson_parse(json_string_t json_str, size_t len,
+                               const json_ndjson_options_t * options,
+                               json_ndjson_callback_t callback, void *user);
+
 /**
  * @brief Returns a string representation of JSON error {json_error_t} type
  *
@@ -0,0 +1,668 @@
+#include "json.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Binary encoding of a DOM. After an 8 byte header, the magic "JSNB",
+ * a version byte and 3 reserved zero bytes, every element is a tag byte
+ * followed by its payload:
+ *
+ *   0 null, 1 false, 2 true
+ *   3 long, zigzag encoded as an unsigned LEB128 varint
+ *   4 double, its 8 bytes little-endian
+ *   5 string, a varint length, the bytes and a NUL
+ *   6 array, a varint count and the elements
+ *   7 object, a varint count and, for every entry, the key written like
+ *     a string without its tag followed by the value
+ *
+ * Lengths and counts come first, so the decoder allocates every string
+ * and array at its final size and never looks at a byte twice, and the
+ * NULs let in-situ decodes point strings straight into the buffer. The
+ * whole buffer is checked before anything is allocated, so a decode
+ * only fails halfway when it runs out of memory.
+ */
+
+/**
+ * @brief Version written after the magic
+ */
+#define JSON_BINARY_VERSION 1
+
+/**
+ * @brief Size of the header
+ */
+#define JSON_BINARY_HEADER_SIZE 8
+
+/**
+ * @brief Longest LEB128 varint of a 64 bit value
+ */
+#define JSON_BINARY_VARINT_MAX_LEN 10
+
+typedef enum json_binary_tag_e {
+  JSON_BINARY_TAG_NULL = 0,
+  JSON_BINARY_TAG_FALSE,
+  JSON_BINARY_TAG_TRUE,
+  JSON_BINARY_TAG_LONG,
+  JSON_BINARY_TAG_DOUBLE,
+  JSON_BINARY_TAG_STRING,
+  JSON_BINARY_TAG_ARRAY,
+  JSON_BINARY_TAG_OBJECT,
+} json_binary_tag_t;
+
+static const char json_binary_header[JSON_BINARY_HEADER_SIZE] = {
+    'J', 'S', 'N', 'B', JSON_BINARY_VERSION, 0, 0, 0,
+};
+
+/**
+ * @brief Writes a tag byte followed by `value` as a varint
+ */
+static _bool json_encode_tagged(json_serializer_t *, json_binary_tag_t,
+                                uint64_t);
+
+/**
+ * @brief Writes `value` as a varint
+ */
+static _bool json_encode_varint(json_serializer_t *, uint64_t);
+
+/**
+ * @brief Writes a JSON element {json_element_t} with its tag
+ */
+static _bool json_encode_element(json_serializer_t *,
+                                 const json_element_t *);
+
+/**
+ * @brief Writes the length, bytes and NUL of a string
+ */
+static _bool json_encode_string(json_serializer_t *, json_string_view_t);
+
+/**
+ * @brief Writes an `Object` {json_object_t} type
+ */
+static _bool json_encode_object(json_serializer_t *, const json_object_t *);
+
+/**
+ * @brief Reads a varint that may run past `end`
+ */
+static _bool json_binary_read_varint(json_string_t *, json_string_t,
+                                     uint64_t *);
+
+/**
+ * @brief Reads a varint already known to fit
+ */
+static uint64_t json_binary_varint(json_string_t *);
+
+/**
+ * @brief Moves past a string whose length is in front of it, making
+ * sure it fits and is NUL-terminated
+ */
+static _bool json_binary_check_string(json_string_t *, json_string_t);
+
+/**
+ * @brief Moves past an element, making sure it is complete
+ */
+static _bool json_binary_check_element(json_string_t *, json_string_t);
+
+/**
+ * @brief Decodes a string whose length is in front of it, copied into
+ * the DOM or pointing into the buffer
+ */
+static _bool json_decode_string(json_context_t *, json_string_t *,
+                                json_string_view_t *);
+
+/**
+ * @brief Decodes a key, from the context's pool if it has one
+ */
+static _bool json_decode_key(json_context_t *, json_string_t *,
+                             json_string_view_t *);
+
+/**
+ * @brief Decodes an element into `element`
+ */
+static _bool json_decode_element(json_context_t *, json_string_t *,
+                                 json_element_t *);
+
+/**
+ * @brief Decodes an `Object` {json_object_t} of `count` entries
+ */
+static _bool json_decode_object(json_context_t *, json_string_t *, size_t,
+                                json_element_value_t *);
+
+/**
+ * @brief Decodes an `Array` {json_array_t} of `count` elements
+ */
+static _bool json_decode_array(json_context_t *, json_string_t *, size_t,
+                               json_element_value_t *);
+
+/**
+ * @brief Releases what a failed heap decode already built
+ */
+static void json_decode_discard(json_context_t *, json_element_t *);
+
+result(size) json_encode(const json_element_t * element,
+                         json_writer_t * writer) {
+  json_serializer_t ctx;
+  const size_t start = writer->size;
+
+  ctx.writer = writer;
+  ctx.indent = 0;
+  ctx.flushed = 0;
+  ctx.error = JSON_ERROR_INVALID_VALUE;
+
+  if (!json_serialize_write(&ctx, json_binary_header,
+                            JSON_BINARY_HEADER_SIZE) ||
+      !json_encode_element(&ctx, element))
+    return result_err(size)(ctx.error);
+
+  return json_serialize_finish(&ctx, start);
+}
+
+_bool json_encode_tagged(json_serializer_t * ctx, json_binary_tag_t tag,
+                         uint64_t value) {
+  if (!json_serialize_reserve(ctx, JSON_BINARY_VARINT_MAX_LEN + 1))
+    return _false;
+
+  ctx->writer->data[ctx->writer->size++] = (char)tag;
+  return json_encode_varint(ctx, value);
+}
+
+_bool json_encode_varint(json_serializer_t * ctx, uint64_t value) {
+  if (!json_serialize_reserve(ctx, JSON_BINARY_VARINT_MAX_LEN))
+    return _false;
+
+  char *output = ctx->writer->data + ctx->writer->size;
+  char *ptr = output;
+
+  while (value >= 0x80) {
+    *ptr++ = (char)(value | 0x80);
+    value >>= 7;
+  }
+  *ptr++ = (char)value;
+
+  ctx->writer->size += ptr - output;
+  return _true;
+}
+
+_bool json_encode_element(json_serializer_t * ctx,
+                          const json_element_t * element) {
+  size_t i;
+
+  switch (element->type) {
+  case JSON_ELEMENT_TYPE_STRING:
+    if (!json_serialize_reserve(ctx, 1))
+      return _false;
+
+    ctx->writer->data[ctx->writer->size++] = JSON_BINARY_TAG_STRING;
+    return json_encode_string(ctx, element->value.as_string);
+
+  case JSON_ELEMENT_TYPE_NUMBER: {
+    const json_number_t number = element->value.as_number;
+
+    if (number.type == JSON_NUMBER_TYPE_LONG) {
+      // Zigzag keeps small negative numbers short
+      const uint64_t value = (uint64_t)number.value.as_long;
+      return json_encode_tagged(ctx, JSON_BINARY_TAG_LONG,
+                                (value << 1) ^ (0 - (value >> 63)));
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &number.value.as_double, sizeof(bits));
+
+    if (!json_serialize_reserve(ctx, 9))
+      return _false;
+
+    char *output = ctx->writer->data + ctx->writer->size;
+    output[0] = JSON_BINARY_TAG_DOUBLE;
+    for (i = 0; i < 8; i++)
+      output[i + 1] = (char)(bits >> (8 * i));
+
+    ctx->writer->size += 9;
+    return _true;
+  }
+
+  case JSON_ELEMENT_TYPE_OBJECT:
+    return json_encode_object(ctx, element->value.as_object);
+
+  case JSON_ELEMENT_TYPE_ARRAY: {
+    const json_array_t *array = element->value.as_array;
+
+    if (!json_encode_tagged(ctx, JSON_BINARY_TAG_ARRAY, array->count))
+      return _false;
+
+    for (i = 0; i < array->count; i++) {
+      if (!json_encode_element(ctx, &array->elements[i]))
+        return _false;
+    }
+    return _true;
+  }
+
+  case JSON_ELEMENT_TYPE_BOOLEAN:
+    if (!json_serialize_reserve(ctx, 1))
+      return _false;
+
+    ctx->writer->data[ctx->writer->size++] =
+        element->value.as_boolean ? JSON_BINARY_TAG_TRUE
+                                  : JSON_BINARY_TAG_FALSE;
+    return _true;
+
+  case JSON_ELEMENT_TYPE_NULL:
+    if (!json_serialize_reserve(ctx, 1))
+      return _false;
+
+    ctx->writer->data[ctx->writer->size++] = JSON_BINARY_TAG_NULL;
+    return _true;
+  }
+
+  return _true;
+}
+
+_bool json_encode_string(json_serializer_t * ctx,
+                         json_string_view_t string) {
+  if (!json_encode_varint(ctx, string.length) ||
+      !json_serialize_write(ctx, string.data, string.length) ||
+      !json_serialize_reserve(ctx, 1))
+    return _false;
+
+  ctx->writer->data[ctx->writer->size++] = '\0';
+  return _true;
+}
+
+_bool json_encode_object(json_serializer_t * ctx,
+                         const json_object_t * object) {
+  size_t i;
+
+  if (!json_encode_tagged(ctx, JSON_BINARY_TAG_OBJECT, object->count))
+    return _false;
+
+  for (i = 0; i < object->count; i++) {
+    if (object->shape != NULL) {
+      if (!json_encode_string(ctx, object->shape->keys[i]) ||
+          !json_encode_element(ctx, &object->values[i]))
+        return _false;
+    } else {
+      if (!json_encode_string(ctx, object->entries[i].key) ||
+          !json_encode_element(ctx, &object->entries[i].element))
+        return _false;
+    }
+  }
+
+  return _true;
+}
+
+result(json_element) json_decode(const void *data, size_t len,
+                                 const json_parse_options_t * options) {
+  json_string_t ptr = (json_string_t)data;
+  json_string_t end = ptr + len;
+  json_parse_options_t decode_options = {0};
+  json_context_t ctx;
+  json_element_t element;
+
+  if (data == NULL || len == 0)
+    return result_err(json_element)(JSON_ERROR_EMPTY);
+
+  if (len < JSON_BINARY_HEADER_SIZE ||
+      memcmp(ptr, json_binary_header, JSON_BINARY_HEADER_SIZE) != 0)
+    return result_err(json_element)(JSON_ERROR_INVALID_VALUE);
+
+  ptr += JSON_BINARY_HEADER_SIZE;
+
+  json_string_t check = ptr;
+  if (!json_binary_check_element(&check, end) || check != end)
+    return result_err(json_element)(JSON_ERROR_INVALID_VALUE);
+
+  // There is no text to index
+  if (options != NULL)
+    decode_options = *options;
+  decode_options.index = NULL;
+
+  json_context_init(&ctx, ptr, end - ptr, &decode_options);
+
+  const _bool decoded = json_decode_element(&ctx, &ptr, &element);
+
+  // The scratch stack only lives as long as the decode
+  json_context_release(&ctx);
+
+  if (!decoded) {
+    json_decode_discard(&ctx, &element);
+    return result_err(json_element)(JSON_ERROR_INVALID_VALUE);
+  }
+
+  return result_ok(json_element)(element);
+}
+
+_bool json_binary_read_varint(json_string_t * str_ptr, json_string_t end,
+                              uint64_t *value) {
+  json_string_t ptr = *str_ptr;
+  unsigned shift = 0;
+
+  *value = 0;
+
+  while (ptr < end && shift < 64) {
+    const unsigned char byte = (unsigned char)*ptr++;
+
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if (byte < 0x80) {
+      *str_ptr = ptr;
+      return _true;
+    }
+
+    shift += 7;
+  }
+
+  return _false;
+}
+
+uint64_t json_binary_varint(json_string_t * str_ptr) {
+  json_string_t ptr = *str_ptr;
+  unsigned char byte = (unsigned char)*ptr++;
+  uint64_t value = byte & 0x7F;
+  unsigned shift = 7;
+
+  // Most lengths and counts fit in the first byte
+  while (byte >= 0x80) {
+    byte = (unsigned char)*ptr++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    shift += 7;
+  }
+
+  *str_ptr = ptr;
+  return value;
+}
+
+_bool json_binary_check_string(json_string_t * str_ptr, json_string_t end) {
+  uint64_t len;
+
+  if (!json_binary_read_varint(str_ptr, end, &len) ||
+      len >= (uint64_t)(end - *str_ptr) || (*str_ptr)[len] != '\0')
+    return _false;
+
+  *str_ptr += len + 1;
+  return _true;
+}
+
+_bool json_binary_check_element(json_string_t * str_ptr,
+                                json_string_t end) {
+  uint64_t count;
+  uint64_t i;
+
+  if (*str_ptr >= end)
+    return _false;
+
+  switch ((unsigned char)*(*str_ptr)++) {
+  case JSON_BINARY_TAG_NULL:
+  case JSON_BINARY_TAG_FALSE:
+  case JSON_BINARY_TAG_TRUE:
+    return _true;
+
+  case JSON_BINARY_TAG_LONG:
+    return json_binary_read_varint(str_ptr, end, &count);
+
+  case JSON_BINARY_TAG_DOUBLE:
+    if (end - *str_ptr < 8)
+      return _false;
+
+    *str_ptr += 8;
+    return _true;
+
+  case JSON_BINARY_TAG_STRING:
+    return json_binary_check_string(str_ptr, end);
+
+  case JSON_BINARY_TAG_ARRAY:
+    if (!json_binary_read_varint(str_ptr, end, &count))
+      return _false;
+
+    // Every element takes a byte at least, which also keeps the count
+    // from overflowing the allocation
+    if (count > (uint64_t)(end - *str_ptr))
+      return _false;
+
+    for (i = 0; i < count; i++) {
+      if (!json_binary_check_element(str_ptr, end))
+        return _false;
+    }
+    return _true;
+
+  case JSON_BINARY_TAG_OBJECT:
+    if (!json_binary_read_varint(str_ptr, end, &count) ||
+        count > (uint64_t)(end - *str_ptr))
+      return _false;
+
+    for (i = 0; i < count; i++) {
+      if (!json_binary_check_string(str_ptr, end) ||
+          !json_binary_check_element(str_ptr, end))
+        return _false;
+    }
+    return _true;
+  }
+
+  return _false;
+}
+
+_bool json_decode_string(json_context_t * ctx, json_string_t * str_ptr,
+                         json_string_view_t * string) {
+  const size_t len = (size_t)json_binary_varint(str_ptr);
+
+  if (ctx->insitu) {
+    string->data = *str_ptr;
+  } else {
+    char *output = (char *)json_context_alloc(ctx, len + 1);
+    if (output == NULL)
+      return _false;
+
+    memcpy(output, *str_ptr, len + 1);
+    string->data = output;
+  }
+
+  string->length = len;
+  *str_ptr += len + 1;
+
+  return _true;
+}
+
+_bool json_decode_key(json_context_t * ctx, json_string_t * str_ptr,
+                      json_string_view_t * key) {
+  if (ctx->keys == NULL)
+    return json_decode_string(ctx, str_ptr, key);
+
+  const size_t len = (size_t)json_binary_varint(str_ptr);
+
+  result(json_string_view) key_result =
+      json_key_pool_intern(ctx->keys, *str_ptr, len);
+  if (result_is_err(json_string_view)(&key_result))
+    return _false;
+
+  *key = result_unwrap(json_string_view)(&key_result);
+  *str_ptr += len + 1;
+
+  return _true;
+}
+
+_bool json_decode_element(json_context_t * ctx, json_string_t * str_ptr,
+                          json_element_t * element) {
+  const json_binary_tag_t tag =
+      (json_binary_tag_t)(unsigned char)*(*str_ptr)++;
+  uint64_t value;
+  size_t i;
+
+  memset(element, 0, sizeof(json_element_t));
+
+  switch (tag) {
+  case JSON_BINARY_TAG_NULL:
+    element->type = JSON_ELEMENT_TYPE_NULL;
+    return _true;
+
+  case JSON_BINARY_TAG_FALSE:
+  case JSON_BINARY_TAG_TRUE:
+    element->type = JSON_ELEMENT_TYPE_BOOLEAN;
+    element->value.as_boolean = tag == JSON_BINARY_TAG_TRUE;
+    return _true;
+
+  case JSON_BINARY_TAG_LONG:
+    value = json_binary_varint(str_ptr);
+
+    element->type = JSON_ELEMENT_TYPE_NUMBER;
+    element->value.as_number.type = JSON_NUMBER_TYPE_LONG;
+    element->value.as_number.value.as_long =
+        (json_number_long_t)((value >> 1) ^ (0 - (value & 1)));
+    return _true;
+
+  case JSON_BINARY_TAG_DOUBLE:
+    value = 0;
+    for (i = 0; i < 8; i++)
+      value |= (uint64_t)(unsigned char)(*str_ptr)[i] << (8 * i);
+    *str_ptr += 8;
+
+    element->type = JSON_ELEMENT_TYPE_NUMBER;
+    element->value.as_number.type = JSON_NUMBER_TYPE_DOUBLE;
+    memcpy(&element->value.as_number.value.as_double, &value, sizeof(value));
+    return _true;
+
+  case JSON_BINARY_TAG_STRING:
+    element->type = JSON_ELEMENT_TYPE_STRING;
+    return json_decode_string(ctx, str_ptr, &element->value.as_string);
+
+  case JSON_BINARY_TAG_ARRAY:
+    element->type = JSON_ELEMENT_TYPE_ARRAY;
+    return json_decode_array(ctx, str_ptr,
+                             (size_t)json_binary_varint(str_ptr),
+                             &element->value);
+
+  case JSON_BINARY_TAG_OBJECT:
+    element->type = JSON_ELEMENT_TYPE_OBJECT;
+    return json_decode_object(ctx, str_ptr,
+                              (size_t)json_binary_varint(str_ptr),
+                              &element->value);
+  }
+
+  return _false;
+}
+
+_bool json_decode_object(json_context_t * ctx, json_string_t * str_ptr,
+                         size_t count, json_element_value_t * value) {
+  size_t i;
+
+  if (count == 0) {
+    json_object_t *object =
+        (json_object_t *)json_context_alloc(ctx, sizeof(json_object_t));
+    if (object == NULL)
+      return _false;
+
+    memset(object, 0, sizeof(json_object_t));
+    value->as_object = object;
+    return _true;
+  }
+
+  // Collected on the scratch stack like a parsed object, so indexing
+  // and shapes are left to {json_build_object}
+  const size_t base = ctx->stack_size;
+
+  for (i = 0; i < count; i++) {
+    json_entry_t entry;
+
+    if (!json_decode_key(ctx, str_ptr, &entry.key))
+      break;
+
+    if (!json_decode_element(ctx, str_ptr, &entry.element)) {
+      json_decode_discard(ctx, &entry.element);
+      if (ctx->keys == NULL && !ctx->insitu)
+        json_context_free(ctx, (void *)entry.key.data);
+      break;
+    }
+
+    json_entry_t *slot =
+        (json_entry_t *)json_stack_push(ctx, sizeof(json_entry_t));
+    if (slot == NULL) {
+      json_decode_discard(ctx, &entry.element);
+      if (ctx->keys == NULL && !ctx->insitu)
+        json_context_free(ctx, (void *)entry.key.data);
+      break;
+    }
+
+    *slot = entry;
+  }
+
+  if (i == count) {
+    result(json_element_value) object_result =
+        json_build_object(ctx, base, count);
+
+    if (result_is_ok(json_element_value)(&object_result)) {
+      *value = result_unwrap(json_element_value)(&object_result);
+      return _true;
+    }
+
+    // {json_build_object} released the entries when it failed
+    value->as_object = NULL;
+    return _false;
+  }
+
+  // Release the `i` entries collected so far
+  const size_t collected = i;
+  for (i = 0; i < collected; i++) {
+    json_entry_t *entry = json_stack_at(ctx, json_entry_t, base) + i;
+
+    json_decode_discard(ctx, &entry->element);
+    if (ctx->keys == NULL && !ctx->insitu)
+      json_context_free(ctx, (void *)entry->key.data);
+  }
+
+  ctx->stack_size = base;
+  value->as_object = NULL;
+
+  return _false;
+}
+
+_bool json_decode_array(json_context_t * ctx, json_string_t * str_ptr,
+                        size_t count, json_element_value_t * value) {
+  json_array_t *array =
+      (json_array_t *)json_context_alloc(ctx, sizeof(json_array_t));
+  json_element_t *elements =
+      count > 0 ? (json_element_t *)json_context_alloc(
+                      ctx, count * sizeof(json_element_t))
+                : NULL;
+
+  if (array == NULL || (count > 0 && elements == NULL)) {
+    json_context_free(ctx, array);
+    json_context_free(ctx, elements);
+    value->as_array = NULL;
+    return _false;
+  }
+
+  array->count = 0;
+  array->elements = elements;
+  value->as_array = array;
+
+  // The elements are decoded in place, the count only covers the ones
+  // done so a failed decode can be released
+  while (array->count < count) {
+    if (!json_decode_element(ctx, str_ptr, &elements[array->count])) {
+      json_decode_discard(ctx, &elements[array->count]);
+
+      // Releasing an array without elements skips their buffer
+      if (array->count == 0) {
+        json_context_free(ctx, elements);
+        json_context_free(ctx, array);
+        value->as_array = NULL;
+      }
+      return _false;
+    }
+
+    array->count++;
+  }
+
+  return _true;
+}
+
+void json_decode_discard(json_context_t * ctx, json_element_t * element) {
+  if ((element->type == JSON_ELEMENT_TYPE_OBJECT &&
+       element->value.as_object == NULL) ||
+      (element->type == JSON_ELEMENT_TYPE_ARRAY &&
+       element->value.as_array == NULL) ||
+      (element->type == JSON_ELEMENT_TYPE_STRING &&
+       element->value.as_string.data == NULL))
+    return;
+
+  json_context_free_element(ctx, element);
+
+  memset(element, 0, sizeof(json_element_t));
+  element->type = JSON_ELEMENT_TYPE_NULL;
+}
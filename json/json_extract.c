@@ -0,0 +1,202 @@
+#include "json.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Field extraction over raw text. The compiled paths of a field set
+ * are resolved by the single-pass scan of {json_path_find_values},
+ * which skips whatever no field goes into with the same scanners the
+ * parser uses on invalid input. Only the values found are decoded.
+ */
+
+/**
+ * @brief Decodes the value a field points at into `out`, unescaping
+ * into the strings of `fields` at `offset`, which moves past what was
+ * written
+ */
+static _bool json_extract_value(json_fields_t *, json_value_t, size_t *,
+                                json_field_t *);
+
+/**
+ * @brief Bytes the escaped string values among `fields` unescape into
+ * at most
+ */
+static size_t json_extract_strings_size(const json_fields_t *);
+
+result(json_fields) json_fields_compile(const json_string_t * names,
+                                        size_t count) {
+  json_fields_t fields = {0};
+
+  fields.paths = (json_path_t *)calloc(count + 1, sizeof(json_path_t));
+  fields.values = (json_value_t *)malloc((count + 1) * sizeof(json_value_t));
+  if (fields.paths == NULL || fields.values == NULL) {
+    json_fields_free(&fields);
+    return result_err(json_fields)(JSON_ERROR_INVALID_VALUE);
+  }
+
+  for (; fields.count < count; fields.count++) {
+    result(json_path) path_result = json_path_compile(names[fields.count]);
+    if (result_is_err(json_path)(&path_result)) {
+      json_fields_free(&fields);
+      return result_map_err(json_fields, json_path, &path_result);
+    }
+
+    fields.paths[fields.count] = result_unwrap(json_path)(&path_result);
+  }
+
+  fields.active =
+      (size_t *)malloc(json_path_scratch_size(fields.paths, fields.count));
+  if (fields.active == NULL) {
+    json_fields_free(&fields);
+    return result_err(json_fields)(JSON_ERROR_INVALID_VALUE);
+  }
+
+  return result_ok(json_fields)(fields);
+}
+
+void json_fields_free(json_fields_t * fields) {
+  size_t i;
+
+  for (i = 0; fields->paths != NULL && i < fields->count; i++)
+    json_path_free(&fields->paths[i]);
+
+  free(fields->paths);
+  free(fields->active);
+  free(fields->values);
+  free(fields->strings);
+
+  memset(fields, 0, sizeof(json_fields_t));
+}
+
+result(size) json_extract(json_string_t json_str, size_t len,
+                          json_fields_t * fields, json_field_t * out) {
+  json_document_t document;
+  size_t offset = 0;
+  size_t i;
+
+  // The document is only a view of the input, its string arena is
+  // never allocated from here
+  result_try(size, json_value, root,
+             json_document_init(&document, json_str, len));
+  result_try(size, size, found,
+             json_path_scan(root, fields->paths, fields->count,
+                            fields->values, fields->active));
+
+  // Grow the buffer once for every escaped string of this record, so
+  // views into it stay valid while the others are written
+  const size_t strings_size = json_extract_strings_size(fields);
+  if (strings_size > fields->strings_capacity) {
+    char *strings = (char *)realloc(fields->strings, strings_size);
+    if (strings == NULL)
+      return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+    fields->strings = strings;
+    fields->strings_capacity = strings_size;
+  }
+
+  for (i = 0; i < fields->count; i++) {
+    out[i].found = _false;
+
+    if (fields->values[i].ptr != NULL &&
+        !json_extract_value(fields, fields->values[i], &offset, &out[i]))
+      return result_err(size)(JSON_ERROR_INVALID_VALUE);
+  }
+
+  return result_ok(size)(found);
+}
+
+size_t json_extract_strings_size(const json_fields_t * fields) {
+  size_t size = 0;
+  size_t i;
+
+  for (i = 0; i < fields->count; i++) {
+    const json_value_t value = fields->values[i];
+    if (value.ptr == NULL || json_peek(value.ptr, value.document->end) != '"')
+      continue;
+
+    json_string_t raw = value.ptr + 1;
+    size_t raw_len = json_string_len(raw, value.document->end);
+
+    // Escapes only ever shorten a string
+    if (memchr(raw, '\\', raw_len) != NULL)
+      size += raw_len + 1;
+  }
+
+  return size;
+}
+
+_bool json_extract_value(json_fields_t * fields, json_value_t value,
+                         size_t *offset, json_field_t * out) {
+  json_string_t end = value.document->end;
+  json_string_t ptr = value.ptr;
+
+  result(json_element_type) type_result = json_guess_element_type(ptr, end);
+  if (result_is_err(json_element_type)(&type_result))
+    return _false;
+
+  out->type = result_unwrap(json_element_type)(&type_result);
+  memset(&out->value, 0, sizeof(json_element_value_t));
+
+  switch (out->type) {
+  case JSON_ELEMENT_TYPE_STRING: {
+    json_string_t raw = ptr + 1;
+    size_t raw_len = json_string_len(raw, end);
+    if (raw_len == 0 && json_peek(raw, end) != '"')
+      return _false;
+
+    if (memchr(raw, '\\', raw_len) == NULL) {
+      out->value.as_string.data = raw;
+      out->value.as_string.length = raw_len;
+      break;
+    }
+
+    char *output = fields->strings + *offset;
+    result(size) length_result = json_unescape_into(output, raw, raw_len);
+    if (result_is_err(size)(&length_result))
+      return _false;
+
+    out->value.as_string.data = output;
+    out->value.as_string.length = result_unwrap(size)(&length_result);
+    *offset += out->value.as_string.length + 1;
+    break;
+  }
+
+  case JSON_ELEMENT_TYPE_NUMBER: {
+    result(json_number) number_result = json_number_parse(&ptr, end);
+    if (result_is_err(json_number)(&number_result))
+      return _false;
+
+    out->value.as_number = result_unwrap(json_number)(&number_result);
+    break;
+  }
+
+  case JSON_ELEMENT_TYPE_BOOLEAN:
+    if ((size_t)(end - ptr) >= 4 && memcmp(ptr, "true", 4) == 0)
+      out->value.as_boolean = _true;
+    else if ((size_t)(end - ptr) >= 5 && memcmp(ptr, "false", 5) == 0)
+      out->value.as_boolean = _false;
+    else
+      return _false;
+    break;
+
+  case JSON_ELEMENT_TYPE_NULL:
+    if ((size_t)(end - ptr) < 4 || memcmp(ptr, "null", 4) != 0)
+      return _false;
+    break;
+
+  case JSON_ELEMENT_TYPE_OBJECT:
+  case JSON_ELEMENT_TYPE_ARRAY:
+    // Handed back as text, to be parsed by the caller if needed
+    json_skip_element_value(&ptr, end, out->type);
+    out->value.as_string.data = value.ptr;
+    out->value.as_string.length = ptr - value.ptr;
+    break;
+  }
+
+  out->found = _true;
+  return _true;
+}
+
+define_result_type(json_fields)
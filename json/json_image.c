@@ -0,0 +1,709 @@
+#include "json.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Frozen document images. Everything is linked by offsets from the
+ * start of the image, so the bytes are read where they are, be it a
+ * buffer or a file mapped read-only by several processes. An 8 byte
+ * header, "JSNI" and the version, is followed by the blocks, each one
+ * written after everything it links to, and a trailer holding the root
+ * node, the image size and a byte order mark.
+ *
+ * A node is 16 bytes: the element type, with the number type in its
+ * second byte, a 32-bit count and a 64-bit value:
+ *
+ *   null, booleans  0 or 1
+ *   numbers         the bits of the long or double
+ *   strings         the length, and the offset of the NUL-terminated bytes
+ *   arrays          the count, and the offset of as many nodes
+ *   objects         the count, and the offset of the offset of a shape
+ *                   block followed by as many value nodes
+ *
+ * A shape block holds the offset, length and low half of the
+ * {json_key_hash} of every key, then a linear probing table of entry
+ * numbers plus one, sized like the index of a parsed object. Objects
+ * sharing a {json_shape_t} share their shape block. Blocks are aligned
+ * to 8 so nodes are read in place.
+ */
+
+/**
+ * @brief Version written in the header and trailer
+ */
+#define JSON_IMAGE_VERSION 1
+
+/**
+ * @brief Size of the header
+ */
+#define JSON_IMAGE_HEADER_SIZE 8
+
+/**
+ * @brief Reads back differently on a machine of the other byte order
+ */
+#define JSON_IMAGE_BYTE_ORDER 0x01020304UL
+
+/**
+ * @brief Counts and string lengths are stored in 32 bits
+ */
+#define JSON_IMAGE_COUNT_MAX 0xFFFFFFFFUL
+
+/**
+ * @brief Slots of the first table of shapes already written
+ */
+#define JSON_IMAGE_SHAPES_MIN_CAPACITY 64
+
+typedef struct json_image_node_s {
+  uint32_t type;
+  uint32_t count;
+  uint64_t value;
+} json_image_node_t;
+
+typedef struct json_image_key_s {
+  uint64_t offset;
+  uint32_t length;
+  uint32_t hash;
+} json_image_key_t;
+
+typedef struct json_image_trailer_s {
+  json_image_node_t root;
+  uint64_t size;
+  uint32_t byte_order;
+  uint32_t version;
+} json_image_trailer_t;
+
+/**
+ * @brief A shape already written and the offset of its block
+ */
+typedef struct json_image_shape_slot_s {
+  const json_shape_t *shape;
+  uint64_t offset;
+} json_image_shape_slot_t;
+
+/**
+ * @brief State of one {json_image_write} call
+ */
+typedef struct json_image_writer_s {
+  json_serializer_t out;
+  /* Size of the writer's buffer when the image started */
+  size_t start;
+  /* Only the scratch stack of the context is used, to collect the
+     nodes and keys of the containers being written */
+  json_context_t scratch;
+  json_image_shape_slot_t *shapes;
+  size_t shape_count;
+  size_t shape_capacity;
+} json_image_writer_t;
+
+static const char json_image_header[JSON_IMAGE_HEADER_SIZE] = {
+    'J', 'S', 'N', 'I', JSON_IMAGE_VERSION, 0, 0, 0,
+};
+
+static const char json_image_padding[8] = {0};
+
+#define json_image_node_at(image, offset)                                      \
+  ((const json_image_node_t *)((image)->data + (offset)))
+
+/**
+ * @brief Offset from the start of the image the next byte is written at
+ */
+#define json_image_offset(ctx)                                                 \
+  ((uint64_t)((ctx)->out.flushed + (ctx)->out.writer->size - (ctx)->start))
+
+/**
+ * @brief Pads the image to a multiple of 8
+ */
+static _bool json_image_align(json_image_writer_t *);
+
+/**
+ * @brief Writes the blocks of an element and fills in its node
+ */
+static _bool json_image_write_element(json_image_writer_t *,
+                                      const json_element_t *,
+                                      json_image_node_t *);
+
+/**
+ * @brief Writes the bytes and NUL of a string at `offset`
+ */
+static _bool json_image_write_string(json_image_writer_t *,
+                                     json_string_view_t, uint64_t *);
+
+/**
+ * @brief Writes the keys and shape block of an object, or finds the
+ * block of its shape written before
+ */
+static _bool json_image_write_shape(json_image_writer_t *,
+                                    const json_object_t *, uint64_t *);
+
+/**
+ * @brief The slot of `shape` among the shapes written, or the free slot
+ * that ends its probe. NULL when the table cannot grow
+ */
+static json_image_shape_slot_t *json_image_shape_slot(json_image_writer_t *,
+                                                      const json_shape_t *);
+
+/**
+ * @brief Whether `size` bytes at an aligned `offset` are in the image
+ */
+static _bool json_image_fits(const json_image_t *, uint64_t, uint64_t);
+
+/**
+ * @brief Whether `len` bytes at `offset` and their NUL are in the image
+ */
+static _bool json_image_fits_string(const json_image_t *, uint64_t, uint64_t);
+
+/**
+ * @brief The keys, size of the probe table and offset of the value
+ * nodes of an object, or false if they are not all in the image
+ */
+static _bool json_image_object(json_image_ref_t, const json_image_key_t **,
+                               size_t *, uint64_t *);
+
+/**
+ * @brief Finds a key whose {json_key_hash} is known
+ */
+static result(json_image_ref)
+    json_image_object_find_hashed(json_image_ref_t, json_string_t, size_t,
+                                  uint64_t);
+
+result(size) json_image_write(const json_element_t * element,
+                              json_writer_t * writer) {
+  json_image_writer_t ctx;
+  json_image_trailer_t trailer;
+
+  memset(&ctx, 0, sizeof(json_image_writer_t));
+  memset(&trailer, 0, sizeof(json_image_trailer_t));
+  ctx.out.writer = writer;
+  ctx.out.error = JSON_ERROR_INVALID_VALUE;
+  ctx.start = writer->size;
+
+  _bool written =
+      json_serialize_write(&ctx.out, json_image_header,
+                           JSON_IMAGE_HEADER_SIZE) &&
+      json_image_write_element(&ctx, element, &trailer.root) &&
+      json_image_align(&ctx);
+
+  if (written) {
+    trailer.size = json_image_offset(&ctx) + sizeof(json_image_trailer_t);
+    trailer.byte_order = JSON_IMAGE_BYTE_ORDER;
+    trailer.version = JSON_IMAGE_VERSION;
+
+    written = json_serialize_write(&ctx.out, (json_string_t)&trailer,
+                                   sizeof(json_image_trailer_t));
+  }
+
+  json_context_release(&ctx.scratch);
+  free(ctx.shapes);
+
+  if (!written)
+    return result_err(size)(ctx.out.error);
+
+  return json_serialize_finish(&ctx.out, ctx.start);
+}
+
+_bool json_image_align(json_image_writer_t * ctx) {
+  const size_t padding = (size_t)(0 - json_image_offset(ctx)) & 7;
+
+  return padding == 0 ||
+         json_serialize_write(&ctx->out, json_image_padding, padding);
+}
+
+_bool json_image_write_element(json_image_writer_t * ctx,
+                               const json_element_t * element,
+                               json_image_node_t * node) {
+  const size_t base = ctx->scratch.stack_size;
+  size_t i;
+
+  memset(node, 0, sizeof(json_image_node_t));
+  node->type = element->type;
+
+  switch (element->type) {
+  case JSON_ELEMENT_TYPE_STRING:
+    node->count = (uint32_t)element->value.as_string.length;
+    return json_image_write_string(ctx, element->value.as_string,
+                                   &node->value);
+
+  case JSON_ELEMENT_TYPE_NUMBER:
+    node->type |= element->value.as_number.type << 8;
+    memcpy(&node->value, &element->value.as_number.value,
+           sizeof(node->value));
+    return _true;
+
+  case JSON_ELEMENT_TYPE_BOOLEAN:
+    node->value = element->value.as_boolean ? 1 : 0;
+    return _true;
+
+  case JSON_ELEMENT_TYPE_NULL:
+    return _true;
+
+  case JSON_ELEMENT_TYPE_ARRAY: {
+    const json_array_t *array = element->value.as_array;
+    if (array->count > JSON_IMAGE_COUNT_MAX)
+      return _false;
+
+    // The children go first, their nodes wait on the scratch stack
+    for (i = 0; i < array->count; i++) {
+      json_image_node_t child;
+      if (!json_image_write_element(ctx, &array->elements[i], &child))
+        return _false;
+
+      json_image_node_t *slot = (json_image_node_t *)json_stack_push(
+          &ctx->scratch, sizeof(json_image_node_t));
+      if (slot == NULL)
+        return _false;
+      *slot = child;
+    }
+
+    if (!json_image_align(ctx))
+      return _false;
+
+    node->count = (uint32_t)array->count;
+    node->value = json_image_offset(ctx);
+
+    ctx->scratch.stack_size = base;
+    return json_serialize_write(
+        &ctx->out, json_stack_at(&ctx->scratch, char, base),
+        array->count * sizeof(json_image_node_t));
+  }
+
+  case JSON_ELEMENT_TYPE_OBJECT: {
+    const json_object_t *object = element->value.as_object;
+    uint64_t shape;
+
+    if (object->count > JSON_IMAGE_COUNT_MAX ||
+        !json_image_write_shape(ctx, object, &shape))
+      return _false;
+
+    for (i = 0; i < object->count; i++) {
+      json_image_node_t child;
+      const json_element_t *value = object->shape != NULL
+                                        ? &object->values[i]
+                                        : &object->entries[i].element;
+      if (!json_image_write_element(ctx, value, &child))
+        return _false;
+
+      json_image_node_t *slot = (json_image_node_t *)json_stack_push(
+          &ctx->scratch, sizeof(json_image_node_t));
+      if (slot == NULL)
+        return _false;
+      *slot = child;
+    }
+
+    if (!json_image_align(ctx))
+      return _false;
+
+    node->count = (uint32_t)object->count;
+    node->value = json_image_offset(ctx);
+
+    ctx->scratch.stack_size = base;
+    return json_serialize_write(&ctx->out, (json_string_t)&shape,
+                                sizeof(shape)) &&
+           json_serialize_write(&ctx->out,
+                                json_stack_at(&ctx->scratch, char, base),
+                                object->count * sizeof(json_image_node_t));
+  }
+  }
+
+  return _false;
+}
+
+_bool json_image_write_string(json_image_writer_t * ctx,
+                              json_string_view_t string, uint64_t *offset) {
+  if (string.length > JSON_IMAGE_COUNT_MAX)
+    return _false;
+
+  *offset = json_image_offset(ctx);
+
+  return json_serialize_write(&ctx->out, string.data, string.length) &&
+         json_serialize_write(&ctx->out, json_image_padding, 1);
+}
+
+_bool json_image_write_shape(json_image_writer_t * ctx,
+                             const json_object_t * object, uint64_t *offset) {
+  json_image_shape_slot_t *written = NULL;
+  const size_t count = object->count;
+  size_t capacity = 4;
+  size_t i;
+
+  if (object->shape != NULL) {
+    written = json_image_shape_slot(ctx, object->shape);
+    if (written == NULL)
+      return _false;
+
+    if (written->shape != NULL) {
+      *offset = written->offset;
+      return _true;
+    }
+  }
+
+  while (3 * capacity < 4 * count)
+    capacity *= 2;
+
+  // Keys and probe table are laid out on the scratch stack as they go
+  // into the image
+  const size_t base = ctx->scratch.stack_size;
+  const size_t size =
+      count * sizeof(json_image_key_t) + capacity * sizeof(uint32_t);
+  if (json_stack_push(&ctx->scratch, size) == NULL)
+    return _false;
+
+  memset(json_stack_at(&ctx->scratch, char, base), 0, size);
+
+  for (i = 0; i < count; i++) {
+    const json_string_view_t key = object->shape != NULL
+                                       ? object->shape->keys[i]
+                                       : object->entries[i].key;
+    const uint64_t hash = json_key_hash(key.data, key.length);
+    uint64_t key_offset;
+
+    if (!json_image_write_string(ctx, key, &key_offset))
+      return _false;
+
+    json_image_key_t *keys =
+        json_stack_at(&ctx->scratch, json_image_key_t, base);
+    uint32_t *slots = (uint32_t *)(keys + count);
+    size_t slot = hash & (capacity - 1);
+
+    keys[i].offset = key_offset;
+    keys[i].length = (uint32_t)key.length;
+    keys[i].hash = (uint32_t)hash;
+
+    while (slots[slot] != 0)
+      slot = (slot + 1) & (capacity - 1);
+    slots[slot] = (uint32_t)(i + 1);
+  }
+
+  if (!json_image_align(ctx))
+    return _false;
+
+  *offset = json_image_offset(ctx);
+
+  ctx->scratch.stack_size = base;
+  if (!json_serialize_write(&ctx->out,
+                            json_stack_at(&ctx->scratch, char, base), size))
+    return _false;
+
+  if (written != NULL) {
+    // Writing the keys never adds shapes, so the slot is still free
+    written->shape = object->shape;
+    written->offset = *offset;
+    ctx->shape_count++;
+  }
+
+  return _true;
+}
+
+json_image_shape_slot_t *json_image_shape_slot(json_image_writer_t * ctx,
+                                               const json_shape_t * shape) {
+  size_t slot;
+
+  // Keep at least a quarter of the slots free so probes stay short
+  if (4 * (ctx->shape_count + 1) > 3 * ctx->shape_capacity) {
+    const size_t capacity = ctx->shape_capacity > 0
+                                ? 2 * ctx->shape_capacity
+                                : JSON_IMAGE_SHAPES_MIN_CAPACITY;
+    json_image_shape_slot_t *shapes = (json_image_shape_slot_t *)calloc(
+        capacity, sizeof(json_image_shape_slot_t));
+    size_t i;
+
+    if (shapes == NULL)
+      return NULL;
+
+    for (i = 0; i < ctx->shape_capacity; i++) {
+      if (ctx->shapes[i].shape == NULL)
+        continue;
+
+      slot = ctx->shapes[i].shape->hash & (capacity - 1);
+      while (shapes[slot].shape != NULL)
+        slot = (slot + 1) & (capacity - 1);
+      shapes[slot] = ctx->shapes[i];
+    }
+
+    free(ctx->shapes);
+    ctx->shapes = shapes;
+    ctx->shape_capacity = capacity;
+  }
+
+  slot = shape->hash & (ctx->shape_capacity - 1);
+  while (ctx->shapes[slot].shape != NULL && ctx->shapes[slot].shape != shape)
+    slot = (slot + 1) & (ctx->shape_capacity - 1);
+
+  return &ctx->shapes[slot];
+}
+
+result(json_image_ref) json_image_open(json_image_t * image,
+                                       const void *data, size_t size) {
+  json_image_ref_t root = {0};
+
+  if (data == NULL ||
+      size < JSON_IMAGE_HEADER_SIZE + sizeof(json_image_trailer_t) ||
+      size % 8 != 0 || (size_t)data % 8 != 0 ||
+      memcmp(data, json_image_header, JSON_IMAGE_HEADER_SIZE) != 0)
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_VALUE);
+
+  const size_t trailer_offset = size - sizeof(json_image_trailer_t);
+  const json_image_trailer_t *trailer =
+      (const json_image_trailer_t *)((json_string_t)data + trailer_offset);
+  if (trailer->size != size || trailer->byte_order != JSON_IMAGE_BYTE_ORDER ||
+      trailer->version != JSON_IMAGE_VERSION)
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_VALUE);
+
+  image->data = (json_string_t)data;
+  image->size = size;
+
+  // The root node is the first member of the trailer
+  root.image = image;
+  root.offset = trailer_offset;
+
+  return result_ok(json_image_ref)(root);
+}
+
+json_element_type_t json_image_type(json_image_ref_t ref) {
+  const json_image_node_t *node = json_image_node_at(ref.image, ref.offset);
+
+  return (json_element_type_t)(node->type & 0xFF);
+}
+
+size_t json_image_count(json_image_ref_t ref) {
+  const json_element_type_t type = json_image_type(ref);
+
+  if (type != JSON_ELEMENT_TYPE_OBJECT && type != JSON_ELEMENT_TYPE_ARRAY)
+    return 0;
+
+  return json_image_node_at(ref.image, ref.offset)->count;
+}
+
+result(json_image_ref) json_image_array_get(json_image_ref_t array,
+                                            size_t i) {
+  const json_image_node_t *node = json_image_node_at(array.image, array.offset);
+
+  if (json_image_type(array) != JSON_ELEMENT_TYPE_ARRAY)
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_TYPE);
+  if (i >= node->count)
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_KEY);
+  if (!json_image_fits(array.image, node->value,
+                       (uint64_t)node->count * sizeof(json_image_node_t)))
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_VALUE);
+
+  json_image_ref_t element = {0};
+  element.image = array.image;
+  element.offset = node->value + i * sizeof(json_image_node_t);
+
+  return result_ok(json_image_ref)(element);
+}
+
+result(json_image_ref) json_image_object_find(json_image_ref_t object,
+                                              json_string_t key) {
+  if (key == NULL)
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_KEY);
+
+  return json_image_object_find_n(object, key, strlen(key));
+}
+
+result(json_image_ref) json_image_object_find_n(json_image_ref_t object,
+                                                json_string_t key,
+                                                size_t len) {
+  if (key == NULL)
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_KEY);
+
+  return json_image_object_find_hashed(object, key, len,
+                                       json_key_hash(key, len));
+}
+
+result(json_image_ref)
+    json_image_object_find_hashed(json_image_ref_t object, json_string_t key,
+                                  size_t len, uint64_t hash) {
+  const json_image_key_t *keys;
+  size_t capacity;
+  uint64_t values;
+  size_t probes;
+
+  if (json_image_type(object) != JSON_ELEMENT_TYPE_OBJECT)
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_TYPE);
+
+  if (!json_image_object(object, &keys, &capacity, &values))
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_VALUE);
+
+  const size_t count = json_image_node_at(object.image, object.offset)->count;
+  const uint32_t *slots = (const uint32_t *)(keys + count);
+  size_t slot = hash & (capacity - 1);
+
+  // A corrupt table may have no free slot to end the probe
+  for (probes = 0; probes < capacity && slots[slot] != 0; probes++) {
+    const size_t entry = slots[slot] - 1;
+    if (entry >= count)
+      return result_err(json_image_ref)(JSON_ERROR_INVALID_VALUE);
+
+    const json_image_key_t *candidate = &keys[entry];
+    if (candidate->hash == (uint32_t)hash && candidate->length == len &&
+        json_image_fits_string(object.image, candidate->offset, len) &&
+        memcmp(object.image->data + candidate->offset, key, len) == 0) {
+      json_image_ref_t value = {0};
+      value.image = object.image;
+      value.offset = values + entry * sizeof(json_image_node_t);
+
+      return result_ok(json_image_ref)(value);
+    }
+
+    slot = (slot + 1) & (capacity - 1);
+  }
+
+  return result_err(json_image_ref)(JSON_ERROR_INVALID_KEY);
+}
+
+result(json_string_view) json_image_object_key(json_image_ref_t object,
+                                               size_t i) {
+  const json_image_key_t *keys;
+  size_t capacity;
+  uint64_t values;
+
+  if (json_image_type(object) != JSON_ELEMENT_TYPE_OBJECT)
+    return result_err(json_string_view)(JSON_ERROR_INVALID_TYPE);
+  if (i >= json_image_count(object))
+    return result_err(json_string_view)(JSON_ERROR_INVALID_KEY);
+
+  if (!json_image_object(object, &keys, &capacity, &values) ||
+      !json_image_fits_string(object.image, keys[i].offset, keys[i].length))
+    return result_err(json_string_view)(JSON_ERROR_INVALID_VALUE);
+
+  json_string_view_t key = {0};
+  key.data = object.image->data + keys[i].offset;
+  key.length = keys[i].length;
+
+  return result_ok(json_string_view)(key);
+}
+
+result(json_image_ref) json_image_object_value(json_image_ref_t object,
+                                               size_t i) {
+  const json_image_key_t *keys;
+  size_t capacity;
+  uint64_t values;
+
+  if (json_image_type(object) != JSON_ELEMENT_TYPE_OBJECT)
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_TYPE);
+  if (i >= json_image_count(object))
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_KEY);
+
+  if (!json_image_object(object, &keys, &capacity, &values))
+    return result_err(json_image_ref)(JSON_ERROR_INVALID_VALUE);
+
+  json_image_ref_t value = {0};
+  value.image = object.image;
+  value.offset = values + i * sizeof(json_image_node_t);
+
+  return result_ok(json_image_ref)(value);
+}
+
+result(json_string_view) json_image_get_string(json_image_ref_t ref) {
+  const json_image_node_t *node = json_image_node_at(ref.image, ref.offset);
+
+  if (json_image_type(ref) != JSON_ELEMENT_TYPE_STRING)
+    return result_err(json_string_view)(JSON_ERROR_INVALID_TYPE);
+  if (!json_image_fits_string(ref.image, node->value, node->count))
+    return result_err(json_string_view)(JSON_ERROR_INVALID_VALUE);
+
+  json_string_view_t string = {0};
+  string.data = ref.image->data + node->value;
+  string.length = node->count;
+
+  return result_ok(json_string_view)(string);
+}
+
+result(json_number) json_image_get_number(json_image_ref_t ref) {
+  const json_image_node_t *node = json_image_node_at(ref.image, ref.offset);
+  json_number_t number = {0};
+
+  if (json_image_type(ref) != JSON_ELEMENT_TYPE_NUMBER)
+    return result_err(json_number)(JSON_ERROR_INVALID_TYPE);
+
+  number.type = (json_number_type_t)(node->type >> 8);
+  memcpy(&number.value, &node->value, sizeof(node->value));
+
+  return result_ok(json_number)(number);
+}
+
+result(json_boolean) json_image_get_boolean(json_image_ref_t ref) {
+  if (json_image_type(ref) != JSON_ELEMENT_TYPE_BOOLEAN)
+    return result_err(json_boolean)(JSON_ERROR_INVALID_TYPE);
+
+  return result_ok(json_boolean)(
+      json_image_node_at(ref.image, ref.offset)->value != 0);
+}
+
+result(json_image_ref) json_image_path_find(json_image_ref_t root,
+                                            const json_path_t * path) {
+  json_image_ref_t value = root;
+  size_t i;
+
+  for (i = 0; i < path->count; i++) {
+    const json_path_step_t *step = &path->steps[i];
+
+    switch (json_image_type(value)) {
+    case JSON_ELEMENT_TYPE_OBJECT: {
+      if (step->key.length == 0)
+        return result_err(json_image_ref)(JSON_ERROR_INVALID_KEY);
+
+      result_try(json_image_ref, json_image_ref, found,
+                 json_image_object_find_hashed(value, step->key.data,
+                                               step->key.length, step->hash));
+      value = found;
+      break;
+    }
+
+    case JSON_ELEMENT_TYPE_ARRAY: {
+      result_try(json_image_ref, json_image_ref, found,
+                 json_image_array_get(value, step->index));
+      value = found;
+      break;
+    }
+
+    default:
+      return result_err(json_image_ref)(JSON_ERROR_INVALID_TYPE);
+    }
+  }
+
+  return result_ok(json_image_ref)(value);
+}
+
+_bool json_image_fits(const json_image_t * image, uint64_t offset,
+                      uint64_t size) {
+  return offset % 8 == 0 && offset <= image->size &&
+         size <= image->size - offset;
+}
+
+_bool json_image_fits_string(const json_image_t * image, uint64_t offset,
+                             uint64_t len) {
+  return offset <= image->size && len < image->size - offset &&
+         image->data[offset + len] == '\0';
+}
+
+_bool json_image_object(json_image_ref_t object,
+                        const json_image_key_t ** keys, size_t *capacity,
+                        uint64_t *values) {
+  const json_image_t *image = object.image;
+  const json_image_node_t *node = json_image_node_at(image, object.offset);
+  const uint64_t count = node->count;
+
+  if (!json_image_fits(image, node->value,
+                       sizeof(uint64_t) + count * sizeof(json_image_node_t)))
+    return _false;
+
+  *capacity = 4;
+  while (3 * *capacity < 4 * count)
+    *capacity *= 2;
+
+  uint64_t shape;
+  memcpy(&shape, image->data + node->value, sizeof(shape));
+  if (!json_image_fits(image, shape,
+                       count * sizeof(json_image_key_t) +
+                           *capacity * sizeof(uint32_t)))
+    return _false;
+
+  *keys = (const json_image_key_t *)(image->data + shape);
+  *values = node->value + sizeof(uint64_t);
+
+  return _true;
+}
+
+define_result_type(json_image_ref)
@@ -0,0 +1,314 @@
+#include "json.h"
+#include "json_internal.h"
+#include "json_simd.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Stage 1 of the parser: classifies the input 64 bytes at a time into
+ * bitmasks of quotes, backslashes, structural characters and whitespace,
+ * resolves escapes and string spans with carries between blocks, and
+ * emits the offset of every token the recursive descent has to look at.
+ */
+
+/**
+ * @brief Bitmasks of one block, bit `i` describes byte `i`
+ */
+typedef struct json_index_block_s {
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t structural;
+  uint64_t whitespace;
+} json_index_block_t;
+
+/**
+ * @brief Fills the bitmasks of the 64 bytes at `block`
+ */
+static void json_index_classify(const unsigned char *, json_index_block_t *);
+
+/**
+ * @brief Bitmask of the characters escaped by a backslash
+ */
+static uint64_t json_index_escaped(uint64_t, uint64_t *);
+
+/**
+ * @brief Bit `i` of the result is the parity of bits `0..i` of `x`
+ */
+static uint64_t json_index_prefix_xor(uint64_t);
+
+/**
+ * @brief Appends the offsets of the bits set in `bits`
+ */
+static _bool json_index_emit(json_index_t *, size_t, uint64_t);
+
+#if defined(JSON_SIMD_AVX2)
+
+/**
+ * @brief Lanes of a 32-byte vector equal to `ch`
+ */
+#define json_index_eq(v, ch) _mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch))
+
+/**
+ * @brief Bitmask of the set lanes of a 32-byte comparison
+ */
+#define json_index_mask(cmp) ((uint64_t)(uint32_t)_mm256_movemask_epi8(cmp))
+
+/**
+ * @brief Lanes of a 32-byte vector holding a structural character
+ */
+static __m256i json_index_structural(__m256i v) {
+  return _mm256_or_si256(
+      _mm256_or_si256(_mm256_or_si256(json_index_eq(v, '{'),
+                                      json_index_eq(v, '}')),
+                      _mm256_or_si256(json_index_eq(v, '['),
+                                      json_index_eq(v, ']'))),
+      _mm256_or_si256(json_index_eq(v, ':'), json_index_eq(v, ',')));
+}
+
+/**
+ * @brief Lanes of a 32-byte vector holding whitespace
+ */
+static __m256i json_index_whitespace(__m256i v) {
+  return _mm256_or_si256(
+      _mm256_or_si256(json_index_eq(v, ' '), json_index_eq(v, '\n')),
+      _mm256_or_si256(json_index_eq(v, '\r'), json_index_eq(v, '\t')));
+}
+
+void json_index_classify(const unsigned char *block,
+                         json_index_block_t *out) {
+  __m256i lo = _mm256_loadu_si256((const __m256i *)block);
+  __m256i hi = _mm256_loadu_si256((const __m256i *)(block + 32));
+
+  // Comparisons are merged in vectors, one movemask per class and half
+  out->quote = json_index_mask(json_index_eq(lo, '"')) |
+               json_index_mask(json_index_eq(hi, '"')) << 32;
+  out->backslash = json_index_mask(json_index_eq(lo, '\\')) |
+                   json_index_mask(json_index_eq(hi, '\\')) << 32;
+  out->structural = json_index_mask(json_index_structural(lo)) |
+                    json_index_mask(json_index_structural(hi)) << 32;
+  out->whitespace = json_index_mask(json_index_whitespace(lo)) |
+                    json_index_mask(json_index_whitespace(hi)) << 32;
+}
+
+#elif defined(JSON_SIMD_SSE2)
+
+/**
+ * @brief Bitmask of the bytes of a 16-byte vector equal to `ch`
+ */
+#define json_index_eq(v, ch)                                                   \
+  ((uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(ch))))
+
+void json_index_classify(const unsigned char *block,
+                         json_index_block_t *out) {
+  json_index_block_t masks = {0};
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(block + i * 16));
+    int shift = i * 16;
+
+    masks.quote |= json_index_eq(v, '"') << shift;
+    masks.backslash |= json_index_eq(v, '\\') << shift;
+    masks.structural |=
+        (json_index_eq(v, '{') | json_index_eq(v, '}') |
+         json_index_eq(v, '[') | json_index_eq(v, ']') |
+         json_index_eq(v, ':') | json_index_eq(v, ','))
+        << shift;
+    masks.whitespace |= (json_index_eq(v, ' ') | json_index_eq(v, '\n') |
+                         json_index_eq(v, '\r') | json_index_eq(v, '\t'))
+                        << shift;
+  }
+
+  *out = masks;
+}
+
+#elif defined(JSON_SIMD_NEON)
+
+/**
+ * @brief Bitmask of the bytes of a 16-byte vector equal to `ch`
+ */
+#define json_index_eq(v, ch) vceqq_u8(v, vdupq_n_u8(ch))
+
+void json_index_classify(const unsigned char *block,
+                         json_index_block_t *out) {
+  json_index_block_t masks = {0};
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    uint8x16_t v = vld1q_u8(block + i * 16);
+    int shift = i * 16;
+
+    masks.quote |= json_simd_movemask(json_index_eq(v, '"')) << shift;
+    masks.backslash |= json_simd_movemask(json_index_eq(v, '\\')) << shift;
+    masks.structural |=
+        json_simd_movemask(vorrq_u8(
+            vorrq_u8(vorrq_u8(json_index_eq(v, '{'), json_index_eq(v, '}')),
+                     vorrq_u8(json_index_eq(v, '['), json_index_eq(v, ']'))),
+            vorrq_u8(json_index_eq(v, ':'), json_index_eq(v, ','))))
+        << shift;
+    masks.whitespace |=
+        json_simd_movemask(
+            vorrq_u8(vorrq_u8(json_index_eq(v, ' '), json_index_eq(v, '\n')),
+                     vorrq_u8(json_index_eq(v, '\r'), json_index_eq(v, '\t'))))
+        << shift;
+  }
+
+  *out = masks;
+}
+
+#else
+
+void json_index_classify(const unsigned char *block,
+                         json_index_block_t *out) {
+  json_index_block_t masks = {0};
+  int i;
+
+  for (i = 0; i < JSON_INDEX_BLOCK; i++) {
+    uint64_t bit = (uint64_t)1 << i;
+
+    switch (block[i]) {
+    case '"':
+      masks.quote |= bit;
+      break;
+    case '\\':
+      masks.backslash |= bit;
+      break;
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ':':
+    case ',':
+      masks.structural |= bit;
+      break;
+    case ' ':
+    case '\n':
+    case '\r':
+    case '\t':
+      masks.whitespace |= bit;
+      break;
+    }
+  }
+
+  *out = masks;
+}
+
+#endif
+
+uint64_t json_index_escaped(uint64_t backslash, uint64_t *prev_escaped) {
+  const uint64_t even_bits = 0x5555555555555555ULL;
+
+  backslash &= ~*prev_escaped;
+  uint64_t follows_escape = backslash << 1 | *prev_escaped;
+
+  // Backslash runs of odd length escape the character after them. Adding
+  // the run starts to the runs carries out of the even or odd ones
+  uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+  uint64_t even_carries = odd_starts + backslash;
+  *prev_escaped = even_carries < odd_starts;
+
+  uint64_t invert_mask = even_carries << 1;
+  return (even_bits ^ invert_mask) & follows_escape;
+}
+
+uint64_t json_index_prefix_xor(uint64_t x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+
+  return x;
+}
+
+_bool json_index_emit(json_index_t * index, size_t base, uint64_t bits) {
+  if (index->capacity - index->count < JSON_INDEX_BLOCK) {
+    size_t capacity = index->capacity > 0 ? index->capacity * 2 : 1024;
+    uint32_t *positions =
+        (uint32_t *)realloc(index->positions, capacity * sizeof(uint32_t));
+    if (positions == NULL)
+      return _false;
+
+    index->positions = positions;
+    index->capacity = capacity;
+  }
+
+  uint32_t *out = index->positions + index->count;
+  while (bits != 0) {
+    *out++ = (uint32_t)(base + json_simd_ctz(bits));
+    bits &= bits - 1;
+  }
+  index->count = out - index->positions;
+
+  return _true;
+}
+
+void json_index_scan(const unsigned char *block, json_index_carry_t * carry,
+                     json_index_masks_t * out) {
+  json_index_block_t masks;
+
+  json_index_classify(block, &masks);
+
+  uint64_t escaped = json_index_escaped(masks.backslash, &carry->escaped);
+  uint64_t quote = masks.quote & ~escaped;
+
+  // Set from each opening quote up to, but excluding, its closing quote
+  uint64_t in_string = json_index_prefix_xor(quote) ^ carry->in_string;
+  carry->in_string = (uint64_t)0 - (in_string >> 63);
+
+  uint64_t outside = ~in_string;
+  uint64_t structural = masks.structural & outside;
+
+  // Scalars (numbers, literals, stray bytes) are indexed where they start
+  uint64_t scalar =
+      ~(masks.structural | masks.whitespace | masks.quote) & outside;
+  uint64_t scalar_start = scalar & ~(scalar << 1 | carry->scalar);
+  carry->scalar = scalar >> 63;
+
+  out->tokens = structural | quote | scalar_start;
+  out->escaped = escaped;
+  out->in_string = in_string;
+}
+
+_bool json_index_build(json_index_t * index, json_string_t json_str,
+                       size_t len) {
+  json_index_carry_t carry = {0};
+  unsigned char tail[JSON_INDEX_BLOCK];
+  size_t offset;
+
+  index->count = 0;
+
+  // Offsets are stored in 32 bits
+  if (len > (size_t)0xFFFFFFFFUL)
+    return _false;
+
+  for (offset = 0; offset < len; offset += JSON_INDEX_BLOCK) {
+    const unsigned char *block = (const unsigned char *)json_str + offset;
+    json_index_masks_t masks;
+
+    // Pad the last partial block with whitespace, it never emits tokens
+    if (len - offset < JSON_INDEX_BLOCK) {
+      memset(tail, ' ', JSON_INDEX_BLOCK);
+      memcpy(tail, block, len - offset);
+      block = tail;
+    }
+
+    json_index_scan(block, &carry, &masks);
+
+    if (!json_index_emit(index, offset, masks.tokens))
+      return _false;
+  }
+
+  return _true;
+}
+
+void json_index_free(json_index_t * index) {
+  free(index->positions);
+  index->positions = NULL;
+  index->count = 0;
+  index->capacity = 0;
+}
+
+json_string_t json_index_kernel(void) { return JSON_SIMD_KERNEL; }
@@ -0,0 +1,359 @@
+#ifndef JSON_INTERNAL
+#define JSON_INTERNAL
+
+#include "json.h"
+
+/*
+ * Scanning helpers and parse state shared by the translation units of
+ * the library. Not part of the public API.
+ */
+
+#define define_result_type(name)                                               \
+  result(name) result_ok(name)(typed(name) value) {                            \
+    result(name) retval = {                                                    \
+        .is_ok = _true,                                                         \
+        .inner =                                                               \
+            {                                                                  \
+                .value = value,                                                \
+            },                                                                 \
+    };                                                                         \
+    return retval;                                                             \
+  }                                                                            \
+  result(name) result_err(name)(typed(json_error) err) {                       \
+    result(name) retval = {                                                    \
+        .is_ok = _false,                                                        \
+        .inner =                                                               \
+            {                                                                  \
+                .err = err,                                                    \
+            },                                                                 \
+    };                                                                         \
+    return retval;                                                             \
+  }                                                                            \
+  typed(json_boolean) result_is_ok(name)(result(name) * result) {              \
+    return result->is_ok;                                                      \
+  }                                                                            \
+  typed(json_boolean) result_is_err(name)(result(name) * result) {             \
+    return !result->is_ok;                                                     \
+  }                                                                            \
+  typed(name) result_unwrap(name)(result(name) * result) {                     \
+    return result->inner.value;                                                \
+  }                                                                            \
+  typed(json_error) result_unwrap_err(name)(result(name) * result) {           \
+    return result->inner.err;                                                  \
+  }
+
+/**
+ * @brief Determines whether a character `ch` is whitespace
+ */
+#define is_whitespace(ch) (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t')
+
+/**
+ * @brief The character at `ptr`, or '\0' once `end` is reached
+ */
+#define json_peek(ptr, end) ((ptr) < (end) ? *(ptr) : '\0')
+
+/**
+ * @brief Numbers shorter than this are copied to the stack to be
+ * handed to `strtod`, longer ones to the heap
+ */
+#define JSON_NUMBER_MAX_LEN 64
+
+/**
+ * @brief Longest text {json_number_format} writes, like
+ * -2.2250738585072014e-308
+ */
+#define JSON_NUMBER_FORMAT_LEN 32
+
+/**
+ * @brief Number of input bytes {json_index_scan} classifies at once
+ */
+#define JSON_INDEX_BLOCK 64
+
+/**
+ * @brief State {json_index_scan} carries from one block to the next
+ */
+typedef struct json_index_carry_s {
+  uint64_t escaped;
+  uint64_t in_string;
+  uint64_t scalar;
+} json_index_carry_t;
+
+/**
+ * @brief Masks of one scanned block, bit `i` describes byte `i`
+ */
+typedef struct json_index_masks_s {
+  /* Structural characters, unescaped quotes and starts of scalars */
+  uint64_t tokens;
+  /* Characters following an unescaped backslash */
+  uint64_t escaped;
+  /* From each opening quote up to, but excluding, its closing quote */
+  uint64_t in_string;
+} json_index_masks_t;
+
+/**
+ * @brief Per-parse state threaded through the recursive descent
+ */
+typedef struct json_context_s {
+  json_string_t start;
+  json_string_t end;
+  const uint32_t *tokens;
+  size_t token_count;
+  size_t token;
+  json_arena_t *arena;
+  _bool insitu;
+  json_key_pool_t *keys;
+  json_shape_table_t *shapes;
+  char *stack;
+  size_t stack_size;
+  size_t stack_capacity;
+} json_context_t;
+
+/**
+ * @brief State of one {json_serialize} or {json_encode} call
+ */
+typedef struct json_serializer_s {
+  json_writer_t *writer;
+  int indent;
+  /* Bytes already handed to the flush callback */
+  size_t flushed;
+  json_error_t error;
+} json_serializer_t;
+
+/**
+ * @brief Makes sure `count` bytes fit in the writer's buffer
+ */
+#define json_serialize_reserve(ctx, count)                                     \
+  ((ctx)->writer->capacity - (ctx)->writer->size >= (count) ||                 \
+   json_serialize_make_room((ctx), (count)))
+
+/**
+ * @brief Flushes or grows the buffer until `size` more bytes fit
+ */
+_bool json_serialize_make_room(json_serializer_t *, size_t);
+
+/**
+ * @brief Appends `len` bytes, flushing as often as it takes
+ */
+_bool json_serialize_write(json_serializer_t *, json_string_t, size_t);
+
+/**
+ * @brief Hands what is left in the writer's buffer to its flush
+ * callback at the end of a call that started at `start`
+ *
+ * @return The number of bytes the call wrote
+ */
+result(size) json_serialize_finish(json_serializer_t *, size_t);
+
+/**
+ * @brief Sets up a context over `len` bytes at `json_str`, building
+ * the structural index first when `options` asks for one
+ */
+void json_context_init(json_context_t *, json_string_t, size_t,
+                       const json_parse_options_t *);
+
+/**
+ * @brief Releases the scratch memory of a context
+ */
+void json_context_release(json_context_t *);
+
+/**
+ * @brief Allocates `size` bytes from the context's arena, or from the
+ * heap when parsing without one
+ */
+void *json_context_alloc(json_context_t *, size_t);
+
+/**
+ * @brief Releases an allocation. A no-op for arena allocations
+ */
+void json_context_free(json_context_t *, void *);
+
+/**
+ * @brief Releases what an element of a parse with `ctx` points to,
+ * leaving its strings and keys to whoever owns them. A no-op for arena
+ * parses
+ */
+void json_context_free_element(json_context_t *, json_element_t *);
+
+/**
+ * @brief Reserves `size` bytes on top of the context's scratch stack.
+ * Containers collect their children there while parsing, so the
+ * returned pointer is only valid until the next push. Entries and
+ * elements share the alignment of their number member, so pushing
+ * whole structs keeps every frame aligned
+ */
+void *json_stack_push(json_context_t *, size_t);
+
+/**
+ * @brief Pointer to the scratch stack at byte offset `offset`
+ */
+#define json_stack_at(ctx, type, offset) ((type *)((ctx)->stack + (offset)))
+
+/**
+ * @brief Bump allocates `size` bytes from `arena`
+ */
+void *json_arena_alloc(json_arena_t *, size_t);
+
+/**
+ * @brief Moves every chunk of `from` into `arena`, leaving `from`
+ * empty. Whatever was allocated from `from` now lives until `arena`
+ * is reset or freed
+ */
+void json_arena_merge(json_arena_t *, json_arena_t *);
+
+/**
+ * @brief Turns the `count` entries collected on the scratch stack at
+ * `base` into an indexed object, or a shaped one when the context has
+ * a shape table, and pops them. When that fails their keys and values
+ * are released too
+ */
+result(json_element_value) json_build_object(json_context_t *, size_t,
+                                             size_t);
+
+/**
+ * @brief Parses the comma separated elements in [`start`, `end`) the
+ * way the inside of an array is parsed, into `arena`. The slice may end
+ * with the ']' of the array it was cut from
+ */
+result(json_element_value) json_parse_elements(json_string_t, json_string_t,
+                                               json_arena_t *);
+
+/**
+ * @brief Moves a JSON string pointer beyond any whitespace. Minified
+ * input has none and pretty-printed input mostly a single space, so
+ * those are checked before falling into the vector loop
+ */
+void json_skip_whitespace(json_string_t *, json_string_t);
+
+/**
+ * @brief Moves a JSON string pointer beyond any whitespace. With a
+ * structural index this is a jump to the next indexed token
+ */
+void json_context_skip_whitespace(json_context_t *, json_string_t *);
+
+/**
+ * @brief Offset to the closing `"` of the string starting at `str`,
+ * looked up in the structural index when there is one
+ */
+size_t json_context_string_len(json_context_t *, json_string_t);
+
+/**
+ * @brief Offset to the last `"` of a JSON string ending before `end`
+ */
+size_t json_string_len(json_string_t, json_string_t);
+
+/**
+ * @brief Skips an element value
+ *
+ * @return true If a valid element is skipped
+ * @return false If element was invalid (still skips)
+ */
+_bool json_skip_element_value(json_string_t *, json_string_t,
+                              json_element_type_t);
+
+/**
+ * @brief Guesses the element type at the start of a string
+ */
+result(json_element_type) json_guess_element_type(json_string_t,
+                                                  json_string_t);
+
+/**
+ * @brief Whether a token represents a number. Like '0'
+ */
+_bool json_is_number(char);
+
+/**
+ * @brief Parses a `Number` {json_number_t} and moves the string
+ * pointer to the end of the parsed number
+ */
+result(json_element_value) json_parse_number(json_context_t *,
+                                             json_string_t *);
+
+/**
+ * @brief Parses the JSON number at the string pointer, which must end
+ * before `end`, and moves the pointer past it. The pointer is left
+ * alone on errors
+ */
+result(json_number) json_number_parse(json_string_t *, json_string_t);
+
+/**
+ * @brief Writes a number as JSON text into `buffer`, which must hold
+ * {JSON_NUMBER_FORMAT_LEN} bytes. Doubles get the fewest digits that
+ * read back to the same value, and always a fraction or an exponent
+ *
+ * @return The number of characters written, 0 for infinities and NaN,
+ * which JSON cannot represent
+ */
+size_t json_number_format(json_number_t, char *);
+
+/**
+ * @brief Hashes `len` bytes of an object key. Objects and key pools
+ * index their keys with it
+ */
+uint64_t json_key_hash(json_string_t, size_t);
+
+/**
+ * @brief Like {json_object_find_n}, with the {json_key_hash} of the key
+ * computed by the caller
+ */
+result(json_element) json_object_find_hashed(const json_object_t *,
+                                             json_string_t, size_t,
+                                             uint64_t);
+
+/**
+ * @brief Like {json_shape_find}, with the {json_key_hash} of the key
+ * computed by the caller
+ */
+result(size) json_shape_find_hashed(const json_shape_t *, json_string_t,
+                                    size_t, uint64_t);
+
+/**
+ * @brief The pooled copy of the `len` bytes at `key`, stored first if
+ * the pool does not have it yet
+ */
+result(json_string_view) json_key_pool_intern(json_key_pool_t *,
+                                              json_string_t, size_t);
+
+/**
+ * @brief The shape of `count` entries with pooled keys, created first
+ * if the table does not have it yet
+ *
+ * @return The shape, or NULL when out of memory
+ */
+json_shape_t *json_shape_intern(json_shape_table_t *, const json_entry_t *,
+                                size_t);
+
+/**
+ * @brief Whether the `raw_len` escaped bytes of a key unescape to the
+ * `len` bytes of `key`
+ */
+_bool json_key_equals(json_string_t, size_t, json_string_t, size_t);
+
+/**
+ * @brief Bytes of scratch {json_path_scan} needs for `count` paths
+ */
+size_t json_path_scratch_size(const json_path_t *, size_t);
+
+/**
+ * @brief {json_path_find_values} with the scratch memory given by the
+ * caller, {json_path_scratch_size} bytes of it
+ */
+result(size) json_path_scan(json_value_t, const json_path_t *, size_t,
+                            json_value_t *, size_t *);
+
+/**
+ * @brief Unescapes the `len` bytes of a string body into `output`,
+ * which must hold at least `len + 1` bytes, and NUL-terminates it.
+ * `output` may be the string itself
+ *
+ * @return The unescaped length
+ */
+result(size) json_unescape_into(char *, json_string_t, size_t);
+
+/**
+ * @brief Classifies the {JSON_INDEX_BLOCK} bytes at `block`, following
+ * on from the blocks before it through `carry`
+ */
+void json_index_scan(const unsigned char *, json_index_carry_t *,
+                     json_index_masks_t *);
+
+#endif
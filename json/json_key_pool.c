@@ -0,0 +1,135 @@
+#include "json.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Interning of object keys. Record-shaped documents repeat the same few
+ * keys in every object, so a parse given a pool looks each key up here
+ * and points its entries at the one stored copy. The table is keyed by
+ * the same hash objects index their entries with.
+ */
+
+/**
+ * @brief Slots of a pool's first table
+ */
+#define JSON_KEY_POOL_MIN_CAPACITY 64
+
+/**
+ * @brief The slot holding `len` bytes at `key`, or the free slot that
+ * ends its probe
+ */
+static json_key_slot_t *json_key_pool_slot(const json_key_pool_t *,
+                                           json_string_t, size_t, uint64_t);
+
+/**
+ * @brief Doubles the table, or creates the first one, and moves every
+ * key to its new slot
+ */
+static _bool json_key_pool_grow(json_key_pool_t *);
+
+void json_key_pool_init(json_key_pool_t * pool) {
+  json_arena_init(&pool->arena, 0);
+  pool->slots = NULL;
+  pool->count = 0;
+  pool->capacity = 0;
+}
+
+void json_key_pool_free(json_key_pool_t * pool) {
+  json_arena_free(&pool->arena);
+  free(pool->slots);
+
+  pool->slots = NULL;
+  pool->count = 0;
+  pool->capacity = 0;
+}
+
+result(json_string_view) json_key_pool_find(const json_key_pool_t * pool,
+                                            json_string_t key, size_t len) {
+  if (key == NULL || len == 0 || pool->capacity == 0)
+    return result_err(json_string_view)(JSON_ERROR_INVALID_KEY);
+
+  const json_key_slot_t *slot =
+      json_key_pool_slot(pool, key, len, json_key_hash(key, len));
+  if (slot->key.data == NULL)
+    return result_err(json_string_view)(JSON_ERROR_INVALID_KEY);
+
+  return result_ok(json_string_view)(slot->key);
+}
+
+result(json_string_view)
+    json_key_pool_intern(json_key_pool_t * pool, json_string_t key,
+                         size_t len) {
+  // Keep at least a quarter of the slots free so probes stay short
+  if (4 * (pool->count + 1) > 3 * pool->capacity &&
+      !json_key_pool_grow(pool))
+    return result_err(json_string_view)(JSON_ERROR_INVALID_VALUE);
+
+  const uint64_t hash = json_key_hash(key, len);
+  json_key_slot_t *slot = json_key_pool_slot(pool, key, len, hash);
+
+  if (slot->key.data == NULL) {
+    char *copy = (char *)json_arena_alloc(&pool->arena, len + 1);
+    if (copy == NULL)
+      return result_err(json_string_view)(JSON_ERROR_INVALID_VALUE);
+
+    memcpy(copy, key, len);
+    copy[len] = '\0';
+
+    slot->hash = hash;
+    slot->key.data = copy;
+    slot->key.length = len;
+    pool->count++;
+  }
+
+  return result_ok(json_string_view)(slot->key);
+}
+
+json_key_slot_t *json_key_pool_slot(const json_key_pool_t * pool,
+                                    json_string_t key, size_t len,
+                                    uint64_t hash) {
+  const size_t mask = pool->capacity - 1;
+  size_t index = hash & mask;
+
+  while (pool->slots[index].key.data != NULL) {
+    json_key_slot_t *slot = &pool->slots[index];
+
+    if (slot->hash == hash && slot->key.length == len &&
+        memcmp(slot->key.data, key, len) == 0)
+      return slot;
+
+    index = (index + 1) & mask;
+  }
+
+  return &pool->slots[index];
+}
+
+_bool json_key_pool_grow(json_key_pool_t * pool) {
+  const size_t capacity = pool->capacity > 0 ? 2 * pool->capacity
+                                             : JSON_KEY_POOL_MIN_CAPACITY;
+  json_key_slot_t *slots =
+      (json_key_slot_t *)calloc(capacity, sizeof(json_key_slot_t));
+  if (slots == NULL)
+    return _false;
+
+  // The stored hashes are reused, the keys themselves are not touched
+  size_t i;
+  for (i = 0; i < pool->capacity; i++) {
+    const json_key_slot_t *slot = &pool->slots[i];
+    if (slot->key.data == NULL)
+      continue;
+
+    size_t index = slot->hash & (capacity - 1);
+    while (slots[index].key.data != NULL)
+      index = (index + 1) & (capacity - 1);
+
+    slots[index] = *slot;
+  }
+
+  free(pool->slots);
+  pool->slots = slots;
+  pool->capacity = capacity;
+
+  return _true;
+}
@@ -0,0 +1,261 @@
+#include "json.h"
+#include "json_internal.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Newline-delimited JSON. Workers claim batches of whole lines in input
+ * order, parse every line of a batch into their own arena and then
+ * deliver the batch under the lock. In order mode a worker waits until
+ * the batches claimed before its own are delivered.
+ */
+
+/**
+ * @brief Bytes of input a worker claims at a time by default
+ */
+#define JSON_NDJSON_BATCH_SIZE (64 * 1024)
+
+/**
+ * @brief A parsed line waiting to be delivered
+ */
+typedef struct json_ndjson_record_s {
+  size_t offset;
+  result(json_element) element;
+} json_ndjson_record_t;
+
+/**
+ * @brief State shared by the workers, guarded by `lock`
+ */
+typedef struct json_ndjson_shared_s {
+  json_string_t start;
+  json_string_t end;
+  json_string_t next;
+  size_t batch_size;
+  json_boolean_t ordered;
+  json_ndjson_callback_t callback;
+  void *user;
+  size_t claimed;
+  size_t delivered;
+  size_t records;
+  json_boolean_t aborted;
+  json_boolean_t failed;
+  pthread_mutex_t lock;
+  pthread_cond_t turn;
+} json_ndjson_shared_t;
+
+/**
+ * @brief A worker and the memory it parses into
+ */
+typedef struct json_ndjson_worker_s {
+  json_ndjson_shared_t *shared;
+  json_arena_t arena;
+  json_ndjson_record_t *records;
+  size_t count;
+  size_t capacity;
+} json_ndjson_worker_t;
+
+/**
+ * @brief Claims, parses and delivers batches until the input runs out
+ * or the parse stops
+ */
+static void *json_ndjson_work(void *);
+
+/**
+ * @brief Parses the lines of [`start`, `end`) into the worker's records
+ */
+static _bool json_ndjson_parse_batch(json_ndjson_worker_t *, json_string_t,
+                                     json_string_t);
+
+/**
+ * @brief Hands the worker's records to the callback. Called with the
+ * lock held
+ */
+static void json_ndjson_deliver(json_ndjson_worker_t *);
+
+result(size) json_ndjson_parse(json_string_t json_str, size_t len,
+                               const json_ndjson_options_t * options,
+                               json_ndjson_callback_t callback, void *user) {
+  json_ndjson_shared_t shared;
+  json_ndjson_worker_t *workers;
+  pthread_t *threads;
+  size_t thread_count = options != NULL ? options->threads : 0;
+  size_t started = 0;
+  size_t i;
+
+  if (json_str == NULL || len == 0) {
+    return result_err(size)(JSON_ERROR_EMPTY);
+  }
+
+  if (thread_count == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = online > 0 ? (size_t)online : 1;
+  }
+
+  memset(&shared, 0, sizeof(json_ndjson_shared_t));
+  shared.start = json_str;
+  shared.end = json_str + len;
+  shared.next = json_str;
+  shared.batch_size = options != NULL && options->batch_size > 0
+                          ? options->batch_size
+                          : JSON_NDJSON_BATCH_SIZE;
+  shared.ordered = options != NULL && options->ordered;
+  shared.callback = callback;
+  shared.user = user;
+
+  workers = (json_ndjson_worker_t *)calloc(thread_count,
+                                           sizeof(json_ndjson_worker_t));
+  threads = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
+  if (workers == NULL || threads == NULL) {
+    free(workers);
+    free(threads);
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+  }
+
+  pthread_mutex_init(&shared.lock, NULL);
+  pthread_cond_init(&shared.turn, NULL);
+
+  for (i = 0; i < thread_count; i++) {
+    workers[i].shared = &shared;
+    json_arena_init(&workers[i].arena, 0);
+  }
+
+  // The caller is the first worker. If a thread cannot be started, the
+  // ones that did share the work
+  for (i = 1; i < thread_count; i++) {
+    if (pthread_create(&threads[started], NULL, json_ndjson_work,
+                       &workers[i]) != 0)
+      break;
+    started++;
+  }
+
+  json_ndjson_work(&workers[0]);
+
+  for (i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+  for (i = 0; i < thread_count; i++) {
+    json_arena_free(&workers[i].arena);
+    free(workers[i].records);
+  }
+
+  pthread_cond_destroy(&shared.turn);
+  pthread_mutex_destroy(&shared.lock);
+  free(workers);
+  free(threads);
+
+  if (shared.aborted)
+    return result_err(size)(JSON_ERROR_ABORTED);
+  if (shared.failed)
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+  return result_ok(size)(shared.records);
+}
+
+void *json_ndjson_work(void *arg) {
+  json_ndjson_worker_t *worker = (json_ndjson_worker_t *)arg;
+  json_ndjson_shared_t *shared = worker->shared;
+
+  for (;;) {
+    json_string_t start, end;
+    size_t batch;
+
+    pthread_mutex_lock(&shared->lock);
+    if (shared->aborted || shared->failed || shared->next == shared->end) {
+      pthread_mutex_unlock(&shared->lock);
+      break;
+    }
+
+    // Extend the batch to the end of the line it stops in
+    start = shared->next;
+    end = shared->end;
+    if ((size_t)(end - start) > shared->batch_size) {
+      const char *newline = (const char *)memchr(
+          start + shared->batch_size, '\n', end - start - shared->batch_size);
+      if (newline != NULL)
+        end = newline + 1;
+    }
+
+    shared->next = end;
+    batch = shared->claimed++;
+    pthread_mutex_unlock(&shared->lock);
+
+    _bool parsed = json_ndjson_parse_batch(worker, start, end);
+
+    pthread_mutex_lock(&shared->lock);
+    while (shared->ordered && shared->delivered != batch &&
+           !shared->aborted && !shared->failed)
+      pthread_cond_wait(&shared->turn, &shared->lock);
+
+    if (!parsed)
+      shared->failed = _true;
+    else if (!shared->aborted && !shared->failed)
+      json_ndjson_deliver(worker);
+
+    shared->delivered++;
+    pthread_cond_broadcast(&shared->turn);
+    pthread_mutex_unlock(&shared->lock);
+
+    json_arena_reset(&worker->arena);
+    worker->count = 0;
+  }
+
+  return NULL;
+}
+
+_bool json_ndjson_parse_batch(json_ndjson_worker_t * worker,
+                              json_string_t start, json_string_t end) {
+  json_parse_options_t options = {0};
+  json_string_t line = start;
+
+  options.arena = &worker->arena;
+
+  while (line < end) {
+    const char *newline = (const char *)memchr(line, '\n', end - line);
+    json_string_t line_end = newline != NULL ? newline : end;
+    json_string_t ptr = line;
+
+    // Blank lines are not records
+    json_skip_whitespace(&ptr, line_end);
+    if (ptr == line_end) {
+      line = line_end + 1;
+      continue;
+    }
+
+    if (worker->count == worker->capacity) {
+      size_t capacity = worker->capacity > 0 ? worker->capacity * 2 : 256;
+      json_ndjson_record_t *records = (json_ndjson_record_t *)realloc(
+          worker->records, capacity * sizeof(json_ndjson_record_t));
+      if (records == NULL)
+        return _false;
+
+      worker->records = records;
+      worker->capacity = capacity;
+    }
+
+    json_ndjson_record_t *record = &worker->records[worker->count++];
+    record->offset = line - worker->shared->start;
+    record->element = json_parse_ex(line, line_end - line, &options);
+
+    line = line_end + 1;
+  }
+
+  return _true;
+}
+
+void json_ndjson_deliver(json_ndjson_worker_t * worker) {
+  json_ndjson_shared_t *shared = worker->shared;
+  size_t i;
+
+  for (i = 0; i < worker->count; i++) {
+    json_ndjson_record_t *record = &worker->records[i];
+
+    shared->records++;
+    if (!shared->callback(shared->user, record->offset, record->element)) {
+      shared->aborted = _true;
+      return;
+    }
+  }
+}
@@ -0,0 +1,299 @@
+#include "json.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * On-demand access: a value is the position of its first byte in the
+ * input. Nothing is parsed until a getter is called, and navigating
+ * past a value skips it with the same scanners {json_parse} uses to
+ * skip invalid input.
+ */
+
+/**
+ * @brief Keys with escapes up to this length are unescaped on the
+ * stack to compare them
+ */
+#define JSON_KEY_BUFFER_SIZE 256
+
+/**
+ * @brief A cursor at `ptr` of `document`
+ */
+static json_value_t json_value_make(json_document_t *, json_string_t);
+
+/**
+ * @brief Moves a JSON string pointer beyond the value it points at
+ */
+static result(json_element_type) json_value_skip(json_document_t *,
+                                                 json_string_t *);
+
+result(json_value) json_document_init(json_document_t * document,
+                                      json_string_t json_str, size_t len) {
+  if (json_str == NULL || len == 0) {
+    return result_err(json_value)(JSON_ERROR_EMPTY);
+  }
+
+  document->start = json_str;
+  document->end = json_str + len;
+  json_arena_init(&document->strings, 0);
+
+  json_skip_whitespace(&json_str, document->end);
+  if (json_str == document->end)
+    return result_err(json_value)(JSON_ERROR_EMPTY);
+
+  return result_ok(json_value)(json_value_make(document, json_str));
+}
+
+void json_document_free(json_document_t * document) {
+  json_arena_free(&document->strings);
+}
+
+json_value_t json_value_make(json_document_t * document, json_string_t ptr) {
+  json_value_t value = {0};
+  value.document = document;
+  value.ptr = ptr;
+
+  return value;
+}
+
+result(json_element_type)
+    json_value_skip(json_document_t * document, json_string_t * str_ptr) {
+  result_try(json_element_type, json_element_type, type,
+             json_guess_element_type(*str_ptr, document->end));
+
+  // The result only flags empty and invalid values, both still skipped.
+  // The separator after the value is what gets checked
+  json_skip_element_value(str_ptr, document->end, type);
+
+  return result_ok(json_element_type)(type);
+}
+
+result(json_element_type) json_value_type(json_value_t value) {
+  return json_guess_element_type(value.ptr, value.document->end);
+}
+
+result(json_value) json_value_first(json_value_t value) {
+  json_string_t end = value.document->end;
+  json_string_t ptr = value.ptr;
+  const char open = json_peek(ptr, end);
+
+  if (open != '{' && open != '[')
+    return result_err(json_value)(JSON_ERROR_INVALID_TYPE);
+
+  ptr++;
+  json_skip_whitespace(&ptr, end);
+
+  const char ch = json_peek(ptr, end);
+  if (ch == '}' || ch == ']')
+    return result_err(json_value)(JSON_ERROR_EMPTY);
+  if (ch == '\0')
+    return result_err(json_value)(JSON_ERROR_INVALID_VALUE);
+
+  return result_ok(json_value)(json_value_make(value.document, ptr));
+}
+
+result(json_value) json_value_next(json_value_t value) {
+  json_document_t *document = value.document;
+  json_string_t ptr = value.ptr;
+
+  result(json_element_type) skip_result = json_value_skip(document, &ptr);
+  if (result_is_err(json_element_type)(&skip_result))
+    return result_map_err(json_value, json_element_type, &skip_result);
+
+  json_skip_whitespace(&ptr, document->end);
+
+  switch (json_peek(ptr, document->end)) {
+  case ',':
+  case ':':
+    ptr++;
+    json_skip_whitespace(&ptr, document->end);
+    return result_ok(json_value)(json_value_make(document, ptr));
+
+  case '}':
+  case ']':
+    return result_err(json_value)(JSON_ERROR_EMPTY);
+
+  default:
+    return result_err(json_value)(JSON_ERROR_INVALID_VALUE);
+  }
+}
+
+result(json_value) json_value_find(json_value_t object, json_string_t key) {
+  if (key == NULL)
+    return result_err(json_value)(JSON_ERROR_INVALID_KEY);
+
+  return json_value_find_n(object, key, strlen(key));
+}
+
+result(json_value) json_value_find_n(json_value_t object, json_string_t key,
+                                     size_t len) {
+  json_document_t *document = object.document;
+  json_string_t end = document->end;
+  json_string_t ptr = object.ptr;
+
+  if (key == NULL)
+    return result_err(json_value)(JSON_ERROR_INVALID_KEY);
+  if (json_peek(ptr, end) != '{')
+    return result_err(json_value)(JSON_ERROR_INVALID_TYPE);
+
+  // Skip the first '{' character
+  ptr++;
+  json_skip_whitespace(&ptr, end);
+
+  while (json_peek(ptr, end) == '"') {
+    json_string_t raw = ptr + 1;
+    size_t raw_len = json_string_len(raw, end);
+    if (raw_len == 0 && json_peek(raw, end) != '"')
+      return result_err(json_value)(JSON_ERROR_INVALID_VALUE);
+
+    _bool found = json_key_equals(raw, raw_len, key, len);
+
+    // Skip beyond the key and the ':' delimiter
+    ptr = raw + raw_len + 1;
+    json_skip_whitespace(&ptr, end);
+    if (json_peek(ptr, end) != ':')
+      return result_err(json_value)(JSON_ERROR_INVALID_VALUE);
+
+    ptr++;
+    json_skip_whitespace(&ptr, end);
+
+    if (found)
+      return result_ok(json_value)(json_value_make(document, ptr));
+
+    result(json_element_type) skip_result = json_value_skip(document, &ptr);
+    if (result_is_err(json_element_type)(&skip_result))
+      return result_map_err(json_value, json_element_type, &skip_result);
+
+    json_skip_whitespace(&ptr, end);
+    if (json_peek(ptr, end) != ',')
+      break;
+
+    // Skip the ',' to move to the next entry
+    ptr++;
+    json_skip_whitespace(&ptr, end);
+  }
+
+  return result_err(json_value)(JSON_ERROR_INVALID_KEY);
+}
+
+_bool json_key_equals(json_string_t raw, size_t raw_len, json_string_t key,
+                      size_t len) {
+  // Escapes only ever shorten a string
+  if (raw_len < len)
+    return _false;
+
+  if (memchr(raw, '\\', raw_len) == NULL)
+    return raw_len == len && memcmp(raw, key, len) == 0;
+
+  char buffer[JSON_KEY_BUFFER_SIZE];
+  char *output = raw_len < JSON_KEY_BUFFER_SIZE ? buffer
+                                                : (char *)malloc(raw_len + 1);
+  if (output == NULL)
+    return _false;
+
+  result(size) length_result = json_unescape_into(output, raw, raw_len);
+  _bool equals = result_is_ok(size)(&length_result) &&
+                 result_unwrap(size)(&length_result) == len &&
+                 memcmp(output, key, len) == 0;
+
+  if (output != buffer)
+    free(output);
+
+  return equals;
+}
+
+result(json_value) json_value_at(json_value_t array, size_t i) {
+  if (json_peek(array.ptr, array.document->end) != '[')
+    return result_err(json_value)(JSON_ERROR_INVALID_TYPE);
+
+  result(json_value) element_result = json_value_first(array);
+  while (result_is_ok(json_value)(&element_result) && i-- > 0) {
+    json_value_t element = result_unwrap(json_value)(&element_result);
+    element_result = json_value_next(element);
+  }
+
+  if (result_is_err(json_value)(&element_result) &&
+      result_unwrap_err(json_value)(&element_result) == JSON_ERROR_EMPTY)
+    return result_err(json_value)(JSON_ERROR_INVALID_KEY);
+
+  return element_result;
+}
+
+result(json_string_view) json_value_get_string(json_value_t value) {
+  json_document_t *document = value.document;
+
+  if (json_peek(value.ptr, document->end) != '"')
+    return result_err(json_string_view)(JSON_ERROR_INVALID_TYPE);
+
+  json_string_t raw = value.ptr + 1;
+  size_t raw_len = json_string_len(raw, document->end);
+  if (raw_len == 0 && json_peek(raw, document->end) != '"')
+    return result_err(json_string_view)(JSON_ERROR_INVALID_VALUE);
+
+  json_string_view_t view = {0};
+
+  if (memchr(raw, '\\', raw_len) == NULL) {
+    view.data = raw;
+    view.length = raw_len;
+    return result_ok(json_string_view)(view);
+  }
+
+  char *output = (char *)json_arena_alloc(&document->strings, raw_len + 1);
+  if (output == NULL)
+    return result_err(json_string_view)(JSON_ERROR_INVALID_VALUE);
+
+  result_try(json_string_view, size, length,
+             json_unescape_into(output, raw, raw_len));
+
+  view.data = output;
+  view.length = length;
+
+  return result_ok(json_string_view)(view);
+}
+
+result(json_number) json_value_get_number(json_value_t value) {
+  json_document_t *document = value.document;
+  json_string_t ptr = value.ptr;
+  json_context_t ctx;
+
+  if (!json_is_number(json_peek(ptr, document->end)))
+    return result_err(json_number)(JSON_ERROR_INVALID_TYPE);
+
+  json_context_init(&ctx, document->start, document->end - document->start,
+                    NULL);
+  result_try(json_number, json_element_value, number,
+             json_parse_number(&ctx, &ptr));
+
+  if (ptr == value.ptr)
+    return result_err(json_number)(JSON_ERROR_INVALID_VALUE);
+
+  return result_ok(json_number)(number.as_number);
+}
+
+result(json_boolean) json_value_get_boolean(json_value_t value) {
+  size_t left = value.document->end - value.ptr;
+
+  switch (json_peek(value.ptr, value.document->end)) {
+  case 't':
+    if (left >= 4 && memcmp(value.ptr, "true", 4) == 0)
+      return result_ok(json_boolean)(_true);
+    return result_err(json_boolean)(JSON_ERROR_INVALID_VALUE);
+
+  case 'f':
+    if (left >= 5 && memcmp(value.ptr, "false", 5) == 0)
+      return result_ok(json_boolean)(_false);
+    return result_err(json_boolean)(JSON_ERROR_INVALID_VALUE);
+
+  default:
+    return result_err(json_boolean)(JSON_ERROR_INVALID_TYPE);
+  }
+}
+
+json_boolean_t json_value_is_null(json_value_t value) {
+  size_t left = value.document->end - value.ptr;
+
+  return left >= 4 && memcmp(value.ptr, "null", 4) == 0;
+}
+
+define_result_type(json_value)
@@ -0,0 +1,337 @@
+#include "json.h"
+#include "json_internal.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Parallel parse of a document that is one large array. The bytes
+ * inside the array are cut into one range per thread. A first pass
+ * over every range counts its unescaped quotes and the change in
+ * nesting depth, once supposing the range starts outside a string and
+ * once supposing it starts inside one. Chaining the ranges from the
+ * first one settles which guess was right and how deep each range
+ * starts. A second pass moves the start of every range to its first
+ * comma between two elements of the array, and the slices in between
+ * are parsed concurrently and stitched into one array.
+ */
+
+/**
+ * @brief Inputs shorter than this per thread are parsed on fewer threads
+ */
+#define JSON_PARALLEL_MIN_SLICE (256 * 1024)
+
+/**
+ * @brief Whether a byte is one the first pass looks at: a quote, a
+ * backslash or a bracket. Runs of other bytes are skipped in a tight
+ * loop
+ */
+#define json_parallel_is_special(ch)                                           \
+  (json_parallel_special[(unsigned char)(ch)])
+
+static const unsigned char json_parallel_special[256] = {
+    ['"'] = 1, ['\\'] = 1, ['['] = 1, [']'] = 1, ['{'] = 1, ['}'] = 1,
+};
+
+/**
+ * @brief A range of the array body and what the passes learn about it
+ */
+typedef struct json_slice_s {
+  json_string_t start;
+  json_string_t end;
+  /* The first byte inside the array, escapes are not looked for
+     before it */
+  json_string_t body;
+  /* Whether the range has an odd number of unescaped quotes, and its
+     change in depth when starting outside and inside a string */
+  _bool odd_quotes;
+  long depth[2];
+  /* Where the range really starts, once the ranges are chained */
+  _bool in_string;
+  long start_depth;
+  /* The comma the slice starts after, NULL if the range has none */
+  json_string_t cut;
+  /* What the slice parses into */
+  json_string_t parse_end;
+  json_arena_t arena;
+  result(json_element_value) elements;
+} json_slice_t;
+
+/**
+ * @brief Runs `task` on every slice, the first one on the calling thread
+ */
+static void json_parallel_run(void *(*)(void *), json_slice_t *, size_t);
+
+/**
+ * @brief Number of backslashes right before `ptr`, not looking before
+ * the array body
+ */
+static size_t json_parallel_backslashes(const json_slice_t *, json_string_t);
+
+/**
+ * @brief First pass: counts the quotes and depth change of a slice
+ */
+static void *json_parallel_scan(void *);
+
+/**
+ * @brief Second pass: finds the first comma between two elements
+ */
+static void *json_parallel_cut(void *);
+
+/**
+ * @brief Third pass: parses the elements of a slice into its arena
+ */
+static void *json_parallel_parse(void *);
+
+result(json_element) json_parse_parallel(json_string_t json_str, size_t len,
+                                         json_arena_t * arena,
+                                         size_t threads) {
+  json_parse_options_t options = {0};
+  json_string_t ptr = json_str;
+  json_string_t end = json_str + len;
+  json_slice_t *slices;
+  size_t count = 0;
+  size_t i;
+
+  if (json_str == NULL || len == 0) {
+    return result_err(json_element)(JSON_ERROR_EMPTY);
+  }
+
+  options.arena = arena;
+
+  if (threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? (size_t)online : 1;
+  }
+  if (threads > len / JSON_PARALLEL_MIN_SLICE)
+    threads = len / JSON_PARALLEL_MIN_SLICE;
+
+  json_skip_whitespace(&ptr, end);
+  if (threads <= 1 || json_peek(ptr, end) != '[')
+    return json_parse_ex(json_str, len, &options);
+
+  slices = (json_slice_t *)calloc(threads, sizeof(json_slice_t));
+  if (slices == NULL)
+    return json_parse_ex(json_str, len, &options);
+
+  // Skip the '[' opening the array
+  ptr++;
+
+  for (i = 0; i < threads; i++) {
+    slices[i].start = ptr + (end - ptr) * i / threads;
+    slices[i].end = ptr + (end - ptr) * (i + 1) / threads;
+    slices[i].body = ptr;
+    json_arena_init(&slices[i].arena, 0);
+  }
+
+  json_parallel_run(json_parallel_scan, slices, threads);
+
+  _bool in_string = _false;
+  long depth = 0;
+
+  for (i = 0; i < threads; i++) {
+    slices[i].in_string = in_string;
+    slices[i].start_depth = depth;
+
+    depth += slices[i].depth[in_string];
+    in_string ^= slices[i].odd_quotes;
+  }
+
+  // Only the ']' of the array may close more than was opened. Anything
+  // else, like text after the array, is left to the serial parse
+  if (in_string || depth != -1) {
+    free(slices);
+    return json_parse_ex(json_str, len, &options);
+  }
+
+  json_parallel_run(json_parallel_cut, slices, threads);
+
+  // A slice runs up to the next cut. Ranges without a cut, which lie
+  // inside a single large element, are parsed as part of the previous
+  slices[0].cut = ptr - 1;
+  for (i = threads; i-- > 0;) {
+    if (slices[i].cut == NULL)
+      continue;
+
+    slices[i].parse_end = end;
+    if (i + 1 < threads) {
+      size_t next = i + 1;
+      while (next < threads && slices[next].cut == NULL)
+        next++;
+      if (next < threads)
+        slices[i].parse_end = slices[next].cut;
+    }
+  }
+
+  json_parallel_run(json_parallel_parse, slices, threads);
+
+  for (i = 0; i < threads; i++) {
+    if (slices[i].cut != NULL &&
+        result_is_ok(json_element_value)(&slices[i].elements))
+      count += result_unwrap(json_element_value)(&slices[i].elements)
+                   .as_array->count;
+  }
+
+  json_element_t *elements =
+      count > 0
+          ? (json_element_t *)json_arena_alloc(arena,
+                                               count * sizeof(json_element_t))
+          : NULL;
+  json_array_t *array = (json_array_t *)json_arena_alloc(arena,
+                                                         sizeof(json_array_t));
+  size_t offset = 0;
+
+  // Stitch the elements together and keep the memory they point to
+  for (i = 0; i < threads; i++) {
+    if (elements != NULL && slices[i].cut != NULL &&
+        result_is_ok(json_element_value)(&slices[i].elements)) {
+      json_array_t *part =
+          result_unwrap(json_element_value)(&slices[i].elements).as_array;
+
+      memcpy(elements + offset, part->elements,
+             part->count * sizeof(json_element_t));
+      offset += part->count;
+    }
+
+    json_arena_merge(arena, &slices[i].arena);
+  }
+
+  free(slices);
+
+  if (count == 0)
+    return result_err(json_element)(JSON_ERROR_EMPTY);
+  if (elements == NULL || array == NULL)
+    return result_err(json_element)(JSON_ERROR_INVALID_VALUE);
+
+  array->count = count;
+  array->elements = elements;
+
+  json_element_t element = {0};
+  element.type = JSON_ELEMENT_TYPE_ARRAY;
+  element.value.as_array = array;
+
+  return result_ok(json_element)(element);
+}
+
+void json_parallel_run(void *(*task)(void *), json_slice_t * slices,
+                       size_t count) {
+  pthread_t *threads = (pthread_t *)malloc(count * sizeof(pthread_t));
+  size_t started = 0;
+  size_t i;
+
+  // Slices whose thread cannot be started run on the calling thread
+  for (i = 1; i < count; i++) {
+    if (threads == NULL ||
+        pthread_create(&threads[started], NULL, task, &slices[i]) != 0)
+      task(&slices[i]);
+    else
+      started++;
+  }
+
+  task(&slices[0]);
+
+  for (i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+  free(threads);
+}
+
+size_t json_parallel_backslashes(const json_slice_t * slice,
+                                 json_string_t ptr) {
+  json_string_t iter = ptr;
+
+  while (iter > slice->body && iter[-1] == '\\')
+    iter--;
+
+  return ptr - iter;
+}
+
+void *json_parallel_scan(void *arg) {
+  json_slice_t *slice = (json_slice_t *)arg;
+  json_string_t ptr = slice->start;
+  size_t backslashes = json_parallel_backslashes(slice, ptr);
+  _bool in_string = _false;
+
+  // Brackets count towards the guess that agrees with `in_string`, the
+  // state as seen from a start outside a string
+  for (; ptr < slice->end; ptr++) {
+    if (!json_parallel_is_special(*ptr)) {
+      backslashes = 0;
+      do
+        ptr++;
+      while (ptr < slice->end && !json_parallel_is_special(*ptr));
+
+      if (ptr == slice->end)
+        break;
+    }
+
+    const char ch = *ptr;
+
+    if (ch == '\\') {
+      backslashes++;
+      continue;
+    }
+
+    if (ch == '"' && backslashes % 2 == 0)
+      in_string = !in_string;
+    else if (ch == '[' || ch == '{')
+      slice->depth[in_string]++;
+    else if (ch == ']' || ch == '}')
+      slice->depth[in_string]--;
+
+    backslashes = 0;
+  }
+
+  slice->odd_quotes = in_string;
+
+  return NULL;
+}
+
+void *json_parallel_cut(void *arg) {
+  json_slice_t *slice = (json_slice_t *)arg;
+  json_string_t ptr = slice->start;
+  size_t backslashes = json_parallel_backslashes(slice, ptr);
+  _bool in_string = slice->in_string;
+  long depth = slice->start_depth;
+
+  slice->cut = NULL;
+
+  for (; ptr < slice->end; ptr++) {
+    const char ch = *ptr;
+
+    if (ch == '\\') {
+      backslashes++;
+      continue;
+    }
+
+    if (ch == '"' && backslashes % 2 == 0) {
+      in_string = !in_string;
+    } else if (!in_string) {
+      if (ch == ',' && depth == 0) {
+        slice->cut = ptr;
+        break;
+      }
+
+      if (ch == '[' || ch == '{')
+        depth++;
+      else if (ch == ']' || ch == '}')
+        depth--;
+    }
+
+    backslashes = 0;
+  }
+
+  return NULL;
+}
+
+void *json_parallel_parse(void *arg) {
+  json_slice_t *slice = (json_slice_t *)arg;
+
+  if (slice->cut != NULL)
+    slice->elements =
+        json_parse_elements(slice->cut + 1, slice->parse_end, &slice->arena);
+
+  return NULL;
+}
@@ -0,0 +1,545 @@
+#include "json.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Compiled paths. A JSON Pointer or dotted path is split into steps
+ * once, with every key unescaped and hashed and every number turned
+ * into an index, so running it against a document is one lookup per
+ * step. Against raw text, several paths are resolved in one scan that
+ * only descends into the containers some path goes through.
+ */
+
+/**
+ * @brief State of {json_path_find_values}
+ */
+typedef struct json_path_walk_s {
+  json_document_t *document;
+  const json_path_t *paths;
+  size_t path_count;
+  json_value_t *values;
+  size_t remaining;
+  /* The numbers of the paths still followed, `path_count` per depth */
+  size_t *active;
+  _bool failed;
+} json_path_walk_t;
+
+/**
+ * @brief Adds the key written to [`key`, `end`) to `path` as a step,
+ * with its hash and index
+ */
+static void json_path_add_step(json_path_t *, char *, char *);
+
+/**
+ * @brief The array index a key spells, or {JSON_PATH_NO_INDEX}
+ */
+static size_t json_path_index(json_string_t, size_t);
+
+/**
+ * @brief Compiles the steps of a JSON Pointer into `path`
+ */
+static _bool json_path_compile_pointer(json_path_t *, json_string_t);
+
+/**
+ * @brief Compiles the steps of a dotted path into `path`
+ */
+static _bool json_path_compile_dotted(json_path_t *, json_string_t);
+
+/**
+ * @brief Records the value at the string pointer for the `count` paths
+ * of `depth` that end there, and follows the others into it. The
+ * pointer is left after the value
+ *
+ * @return false Once every path is resolved or the input is malformed
+ */
+static _bool json_path_walk_value(json_path_walk_t *, json_string_t *,
+                                  size_t, size_t);
+
+/**
+ * @brief Scans an object once for the keys of the `count` paths of
+ * `depth`
+ */
+static _bool json_path_walk_object(json_path_walk_t *, json_string_t *,
+                                   size_t, size_t);
+
+/**
+ * @brief Scans an array once for the indexes of the `count` paths of
+ * `depth`
+ */
+static _bool json_path_walk_array(json_path_walk_t *, json_string_t *,
+                                  size_t, size_t);
+
+/**
+ * @brief Sorts the numbers of `count` paths by the index of their step
+ * at `depth`, so an array is matched against them in order
+ */
+static void json_path_sort(const json_path_t *, size_t *, size_t, size_t);
+
+/**
+ * @brief Moves the path at `root` down the heap of the first `count`
+ * paths until it is not smaller than its children
+ */
+static void json_path_sift(const json_path_t *, size_t *, size_t, size_t,
+                           size_t);
+
+/**
+ * @brief Moves the string pointer beyond a value no path goes into
+ */
+static _bool json_path_walk_skip(json_path_walk_t *, json_string_t *);
+
+result(json_path) json_path_compile(json_string_t path) {
+  json_path_t compiled = {0};
+
+  if (path == NULL)
+    return result_err(json_path)(JSON_ERROR_INVALID_KEY);
+
+  // Every separator starts at most one step, and every step adds a
+  // terminator to the keys
+  size_t len = strlen(path);
+  size_t bound = 1;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    if (path[i] == '/' || path[i] == '.' || path[i] == '[')
+      bound++;
+  }
+
+  compiled.steps =
+      (json_path_step_t *)malloc(bound * sizeof(json_path_step_t));
+  compiled.keys = (char *)malloc(len + bound);
+  if (compiled.steps == NULL || compiled.keys == NULL) {
+    json_path_free(&compiled);
+    return result_err(json_path)(JSON_ERROR_INVALID_VALUE);
+  }
+
+  _bool valid = len == 0 || path[0] == '/'
+                    ? json_path_compile_pointer(&compiled, path)
+                    : json_path_compile_dotted(&compiled, path);
+  if (!valid) {
+    json_path_free(&compiled);
+    return result_err(json_path)(JSON_ERROR_INVALID_KEY);
+  }
+
+  return result_ok(json_path)(compiled);
+}
+
+void json_path_free(json_path_t * path) {
+  free(path->steps);
+  free(path->keys);
+
+  path->steps = NULL;
+  path->keys = NULL;
+  path->count = 0;
+}
+
+_bool json_path_compile_pointer(json_path_t * path, json_string_t iter) {
+  char *output = path->keys;
+
+  while (*iter == '/') {
+    char *key = output;
+    iter++;
+
+    for (; *iter != '\0' && *iter != '/'; iter++) {
+      if (*iter != '~') {
+        *output++ = *iter;
+        continue;
+      }
+
+      // The only escapes of a pointer
+      iter++;
+      if (*iter == '0')
+        *output++ = '~';
+      else if (*iter == '1')
+        *output++ = '/';
+      else
+        return _false;
+    }
+
+    json_path_add_step(path, key, output);
+    *output++ = '\0';
+  }
+
+  return *iter == '\0';
+}
+
+_bool json_path_compile_dotted(json_path_t * path, json_string_t iter) {
+  char *output = path->keys;
+
+  while (*iter != '\0') {
+    char *key = output;
+
+    if (*iter == '[') {
+      for (iter++; *iter >= '0' && *iter <= '9'; iter++)
+        *output++ = *iter;
+
+      if (output == key || *iter != ']')
+        return _false;
+      iter++;
+
+      if (*iter != '\0' && *iter != '.' && *iter != '[')
+        return _false;
+    } else {
+      for (; *iter != '\0' && *iter != '.' && *iter != '['; iter++)
+        *output++ = *iter;
+
+      if (output == key)
+        return _false;
+    }
+
+    json_path_add_step(path, key, output);
+    *output++ = '\0';
+
+    // A '.' is always followed by another step
+    if (*iter == '.' && *++iter == '\0')
+      return _false;
+  }
+
+  return _true;
+}
+
+void json_path_add_step(json_path_t * path, char *key, char *end) {
+  json_path_step_t *step = &path->steps[path->count++];
+
+  step->key.data = key;
+  step->key.length = end - key;
+  step->hash = json_key_hash(key, step->key.length);
+  step->index = json_path_index(key, step->key.length);
+}
+
+size_t json_path_index(json_string_t key, size_t len) {
+  size_t index = 0;
+  size_t i;
+
+  // Like RFC 6901, no leading zeros
+  if (len == 0 || (len > 1 && key[0] == '0'))
+    return JSON_PATH_NO_INDEX;
+
+  for (i = 0; i < len; i++) {
+    if (key[i] < '0' || key[i] > '9')
+      return JSON_PATH_NO_INDEX;
+    if (index > (JSON_PATH_NO_INDEX - 9) / 10)
+      return JSON_PATH_NO_INDEX;
+
+    index = index * 10 + (key[i] - '0');
+  }
+
+  return index;
+}
+
+result(json_element) json_path_find(const json_element_t * root,
+                                    const json_path_t * path) {
+  json_element_t element = *root;
+  size_t i;
+
+  for (i = 0; i < path->count; i++) {
+    const json_path_step_t *step = &path->steps[i];
+
+    switch (element.type) {
+    case JSON_ELEMENT_TYPE_OBJECT: {
+      if (step->key.length == 0)
+        return result_err(json_element)(JSON_ERROR_INVALID_KEY);
+
+      result_try(json_element, json_element, found,
+                 json_object_find_hashed(element.value.as_object,
+                                         step->key.data, step->key.length,
+                                         step->hash));
+      element = found;
+      break;
+    }
+
+    case JSON_ELEMENT_TYPE_ARRAY:
+      if (step->index >= element.value.as_array->count)
+        return result_err(json_element)(JSON_ERROR_INVALID_KEY);
+
+      element = element.value.as_array->elements[step->index];
+      break;
+
+    default:
+      return result_err(json_element)(JSON_ERROR_INVALID_TYPE);
+    }
+  }
+
+  return result_ok(json_element)(element);
+}
+
+result(json_value) json_path_find_value(json_value_t root,
+                                        const json_path_t * path) {
+  json_value_t value = root;
+  size_t i;
+
+  for (i = 0; i < path->count; i++) {
+    const json_path_step_t *step = &path->steps[i];
+    result(json_value) next_result;
+
+    switch (json_peek(value.ptr, value.document->end)) {
+    case '{':
+      next_result =
+          json_value_find_n(value, step->key.data, step->key.length);
+      break;
+
+    case '[':
+      if (step->index == JSON_PATH_NO_INDEX)
+        return result_err(json_value)(JSON_ERROR_INVALID_KEY);
+
+      next_result = json_value_at(value, step->index);
+      break;
+
+    default:
+      return result_err(json_value)(JSON_ERROR_INVALID_TYPE);
+    }
+
+    if (result_is_err(json_value)(&next_result))
+      return next_result;
+    value = result_unwrap(json_value)(&next_result);
+  }
+
+  return result_ok(json_value)(value);
+}
+
+result(size) json_path_find_values(json_value_t root,
+                                   const json_path_t * paths, size_t count,
+                                   json_value_t * values) {
+  size_t *active = (size_t *)malloc(json_path_scratch_size(paths, count));
+  if (active == NULL)
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+  result(size) found = json_path_scan(root, paths, count, values, active);
+  free(active);
+
+  return found;
+}
+
+size_t json_path_scratch_size(const json_path_t * paths, size_t count) {
+  size_t depth = 0;
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    if (paths[i].count > depth)
+      depth = paths[i].count;
+  }
+
+  // Never 0, so that allocating it always means something
+  return ((depth + 1) * count + 1) * sizeof(size_t);
+}
+
+result(size) json_path_scan(json_value_t root, const json_path_t * paths,
+                            size_t count, json_value_t * values,
+                            size_t * active) {
+  json_path_walk_t walk = {0};
+  size_t i;
+
+  // Every path starts at the root
+  for (i = 0; i < count; i++) {
+    values[i].document = root.document;
+    values[i].ptr = NULL;
+    active[i] = i;
+  }
+
+  if (count == 0)
+    return result_ok(size)(0);
+
+  walk.document = root.document;
+  walk.paths = paths;
+  walk.path_count = count;
+  walk.values = values;
+  walk.remaining = count;
+  walk.active = active;
+
+  json_string_t ptr = root.ptr;
+  json_path_walk_value(&walk, &ptr, 0, count);
+
+  if (walk.failed)
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+  return result_ok(size)(count - walk.remaining);
+}
+
+_bool json_path_walk_value(json_path_walk_t * walk, json_string_t * str_ptr,
+                           size_t depth, size_t count) {
+  size_t *active = walk->active + depth * walk->path_count;
+  size_t kept = 0;
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    const size_t path = active[i];
+
+    // With duplicate keys, the first match wins
+    if (walk->values[path].ptr != NULL)
+      continue;
+
+    if (walk->paths[path].count == depth) {
+      walk->values[path].ptr = *str_ptr;
+      walk->remaining--;
+    } else {
+      active[kept++] = path;
+    }
+  }
+
+  if (walk->remaining == 0)
+    return _false;
+
+  switch (kept > 0 ? json_peek(*str_ptr, walk->document->end) : '\0') {
+  case '{':
+    return json_path_walk_object(walk, str_ptr, depth, kept);
+  case '[':
+    return json_path_walk_array(walk, str_ptr, depth, kept);
+  default:
+    return json_path_walk_skip(walk, str_ptr);
+  }
+}
+
+_bool json_path_walk_object(json_path_walk_t * walk, json_string_t * str_ptr,
+                            size_t depth, size_t count) {
+  const size_t *active = walk->active + depth * walk->path_count;
+  size_t *next = walk->active + (depth + 1) * walk->path_count;
+  json_string_t end = walk->document->end;
+  json_string_t ptr = *str_ptr;
+  size_t i;
+
+  // Skip the first '{' character
+  ptr++;
+  json_skip_whitespace(&ptr, end);
+
+  while (json_peek(ptr, end) == '"') {
+    json_string_t raw = ptr + 1;
+    size_t raw_len = json_string_len(raw, end);
+    if (raw_len == 0 && json_peek(raw, end) != '"')
+      break;
+
+    size_t matched = 0;
+    for (i = 0; i < count; i++) {
+      const json_path_step_t *step = &walk->paths[active[i]].steps[depth];
+
+      if (json_key_equals(raw, raw_len, step->key.data, step->key.length))
+        next[matched++] = active[i];
+    }
+
+    // Skip beyond the key and the ':' delimiter
+    ptr = raw + raw_len + 1;
+    json_skip_whitespace(&ptr, end);
+    if (json_peek(ptr, end) != ':')
+      break;
+
+    ptr++;
+    json_skip_whitespace(&ptr, end);
+
+    if (matched > 0 ? !json_path_walk_value(walk, &ptr, depth + 1, matched)
+                    : !json_path_walk_skip(walk, &ptr))
+      return _false;
+
+    json_skip_whitespace(&ptr, end);
+    if (json_peek(ptr, end) != ',')
+      break;
+
+    // Skip the ',' to move to the next entry
+    ptr++;
+    json_skip_whitespace(&ptr, end);
+  }
+
+  if (json_peek(ptr, end) != '}') {
+    walk->failed = _true;
+    return _false;
+  }
+
+  *str_ptr = ptr + 1;
+  return _true;
+}
+
+_bool json_path_walk_array(json_path_walk_t * walk, json_string_t * str_ptr,
+                           size_t depth, size_t count) {
+  size_t *active = walk->active + depth * walk->path_count;
+  size_t *next = walk->active + (depth + 1) * walk->path_count;
+  json_string_t end = walk->document->end;
+  json_string_t ptr = *str_ptr;
+  size_t position, i = 0;
+
+  // Positions only grow, so with the paths in index order each one is
+  // looked at once however many of them go through this array
+  json_path_sort(walk->paths, active, count, depth);
+
+  // Skip the first '[' character
+  ptr++;
+  json_skip_whitespace(&ptr, end);
+
+  for (position = 0;
+       json_peek(ptr, end) != ']' && json_peek(ptr, end) != '\0';
+       position++) {
+    size_t matched = 0;
+    while (i < count && walk->paths[active[i]].steps[depth].index == position)
+      next[matched++] = active[i++];
+
+    if (matched > 0 ? !json_path_walk_value(walk, &ptr, depth + 1, matched)
+                    : !json_path_walk_skip(walk, &ptr))
+      return _false;
+
+    json_skip_whitespace(&ptr, end);
+    if (json_peek(ptr, end) != ',')
+      break;
+
+    // Skip the ',' to move to the next element
+    ptr++;
+    json_skip_whitespace(&ptr, end);
+  }
+
+  if (json_peek(ptr, end) != ']') {
+    walk->failed = _true;
+    return _false;
+  }
+
+  *str_ptr = ptr + 1;
+  return _true;
+}
+
+void json_path_sort(const json_path_t * paths, size_t *active, size_t count,
+                    size_t depth) {
+  size_t i;
+
+  // Heapsort, so any order of paths takes n log n
+  for (i = count / 2; i-- > 0;)
+    json_path_sift(paths, active, i, count, depth);
+
+  for (i = count; i-- > 1;) {
+    const size_t temp = active[0];
+    active[0] = active[i];
+    active[i] = temp;
+
+    json_path_sift(paths, active, 0, i, depth);
+  }
+}
+
+void json_path_sift(const json_path_t * paths, size_t *active, size_t root,
+                    size_t count, size_t depth) {
+  size_t child;
+
+  while ((child = 2 * root + 1) < count) {
+    if (child + 1 < count && paths[active[child + 1]].steps[depth].index >
+                                 paths[active[child]].steps[depth].index)
+      child++;
+    if (paths[active[root]].steps[depth].index >=
+        paths[active[child]].steps[depth].index)
+      return;
+
+    const size_t temp = active[root];
+    active[root] = active[child];
+    active[child] = temp;
+    root = child;
+  }
+}
+
+_bool json_path_walk_skip(json_path_walk_t * walk, json_string_t * str_ptr) {
+  result(json_element_type) type_result =
+      json_guess_element_type(*str_ptr, walk->document->end);
+  if (result_is_err(json_element_type)(&type_result)) {
+    walk->failed = _true;
+    return _false;
+  }
+
+  // Like the on-demand cursors, only the separator after a skipped
+  // value is checked
+  json_skip_element_value(str_ptr, walk->document->end,
+                          result_unwrap(json_element_type)(&type_result));
+  return _true;
+}
+
+define_result_type(json_path)
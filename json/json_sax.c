@@ -0,0 +1,640 @@
+#include "json.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Event parser. Instead of recursing, the kind of every open container
+ * is kept on the context's scratch stack, one byte per level, and the
+ * parser moves between a few states.
+ */
+
+/**
+ * @brief What the parser expects at the current position
+ */
+typedef enum json_sax_state_e {
+  JSON_SAX_VALUE = 0,
+  JSON_SAX_KEY,
+  JSON_SAX_AFTER_VALUE,
+  JSON_SAX_DONE
+} json_sax_state_t;
+
+/**
+ * @brief Buffer strings with escapes are unescaped into, reused for
+ * every string
+ */
+typedef struct json_sax_buffer_s {
+  char *data;
+  size_t capacity;
+} json_sax_buffer_t;
+
+/**
+ * @brief Invokes a callback of `handler` unless it is NULL, and
+ * evaluates to whether the parse should go on
+ */
+#define json_sax_emit(handler, event, ...)                                     \
+  ((handler)->event == NULL || (handler)->event(__VA_ARGS__))
+
+/**
+ * @brief Runs the parse over the whole context
+ */
+static result(size) json_sax_run(json_context_t *, json_sax_buffer_t *,
+                                 const json_sax_handler_t *, void *);
+
+/**
+ * @brief Emits the scalar at the string pointer and moves the pointer
+ * past it
+ */
+static result(size) json_sax_scalar(json_context_t *, json_sax_buffer_t *,
+                                    json_string_t *,
+                                    const json_sax_handler_t *, void *);
+
+/**
+ * @brief Reads the string at the string pointer, unescaping it into
+ * `buffer` only when it has escapes, and moves the pointer past it
+ */
+static result(json_string_view) json_sax_string(json_context_t *,
+                                                json_sax_buffer_t *,
+                                                json_string_t *);
+
+result(size) json_sax_parse(json_string_t json_str, size_t len,
+                            const json_sax_handler_t * handler, void *user) {
+  json_context_t ctx;
+  json_sax_buffer_t buffer = {0};
+
+  if (json_str == NULL || len == 0) {
+    return result_err(size)(JSON_ERROR_EMPTY);
+  }
+
+  json_context_init(&ctx, json_str, len, NULL);
+
+  result(size) end_result = json_sax_run(&ctx, &buffer, handler, user);
+
+  json_context_release(&ctx);
+  free(buffer.data);
+
+  return end_result;
+}
+
+result(size) json_sax_run(json_context_t * ctx, json_sax_buffer_t * buffer,
+                          const json_sax_handler_t * handler, void *user) {
+  json_sax_state_t state = JSON_SAX_VALUE;
+  json_string_t ptr = ctx->start;
+
+  json_context_skip_whitespace(ctx, &ptr);
+  if (ptr == ctx->end)
+    return result_err(size)(JSON_ERROR_EMPTY);
+
+  while (state != JSON_SAX_DONE) {
+    const char ch = json_peek(ptr, ctx->end);
+
+    switch (state) {
+    case JSON_SAX_VALUE:
+      if (ch == '{' || ch == '[') {
+        char *top = (char *)json_stack_push(ctx, 1);
+        if (top == NULL)
+          return result_err(size)(JSON_ERROR_INVALID_VALUE);
+        *top = ch;
+
+        if (ch == '{' ? !json_sax_emit(handler, start_object, user)
+                      : !json_sax_emit(handler, start_array, user))
+          return result_err(size)(JSON_ERROR_ABORTED);
+
+        ptr++;
+        json_context_skip_whitespace(ctx, &ptr);
+
+        // An empty container is closed right away
+        const char next = json_peek(ptr, ctx->end);
+        if (next == '}' || next == ']')
+          state = JSON_SAX_AFTER_VALUE;
+        else
+          state = ch == '{' ? JSON_SAX_KEY : JSON_SAX_VALUE;
+      } else {
+        result(size) scalar_result =
+            json_sax_scalar(ctx, buffer, &ptr, handler, user);
+        if (result_is_err(size)(&scalar_result))
+          return scalar_result;
+
+        state = JSON_SAX_AFTER_VALUE;
+      }
+      break;
+
+    case JSON_SAX_KEY: {
+      if (ch != '"')
+        return result_err(size)(JSON_ERROR_INVALID_KEY);
+
+      result_try(size, json_string_view, key,
+                 json_sax_string(ctx, buffer, &ptr));
+      if (!json_sax_emit(handler, key, user, key))
+        return result_err(size)(JSON_ERROR_ABORTED);
+
+      json_context_skip_whitespace(ctx, &ptr);
+      if (json_peek(ptr, ctx->end) != ':')
+        return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+      ptr++;
+      json_context_skip_whitespace(ctx, &ptr);
+      state = JSON_SAX_VALUE;
+      break;
+    }
+
+    case JSON_SAX_AFTER_VALUE: {
+      // The root value is complete
+      if (ctx->stack_size == 0) {
+        state = JSON_SAX_DONE;
+        break;
+      }
+
+      json_context_skip_whitespace(ctx, &ptr);
+
+      const char top = ctx->stack[ctx->stack_size - 1];
+      const char next = json_peek(ptr, ctx->end);
+
+      if (next == ',') {
+        ptr++;
+        json_context_skip_whitespace(ctx, &ptr);
+        state = top == '{' ? JSON_SAX_KEY : JSON_SAX_VALUE;
+      } else if (next == (top == '{' ? '}' : ']')) {
+        ptr++;
+        ctx->stack_size--;
+
+        if (top == '{' ? !json_sax_emit(handler, end_object, user)
+                       : !json_sax_emit(handler, end_array, user))
+          return result_err(size)(JSON_ERROR_ABORTED);
+      } else {
+        return result_err(size)(JSON_ERROR_INVALID_VALUE);
+      }
+      break;
+    }
+
+    case JSON_SAX_DONE:
+      break;
+    }
+  }
+
+  return result_ok(size)(ptr - ctx->start);
+}
+
+result(size) json_sax_scalar(json_context_t * ctx, json_sax_buffer_t * buffer,
+                             json_string_t * str_ptr,
+                             const json_sax_handler_t * handler, void *user) {
+  json_string_t start = *str_ptr;
+  size_t left = ctx->end - start;
+  _bool go_on;
+
+  result_try(size, json_element_type, type,
+             json_guess_element_type(start, ctx->end));
+
+  switch (type) {
+  case JSON_ELEMENT_TYPE_STRING: {
+    result_try(size, json_string_view, string,
+               json_sax_string(ctx, buffer, str_ptr));
+    go_on = json_sax_emit(handler, string, user, string);
+    break;
+  }
+
+  case JSON_ELEMENT_TYPE_NUMBER: {
+    result_try(size, json_element_value, value,
+               json_parse_number(ctx, str_ptr));
+    if (*str_ptr == start)
+      return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+    go_on = json_sax_emit(handler, number, user, value.as_number);
+    break;
+  }
+
+  case JSON_ELEMENT_TYPE_BOOLEAN:
+    if (left >= 4 && memcmp(start, "true", 4) == 0) {
+      (*str_ptr) += 4;
+      go_on = json_sax_emit(handler, boolean, user, _true);
+    } else if (left >= 5 && memcmp(start, "false", 5) == 0) {
+      (*str_ptr) += 5;
+      go_on = json_sax_emit(handler, boolean, user, _false);
+    } else {
+      return result_err(size)(JSON_ERROR_INVALID_VALUE);
+    }
+    break;
+
+  case JSON_ELEMENT_TYPE_NULL:
+    if (left < 4 || memcmp(start, "null", 4) != 0)
+      return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+    (*str_ptr) += 4;
+    go_on = json_sax_emit(handler, null, user);
+    break;
+
+  default:
+    return result_err(size)(JSON_ERROR_INVALID_TYPE);
+  }
+
+  if (!go_on)
+    return result_err(size)(JSON_ERROR_ABORTED);
+
+  return result_ok(size)(*str_ptr - ctx->start);
+}
+
+result(json_string_view) json_sax_string(json_context_t * ctx,
+                                         json_sax_buffer_t * buffer,
+                                         json_string_t * str_ptr) {
+  json_string_t raw = *str_ptr + 1;
+  size_t len = json_context_string_len(ctx, raw);
+
+  // A zero length is either "" or a missing closing quote
+  if (len == 0 && json_peek(raw, ctx->end) != '"')
+    return result_err(json_string_view)(JSON_ERROR_INVALID_VALUE);
+
+  // Skip to beyond the string
+  *str_ptr = raw + len + 1;
+
+  json_string_view_t view = {0};
+  view.data = raw;
+  view.length = len;
+
+  if (memchr(raw, '\\', len) == NULL)
+    return result_ok(json_string_view)(view);
+
+  if (buffer->capacity < len + 1) {
+    size_t capacity = buffer->capacity > 0 ? buffer->capacity : 64;
+    while (capacity < len + 1)
+      capacity *= 2;
+
+    char *data = (char *)realloc(buffer->data, capacity);
+    if (data == NULL)
+      return result_err(json_string_view)(JSON_ERROR_INVALID_VALUE);
+
+    buffer->data = data;
+    buffer->capacity = capacity;
+  }
+
+  result_try(json_string_view, size, length,
+             json_unescape_into(buffer->data, raw, len));
+
+  view.data = buffer->data;
+  view.length = length;
+
+  return result_ok(json_string_view)(view);
+}
+
+/**
+ * @brief States of {json_parser_t}
+ */
+typedef enum json_parser_state_e {
+  JSON_PARSER_VALUE = 0,
+  JSON_PARSER_OBJECT_START,
+  JSON_PARSER_ARRAY_START,
+  JSON_PARSER_KEY,
+  JSON_PARSER_COLON,
+  JSON_PARSER_AFTER_VALUE,
+  JSON_PARSER_STRING,
+  JSON_PARSER_BARE,
+  JSON_PARSER_DONE,
+  JSON_PARSER_FAILED
+} json_parser_state_t;
+
+/**
+ * @brief Whether `ch` ends a number or literal
+ */
+#define json_parser_is_delimiter(ch)                                           \
+  (is_whitespace(ch) || ch == ',' || ch == ':' || ch == '[' || ch == ']' ||    \
+   ch == '{' || ch == '}' || ch == '"')
+
+/**
+ * @brief Appends `len` bytes to a growable buffer
+ */
+static _bool json_parser_append(char **, size_t *, size_t *, json_string_t,
+                                size_t);
+
+/**
+ * @brief Parses one chunk, leaving a cut token in the token buffer
+ */
+static result(size) json_parser_run(json_parser_t *, json_string_t, size_t);
+
+/**
+ * @brief Emits the token that ends at `end`. It starts at `start`, or
+ * in the token buffer if earlier chunks held its beginning
+ */
+static result(size) json_parser_token(json_parser_t *, json_string_t,
+                                      json_string_t);
+
+/**
+ * @brief Closes the innermost container
+ */
+static _bool json_parser_close(json_parser_t *);
+
+void json_parser_init(json_parser_t * parser,
+                      const json_sax_handler_t * handler, void *user) {
+  memset(parser, 0, sizeof(json_parser_t));
+  parser->handler = handler;
+  parser->user = user;
+  parser->state = JSON_PARSER_VALUE;
+}
+
+void json_parser_free(json_parser_t * parser) {
+  free(parser->stack);
+  free(parser->token);
+  free(parser->strings);
+
+  parser->stack = NULL;
+  parser->depth = 0;
+  parser->stack_capacity = 0;
+  parser->token = NULL;
+  parser->token_size = 0;
+  parser->token_capacity = 0;
+  parser->strings = NULL;
+  parser->strings_capacity = 0;
+}
+
+result(size) json_parser_feed(json_parser_t * parser, json_string_t chunk,
+                              size_t len) {
+  if (parser->state == JSON_PARSER_FAILED)
+    return result_err(size)(parser->error);
+  if (len == 0)
+    return result_ok(size)(0);
+
+  result(size) fed_result = json_parser_run(parser, chunk, len);
+  if (result_is_err(size)(&fed_result)) {
+    parser->state = JSON_PARSER_FAILED;
+    parser->error = result_unwrap_err(size)(&fed_result);
+    return fed_result;
+  }
+
+  parser->offset += len;
+  return fed_result;
+}
+
+result(size) json_parser_finish(json_parser_t * parser) {
+  if (parser->state == JSON_PARSER_FAILED)
+    return result_err(size)(parser->error);
+
+  // The end of the input is what ends a trailing number or literal
+  if (parser->state == JSON_PARSER_BARE) {
+    result(size) token_result = json_parser_token(parser, NULL, NULL);
+    if (result_is_err(size)(&token_result)) {
+      parser->state = JSON_PARSER_FAILED;
+      parser->error = result_unwrap_err(size)(&token_result);
+      return token_result;
+    }
+  }
+
+  if (parser->state == JSON_PARSER_DONE)
+    return result_ok(size)(parser->offset);
+
+  parser->error = parser->state == JSON_PARSER_VALUE && parser->depth == 0
+                      ? JSON_ERROR_EMPTY
+                      : JSON_ERROR_INVALID_VALUE;
+  parser->state = JSON_PARSER_FAILED;
+
+  return result_err(size)(parser->error);
+}
+
+_bool json_parser_append(char **data, size_t *size, size_t *capacity,
+                         json_string_t bytes, size_t len) {
+  if (*capacity - *size < len) {
+    size_t new_capacity = *capacity > 0 ? *capacity * 2 : 64;
+    while (new_capacity - *size < len)
+      new_capacity *= 2;
+
+    char *new_data = (char *)realloc(*data, new_capacity);
+    if (new_data == NULL)
+      return _false;
+
+    *data = new_data;
+    *capacity = new_capacity;
+  }
+
+  memcpy(*data + *size, bytes, len);
+  *size += len;
+
+  return _true;
+}
+
+result(size) json_parser_run(json_parser_t * parser, json_string_t chunk,
+                             size_t len) {
+  const json_sax_handler_t *handler = parser->handler;
+  json_string_t ptr = chunk;
+  json_string_t end = chunk + len;
+
+  // A token cut by the previous chunk goes on from the first byte
+  json_string_t token_start = chunk;
+
+  while (ptr < end) {
+    switch (parser->state) {
+    case JSON_PARSER_STRING: {
+      // The backslash of an escape may have been the last byte of the
+      // previous chunk
+      if (parser->escaped) {
+        parser->escaped = _false;
+        ptr++;
+      }
+
+      json_string_t body = ptr;
+      ptr += json_string_len(body, end);
+
+      if (ptr < end && *ptr == '"') {
+        ptr++;
+        result(size) token_result = json_parser_token(parser, token_start, ptr);
+        if (result_is_err(size)(&token_result))
+          return token_result;
+      } else {
+        // An odd run of backslashes at the end leaves an escape open
+        json_string_t iter = end;
+        while (iter > body && iter[-1] == '\\')
+          iter--;
+
+        parser->escaped = (end - iter) % 2 == 1;
+        ptr = end;
+      }
+      break;
+    }
+
+    case JSON_PARSER_BARE:
+      while (ptr < end && !json_parser_is_delimiter(*ptr))
+        ptr++;
+
+      if (ptr < end) {
+        result(size) token_result = json_parser_token(parser, token_start, ptr);
+        if (result_is_err(size)(&token_result))
+          return token_result;
+      }
+      break;
+
+    default: {
+      json_skip_whitespace(&ptr, end);
+      if (ptr == end)
+        break;
+
+      const char ch = *ptr;
+
+      switch (parser->state) {
+      case JSON_PARSER_OBJECT_START:
+        if (ch == '}') {
+          ptr++;
+          if (!json_parser_close(parser))
+            return result_err(size)(JSON_ERROR_ABORTED);
+          break;
+        }
+        // Otherwise the first key
+        /* fallthrough */
+      case JSON_PARSER_KEY:
+        if (ch != '"')
+          return result_err(size)(JSON_ERROR_INVALID_KEY);
+
+        token_start = ptr++;
+        parser->token_is_key = _true;
+        parser->escaped = _false;
+        parser->state = JSON_PARSER_STRING;
+        break;
+
+      case JSON_PARSER_COLON:
+        if (ch != ':')
+          return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+        ptr++;
+        parser->state = JSON_PARSER_VALUE;
+        break;
+
+      case JSON_PARSER_ARRAY_START:
+        if (ch == ']') {
+          ptr++;
+          if (!json_parser_close(parser))
+            return result_err(size)(JSON_ERROR_ABORTED);
+          break;
+        }
+        // Otherwise the first element
+        /* fallthrough */
+      case JSON_PARSER_VALUE:
+        if (ch == '{' || ch == '[') {
+          if (!json_parser_append(&parser->stack, &parser->depth,
+                                  &parser->stack_capacity, &ch, 1))
+            return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+          if (ch == '{' ? !json_sax_emit(handler, start_object, parser->user)
+                        : !json_sax_emit(handler, start_array, parser->user))
+            return result_err(size)(JSON_ERROR_ABORTED);
+
+          ptr++;
+          parser->state =
+              ch == '{' ? JSON_PARSER_OBJECT_START : JSON_PARSER_ARRAY_START;
+        } else if (ch == '"') {
+          token_start = ptr++;
+          parser->token_is_key = _false;
+          parser->escaped = _false;
+          parser->state = JSON_PARSER_STRING;
+        } else if (json_parser_is_delimiter(ch)) {
+          return result_err(size)(JSON_ERROR_INVALID_TYPE);
+        } else {
+          token_start = ptr;
+          parser->token_is_key = _false;
+          parser->state = JSON_PARSER_BARE;
+        }
+        break;
+
+      case JSON_PARSER_AFTER_VALUE: {
+        const char top = parser->stack[parser->depth - 1];
+
+        if (ch == ',') {
+          ptr++;
+          parser->state = top == '{' ? JSON_PARSER_KEY : JSON_PARSER_VALUE;
+        } else if (ch == (top == '{' ? '}' : ']')) {
+          ptr++;
+          if (!json_parser_close(parser))
+            return result_err(size)(JSON_ERROR_ABORTED);
+        } else {
+          return result_err(size)(JSON_ERROR_INVALID_VALUE);
+        }
+        break;
+      }
+
+      default:
+        // Only whitespace may follow the root value
+        return result_err(size)(JSON_ERROR_INVALID_VALUE);
+      }
+      break;
+    }
+    }
+  }
+
+  // Keep the start of a token the chunk boundary cut
+  if (parser->state == JSON_PARSER_STRING ||
+      parser->state == JSON_PARSER_BARE) {
+    if (!json_parser_append(&parser->token, &parser->token_size,
+                            &parser->token_capacity, token_start,
+                            end - token_start))
+      return result_err(size)(JSON_ERROR_INVALID_VALUE);
+  }
+
+  return result_ok(size)(len);
+}
+
+result(size) json_parser_token(json_parser_t * parser, json_string_t start,
+                               json_string_t end) {
+  json_string_t data = start;
+  size_t size = end - start;
+
+  if (parser->token_size > 0) {
+    if (size > 0 && !json_parser_append(&parser->token, &parser->token_size,
+                            &parser->token_capacity, start, size))
+      return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+    data = parser->token;
+    size = parser->token_size;
+    parser->token_size = 0;
+  }
+
+  json_context_t ctx;
+  json_sax_buffer_t buffer = {0};
+  json_string_t ptr = data;
+  _bool go_on = _true;
+
+  json_context_init(&ctx, data, size, NULL);
+  buffer.data = parser->strings;
+  buffer.capacity = parser->strings_capacity;
+
+  if (parser->token_is_key) {
+    result(json_string_view) key_result =
+        json_sax_string(&ctx, &buffer, &ptr);
+
+    if (result_is_ok(json_string_view)(&key_result)) {
+      json_string_view_t key = result_unwrap(json_string_view)(&key_result);
+      go_on = json_sax_emit(parser->handler, key, parser->user, key);
+    }
+
+    parser->strings = buffer.data;
+    parser->strings_capacity = buffer.capacity;
+    if (result_is_err(json_string_view)(&key_result))
+      return result_map_err(size, json_string_view, &key_result);
+
+    parser->state = JSON_PARSER_COLON;
+  } else {
+    result(size) scalar_result =
+        json_sax_scalar(&ctx, &buffer, &ptr, parser->handler, parser->user);
+
+    parser->strings = buffer.data;
+    parser->strings_capacity = buffer.capacity;
+    if (result_is_err(size)(&scalar_result))
+      return scalar_result;
+
+    parser->state =
+        parser->depth == 0 ? JSON_PARSER_DONE : JSON_PARSER_AFTER_VALUE;
+  }
+
+  if (!go_on)
+    return result_err(size)(JSON_ERROR_ABORTED);
+
+  // Like "12ab" or "nul", only part of the token was a value
+  if (ptr != data + size)
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+  return result_ok(size)(size);
+}
+
+_bool json_parser_close(json_parser_t * parser) {
+  const char top = parser->stack[--parser->depth];
+
+  parser->state =
+      parser->depth == 0 ? JSON_PARSER_DONE : JSON_PARSER_AFTER_VALUE;
+
+  return top == '{' ? json_sax_emit(parser->handler, end_object, parser->user)
+                    : json_sax_emit(parser->handler, end_array, parser->user);
+}
@@ -0,0 +1,486 @@
+#include "json.h"
+#include "json_internal.h"
+#include "json_simd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * JSON text output. Everything is appended to the buffer of a writer,
+ * which either grows or is flushed to a callback when full, so output
+ * costs a bounds check per token instead of a stdio call. Strings are
+ * copied in runs between the bytes that need escaping, found a vector
+ * at a time, and numbers are formatted by {json_number_format}.
+ */
+
+/**
+ * @brief Size of the buffer of a writer with a flush callback
+ */
+#define JSON_WRITER_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Strings up to this long are escaped straight into the buffer
+ */
+#define JSON_SERIALIZE_SHORT_STRING 1024
+
+/**
+ * @brief Spaces written at a time when indenting
+ */
+#define JSON_SERIALIZE_SPACES 32
+
+/**
+ * @brief The escape of every byte: 0 when it is written as it is, 'u'
+ * for a \u00XX escape and the letter after the backslash otherwise
+ */
+static const char json_serialize_escape[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    'u', 'u', 'u', 'u', ['"'] = '"', ['\\'] = '\\',
+};
+
+static const char json_serialize_spaces[JSON_SERIALIZE_SPACES + 1] =
+    "                                ";
+
+/**
+ * @brief Appends a single character
+ */
+static _bool json_serialize_put(json_serializer_t *, char);
+
+/**
+ * @brief Starts a new line indented for `level`
+ */
+static _bool json_serialize_newline(json_serializer_t *, int);
+
+/**
+ * @brief Length of the run at the start of a string that is written
+ * without escapes
+ */
+static size_t json_serialize_plain_len(json_string_t, size_t);
+
+/**
+ * @brief Writes a JSON element {json_element_t} at nesting `level`
+ */
+static _bool json_serialize_element(json_serializer_t *,
+                                    const json_element_t *, int);
+
+/**
+ * @brief Writes a `String` {json_string_view_t} with its quotes
+ */
+static _bool json_serialize_string(json_serializer_t *, json_string_view_t);
+
+/**
+ * @brief Writes the escape of `ch` to `output`, which must have room
+ * for 6 bytes
+ *
+ * @return The length of the escape
+ */
+static size_t json_serialize_escape_into(char *, char);
+
+/**
+ * @brief Writes a `Number` {json_number_t} type
+ */
+static _bool json_serialize_number(json_serializer_t *, json_number_t);
+
+/**
+ * @brief Writes an `Object` {json_object_t} type
+ */
+static _bool json_serialize_object(json_serializer_t *, const json_object_t *,
+                                   int);
+
+/**
+ * @brief Writes an `Array` {json_array_t} type
+ */
+static _bool json_serialize_array(json_serializer_t *, const json_array_t *,
+                                  int);
+
+/**
+ * @brief Flush callback of {json_print}
+ */
+static json_boolean_t json_print_flush(void *, json_string_t, size_t);
+
+void json_writer_init(json_writer_t * writer, json_writer_flush_t flush,
+                      void *user) {
+  memset(writer, 0, sizeof(json_writer_t));
+  writer->flush = flush;
+  writer->user = user;
+}
+
+void json_writer_free(json_writer_t * writer) {
+  free(writer->data);
+  writer->data = NULL;
+  writer->size = 0;
+  writer->capacity = 0;
+}
+
+result(size) json_serialize(const json_element_t * element,
+                            json_writer_t * writer, int indent) {
+  json_serializer_t ctx;
+  const size_t start = writer->size;
+
+  ctx.writer = writer;
+  ctx.indent = indent > 0 ? indent : 0;
+  ctx.flushed = 0;
+  ctx.error = JSON_ERROR_INVALID_VALUE;
+
+  if (!json_serialize_element(&ctx, element, 0))
+    return result_err(size)(ctx.error);
+
+  return json_serialize_finish(&ctx, start);
+}
+
+result(size) json_serialize_finish(json_serializer_t * ctx, size_t start) {
+  json_writer_t *writer = ctx->writer;
+
+  if (writer->flush != NULL && writer->size > 0) {
+    if (!writer->flush(writer->user, writer->data, writer->size))
+      return result_err(size)(JSON_ERROR_ABORTED);
+
+    ctx->flushed += writer->size;
+    writer->size = 0;
+  }
+
+  return result_ok(size)(ctx->flushed + writer->size - start);
+}
+
+void json_print(json_element_t * element, int indent) {
+  json_writer_t writer;
+
+  json_writer_init(&writer, json_print_flush, stdout);
+  json_serialize(element, &writer, indent);
+  json_writer_free(&writer);
+}
+
+_bool json_serialize_make_room(json_serializer_t * ctx, size_t size) {
+  json_writer_t *writer = ctx->writer;
+  size_t capacity = writer->capacity;
+
+  if (writer->flush != NULL) {
+    if (writer->size > 0) {
+      if (!writer->flush(writer->user, writer->data, writer->size)) {
+        ctx->error = JSON_ERROR_ABORTED;
+        return _false;
+      }
+      ctx->flushed += writer->size;
+      writer->size = 0;
+    }
+
+    if (capacity < JSON_WRITER_BUFFER_SIZE)
+      capacity = JSON_WRITER_BUFFER_SIZE;
+  }
+
+  if (capacity - writer->size < size) {
+    capacity = capacity > 0 ? capacity * 2 : 256;
+    if (capacity - writer->size < size)
+      capacity = writer->size + size;
+  }
+
+  if (capacity != writer->capacity) {
+    char *data = (char *)realloc(writer->data, capacity);
+    if (data == NULL) {
+      ctx->error = JSON_ERROR_INVALID_VALUE;
+      return _false;
+    }
+
+    writer->data = data;
+    writer->capacity = capacity;
+  }
+
+  return _true;
+}
+
+_bool json_serialize_write(json_serializer_t * ctx, json_string_t data,
+                           size_t len) {
+  json_writer_t *writer = ctx->writer;
+
+  // Without a callback the buffer grows to fit it all at once
+  if (writer->flush == NULL && !json_serialize_reserve(ctx, len))
+    return _false;
+
+  for (;;) {
+    size_t room = writer->capacity - writer->size;
+    if (room > len)
+      room = len;
+
+    if (room > 0) {
+      memcpy(writer->data + writer->size, data, room);
+      writer->size += room;
+      data += room;
+      len -= room;
+    }
+
+    if (len == 0)
+      return _true;
+
+    if (!json_serialize_make_room(ctx, 1))
+      return _false;
+  }
+}
+
+_bool json_serialize_put(json_serializer_t * ctx, char ch) {
+  if (!json_serialize_reserve(ctx, 1))
+    return _false;
+
+  ctx->writer->data[ctx->writer->size++] = ch;
+  return _true;
+}
+
+_bool json_serialize_newline(json_serializer_t * ctx, int level) {
+  size_t spaces = (size_t)ctx->indent * level;
+
+  // Usual depths fit in one go
+  if (spaces <= JSON_SERIALIZE_SPACES) {
+    if (!json_serialize_reserve(ctx, spaces + 1))
+      return _false;
+
+    char *output = ctx->writer->data + ctx->writer->size;
+    output[0] = '\n';
+    memcpy(output + 1, json_serialize_spaces, spaces);
+    ctx->writer->size += spaces + 1;
+    return _true;
+  }
+
+  if (!json_serialize_put(ctx, '\n'))
+    return _false;
+
+  while (spaces > 0) {
+    size_t count =
+        spaces < JSON_SERIALIZE_SPACES ? spaces : JSON_SERIALIZE_SPACES;
+
+    if (!json_serialize_write(ctx, json_serialize_spaces, count))
+      return _false;
+    spaces -= count;
+  }
+
+  return _true;
+}
+
+size_t json_serialize_plain_len(json_string_t str, size_t len) {
+  json_string_t ptr = str;
+  json_string_t end = str + len;
+
+#if defined(JSON_SIMD_AVX2)
+  while (end - ptr >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+    // Control characters are the bytes up to 0x1F, unsigned
+    __m256i special = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))),
+        _mm256_cmpeq_epi8(_mm256_max_epu8(v, _mm256_set1_epi8(0x1F)),
+                          _mm256_set1_epi8(0x1F)));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(special);
+
+    if (mask != 0)
+      return ptr + json_simd_ctz(mask) - str;
+    ptr += 32;
+  }
+#elif defined(JSON_SIMD_SSE2)
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+    __m128i special =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                  _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+                     _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(0x1F)),
+                                    _mm_set1_epi8(0x1F)));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+
+    if (mask != 0)
+      return ptr + json_simd_ctz(mask) - str;
+    ptr += 16;
+  }
+#elif defined(JSON_SIMD_NEON)
+  while (end - ptr >= 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)ptr);
+    uint8x16_t special =
+        vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')),
+                          vceqq_u8(v, vdupq_n_u8('\\'))),
+                 vcltq_u8(v, vdupq_n_u8(0x20)));
+    uint64_t mask = json_simd_movemask(special);
+
+    if (mask != 0)
+      return ptr + json_simd_ctz(mask) - str;
+    ptr += 16;
+  }
+#endif
+
+  while (ptr < end && !json_serialize_escape[(unsigned char)*ptr])
+    ptr++;
+
+  return ptr - str;
+}
+
+_bool json_serialize_element(json_serializer_t * ctx,
+                             const json_element_t * element, int level) {
+  switch (element->type) {
+  case JSON_ELEMENT_TYPE_STRING:
+    return json_serialize_string(ctx, element->value.as_string);
+
+  case JSON_ELEMENT_TYPE_NUMBER:
+    return json_serialize_number(ctx, element->value.as_number);
+
+  case JSON_ELEMENT_TYPE_OBJECT:
+    return json_serialize_object(ctx, element->value.as_object, level);
+
+  case JSON_ELEMENT_TYPE_ARRAY:
+    return json_serialize_array(ctx, element->value.as_array, level);
+
+  case JSON_ELEMENT_TYPE_BOOLEAN:
+    return element->value.as_boolean ? json_serialize_write(ctx, "true", 4)
+                                     : json_serialize_write(ctx, "false", 5);
+
+  case JSON_ELEMENT_TYPE_NULL:
+    return json_serialize_write(ctx, "null", 4);
+  }
+
+  return _true;
+}
+
+_bool json_serialize_string(json_serializer_t * ctx,
+                            json_string_view_t string) {
+  json_string_t ptr = string.data;
+  json_string_t end = string.data + string.length;
+  char *output;
+
+  // Short strings get room for the worst case, every byte escaped as
+  // \u00XX, and are written without further checks
+  if (string.length <= JSON_SERIALIZE_SHORT_STRING) {
+    if (!json_serialize_reserve(ctx, 6 * string.length + 2))
+      return _false;
+
+    output = ctx->writer->data + ctx->writer->size;
+    *output++ = '"';
+
+    while (ptr < end) {
+      const size_t plain = json_serialize_plain_len(ptr, end - ptr);
+
+      memcpy(output, ptr, plain);
+      output += plain;
+      ptr += plain;
+
+      if (ptr < end)
+        output += json_serialize_escape_into(output, *ptr++);
+    }
+
+    *output++ = '"';
+    ctx->writer->size = output - ctx->writer->data;
+    return _true;
+  }
+
+  if (!json_serialize_put(ctx, '"'))
+    return _false;
+
+  while (ptr < end) {
+    const size_t plain = json_serialize_plain_len(ptr, end - ptr);
+
+    if (plain > 0 && !json_serialize_write(ctx, ptr, plain))
+      return _false;
+    ptr += plain;
+
+    if (ptr == end)
+      break;
+
+    if (!json_serialize_reserve(ctx, 6))
+      return _false;
+
+    output = ctx->writer->data + ctx->writer->size;
+    ctx->writer->size += json_serialize_escape_into(output, *ptr++);
+  }
+
+  return json_serialize_put(ctx, '"');
+}
+
+size_t json_serialize_escape_into(char *output, char ch) {
+  static const char hex[] = "0123456789abcdef";
+  const char escape = json_serialize_escape[(unsigned char)ch];
+
+  output[0] = '\\';
+  output[1] = escape;
+  if (escape != 'u')
+    return 2;
+
+  output[2] = '0';
+  output[3] = '0';
+  output[4] = hex[(unsigned char)ch >> 4];
+  output[5] = hex[ch & 0xF];
+  return 6;
+}
+
+_bool json_serialize_number(json_serializer_t * ctx, json_number_t number) {
+  if (!json_serialize_reserve(ctx, JSON_NUMBER_FORMAT_LEN))
+    return _false;
+
+  const size_t len =
+      json_number_format(number, ctx->writer->data + ctx->writer->size);
+  if (len == 0) {
+    ctx->error = JSON_ERROR_INVALID_VALUE;
+    return _false;
+  }
+
+  ctx->writer->size += len;
+  return _true;
+}
+
+_bool json_serialize_object(json_serializer_t * ctx,
+                            const json_object_t * object, int level) {
+  size_t i;
+
+  if (!json_serialize_put(ctx, '{'))
+    return _false;
+
+  for (i = 0; i < object->count; i++) {
+    json_string_view_t key;
+    const json_element_t *value;
+
+    if (object->shape != NULL) {
+      key = object->shape->keys[i];
+      value = &object->values[i];
+    } else {
+      key = object->entries[i].key;
+      value = &object->entries[i].element;
+    }
+
+    if (i > 0 && !json_serialize_put(ctx, ','))
+      return _false;
+    if (ctx->indent > 0 && !json_serialize_newline(ctx, level + 1))
+      return _false;
+
+    if (!json_serialize_string(ctx, key) || !json_serialize_put(ctx, ':') ||
+        (ctx->indent > 0 && !json_serialize_put(ctx, ' ')) ||
+        !json_serialize_element(ctx, value, level + 1))
+      return _false;
+  }
+
+  if (ctx->indent > 0 && object->count > 0 &&
+      !json_serialize_newline(ctx, level))
+    return _false;
+
+  return json_serialize_put(ctx, '}');
+}
+
+_bool json_serialize_array(json_serializer_t * ctx, const json_array_t * array,
+                           int level) {
+  size_t i;
+
+  if (!json_serialize_put(ctx, '['))
+    return _false;
+
+  for (i = 0; i < array->count; i++) {
+    if (i > 0 && !json_serialize_put(ctx, ','))
+      return _false;
+    if (ctx->indent > 0 && !json_serialize_newline(ctx, level + 1))
+      return _false;
+
+    if (!json_serialize_element(ctx, &array->elements[i], level + 1))
+      return _false;
+  }
+
+  if (ctx->indent > 0 && array->count > 0 &&
+      !json_serialize_newline(ctx, level))
+    return _false;
+
+  return json_serialize_put(ctx, ']');
+}
+
+json_boolean_t json_print_flush(void *user, json_string_t data, size_t len) {
+  return fwrite(data, 1, len, (FILE *)user) == len;
+}
@@ -0,0 +1,223 @@
+#include "json.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Shapes, or hidden classes, of objects. Keys come from the table's key
+ * pool, so a shape is told apart by the pointers of its keys alone and
+ * two objects share one exactly when they have the same keys in the
+ * same order. Objects given a shape keep a flat array of values and no
+ * index, the shape carries the one index all of them use.
+ */
+
+/**
+ * @brief Slots of a table's first shape table
+ */
+#define JSON_SHAPE_TABLE_MIN_CAPACITY 64
+
+/**
+ * @brief Hashes the key pointers of `count` entries
+ */
+static uint64_t json_shape_hash(const json_entry_t *, size_t);
+
+/**
+ * @brief Whether the keys of `shape` are the keys of `count` entries
+ */
+static _bool json_shape_matches(const json_shape_t *, const json_entry_t *,
+                                size_t);
+
+/**
+ * @brief Creates the shape of `count` entries in the table's arena and
+ * indexes its keys
+ */
+static json_shape_t *json_shape_create(json_shape_table_t *,
+                                       const json_entry_t *, size_t,
+                                       uint64_t);
+
+/**
+ * @brief Doubles the table, or creates the first one, and moves every
+ * shape to its new slot
+ */
+static _bool json_shape_table_grow(json_shape_table_t *);
+
+void json_shape_table_init(json_shape_table_t * table) {
+  json_key_pool_init(&table->keys);
+  json_arena_init(&table->arena, 0);
+  table->slots = NULL;
+  table->count = 0;
+  table->capacity = 0;
+}
+
+void json_shape_table_free(json_shape_table_t * table) {
+  json_key_pool_free(&table->keys);
+  json_arena_free(&table->arena);
+  free(table->slots);
+
+  table->slots = NULL;
+  table->count = 0;
+  table->capacity = 0;
+}
+
+result(size) json_shape_find(const json_shape_t * shape, json_string_t key,
+                             size_t len) {
+  if (key == NULL || len == 0)
+    return result_err(size)(JSON_ERROR_INVALID_KEY);
+
+  return json_shape_find_hashed(shape, key, len, json_key_hash(key, len));
+}
+
+result(size) json_shape_find_hashed(const json_shape_t * shape,
+                                    json_string_t key, size_t len,
+                                    uint64_t hash) {
+  const size_t mask = shape->capacity - 1;
+  size_t slot = hash & mask;
+
+  // The index always has a free slot, which ends the probe
+  while (shape->slots[slot].key != NULL) {
+    const json_shape_slot_t *candidate = &shape->slots[slot];
+
+    if (candidate->hash == hash && candidate->key->length == len &&
+        (candidate->key->data == key ||
+         memcmp(key, candidate->key->data, len) == 0))
+      return result_ok(size)((size_t)(candidate->key - shape->keys));
+
+    slot = (slot + 1) & mask;
+  }
+
+  return result_err(size)(JSON_ERROR_INVALID_KEY);
+}
+
+json_shape_t *json_shape_intern(json_shape_table_t * table,
+                                const json_entry_t * entries, size_t count) {
+  // Keep at least a quarter of the slots free so probes stay short
+  if (4 * (table->count + 1) > 3 * table->capacity &&
+      !json_shape_table_grow(table))
+    return NULL;
+
+  const uint64_t hash = json_shape_hash(entries, count);
+  const size_t mask = table->capacity - 1;
+  size_t slot = hash & mask;
+
+  while (table->slots[slot] != NULL) {
+    json_shape_t *shape = table->slots[slot];
+
+    if (shape->hash == hash && json_shape_matches(shape, entries, count))
+      return shape;
+
+    slot = (slot + 1) & mask;
+  }
+
+  json_shape_t *shape = json_shape_create(table, entries, count, hash);
+  if (shape == NULL)
+    return NULL;
+
+  table->slots[slot] = shape;
+  table->count++;
+
+  return shape;
+}
+
+uint64_t json_shape_hash(const json_entry_t * entries, size_t count) {
+  uint64_t hash = 0x9E3779B97F4A7C15ULL ^ count;
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    hash = (hash ^ (uint64_t)(uintptr_t)entries[i].key.data) *
+           0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 32;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+
+  return hash;
+}
+
+_bool json_shape_matches(const json_shape_t * shape,
+                         const json_entry_t * entries, size_t count) {
+  size_t i;
+
+  if (shape->count != count)
+    return _false;
+
+  // Pooled keys are equal exactly when their pointers are
+  for (i = 0; i < count; i++) {
+    if (shape->keys[i].data != entries[i].key.data)
+      return _false;
+  }
+
+  return _true;
+}
+
+json_shape_t *json_shape_create(json_shape_table_t * table,
+                                const json_entry_t * entries, size_t count,
+                                uint64_t hash) {
+  size_t capacity = 4;
+  while (3 * capacity < 4 * count)
+    capacity *= 2;
+
+  json_shape_t *shape =
+      (json_shape_t *)json_arena_alloc(&table->arena, sizeof(json_shape_t));
+  json_string_view_t *keys = (json_string_view_t *)json_arena_alloc(
+      &table->arena, count * sizeof(json_string_view_t));
+  json_shape_slot_t *slots = (json_shape_slot_t *)json_arena_alloc(
+      &table->arena, capacity * sizeof(json_shape_slot_t));
+  if (shape == NULL || keys == NULL || slots == NULL)
+    return NULL;
+
+  memset(slots, 0, capacity * sizeof(json_shape_slot_t));
+
+  size_t i;
+  for (i = 0; i < count; i++) {
+    const uint64_t key_hash =
+        json_key_hash(entries[i].key.data, entries[i].key.length);
+    size_t slot = key_hash & (capacity - 1);
+
+    keys[i] = entries[i].key;
+
+    while (slots[slot].key != NULL)
+      slot = (slot + 1) & (capacity - 1);
+
+    slots[slot].hash = key_hash;
+    slots[slot].key = &keys[i];
+  }
+
+  shape->count = count;
+  shape->keys = keys;
+  shape->slots = slots;
+  shape->capacity = capacity;
+  shape->hash = hash;
+
+  return shape;
+}
+
+_bool json_shape_table_grow(json_shape_table_t * table) {
+  const size_t capacity = table->capacity > 0 ? 2 * table->capacity
+                                              : JSON_SHAPE_TABLE_MIN_CAPACITY;
+  json_shape_t **slots = (json_shape_t **)calloc(capacity, sizeof(void *));
+  if (slots == NULL)
+    return _false;
+
+  // The stored hashes are reused, the shapes themselves are not touched
+  size_t i;
+  for (i = 0; i < table->capacity; i++) {
+    json_shape_t *shape = table->slots[i];
+    if (shape == NULL)
+      continue;
+
+    size_t index = shape->hash & (capacity - 1);
+    while (slots[index] != NULL)
+      index = (index + 1) & (capacity - 1);
+
+    slots[index] = shape;
+  }
+
+  free(table->slots);
+  table->slots = slots;
+  table->capacity = capacity;
+
+  return _true;
+}
@@ -0,0 +1,67 @@
+#ifndef JSON_SIMD
+#define JSON_SIMD
+
+#include "json.h"
+
+/*
+ * Vector instruction set shared by the scanning kernels of the library,
+ * picked at compile time. Define `JSON_NO_SIMD` to force the portable
+ * code paths.
+ */
+
+#if !defined(JSON_NO_SIMD) && defined(__AVX2__)
+#define JSON_SIMD_AVX2
+#include <immintrin.h>
+#elif !defined(JSON_NO_SIMD) && defined(__SSE2__)
+#define JSON_SIMD_SSE2
+#include <emmintrin.h>
+#elif !defined(JSON_NO_SIMD) && defined(__ARM_NEON)
+#define JSON_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(JSON_SIMD_AVX2)
+#define JSON_SIMD_KERNEL "avx2"
+#elif defined(JSON_SIMD_SSE2)
+#define JSON_SIMD_KERNEL "sse2"
+#elif defined(JSON_SIMD_NEON)
+#define JSON_SIMD_KERNEL "neon"
+#else
+#define JSON_SIMD_KERNEL "scalar"
+#endif
+
+/**
+ * @brief Index of the lowest set bit of a non-zero mask
+ */
+static inline int json_simd_ctz(uint64_t bits) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(bits);
+#else
+  int i = 0;
+  while ((bits & 1) == 0) {
+    bits >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+#if defined(JSON_SIMD_NEON)
+/**
+ * @brief Packs the 0x00/0xFF lanes of a comparison into 16 bits, like
+ * `_mm_movemask_epi8`
+ */
+static inline uint64_t json_simd_movemask(uint8x16_t cmp) {
+  static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                      1, 2, 4, 8, 16, 32, 64, 128};
+  uint8x16_t bits = vandq_u8(cmp, vld1q_u8(weights));
+  uint8x8_t sum = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+  sum = vpadd_u8(sum, sum);
+  sum = vpadd_u8(sum, sum);
+
+  return (uint64_t)vget_lane_u8(sum, 0) |
+         (uint64_t)vget_lane_u8(sum, 1) << 8;
+}
+#endif
+
+#endif
@@ -0,0 +1,524 @@
+#include "json.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Tape representation of a document. Every word carries a tag in its
+ * top byte and a 56-bit payload:
+ *
+ *   '{' '['  count of children << 32 | index past the closing word
+ *   '}' ']'  index of the opening word
+ *   '"'      offset into the string buffer, the next word is the length
+ *   'l' 'd'  the next word holds the bits of the long or double
+ *   't' 'f' 'n'
+ *
+ * Object children are key strings each followed by their value.
+ */
+
+/**
+ * @brief Bits the tag of a word is shifted by
+ */
+#define JSON_TAPE_TAG_SHIFT 56
+
+/**
+ * @brief Children counts saturate here, larger containers are counted
+ * by walking them
+ */
+#define JSON_TAPE_COUNT_MAX 0xFFFFFF
+
+/**
+ * @brief Containers store word indices in 32 bits
+ */
+#define JSON_TAPE_INDEX_MAX 0xFFFFFFFFUL
+
+/**
+ * @brief Initial number of words of a tape
+ */
+#define JSON_TAPE_SIZE 1024
+
+#define json_tape_tag(word) ((char)((word) >> JSON_TAPE_TAG_SHIFT))
+
+#define json_tape_payload(word)                                                \
+  ((word) & (((uint64_t)1 << JSON_TAPE_TAG_SHIFT) - 1))
+
+#define json_tape_word(tag, payload)                                           \
+  ((uint64_t)(unsigned char)(tag) << JSON_TAPE_TAG_SHIFT | (uint64_t)(payload))
+
+/**
+ * @brief Makes room for `count` more words
+ */
+static _bool json_tape_reserve(json_tape_t *, size_t);
+
+/**
+ * @brief Index of the word following the value at `index`
+ */
+static size_t json_tape_skip(const json_tape_t *, size_t);
+
+/**
+ * @brief Appends the value at the string pointer and moves the pointer
+ * past it
+ *
+ * @return The index of the first word of the value
+ */
+static result(size) json_tape_parse_value(json_tape_t *, json_context_t *,
+                                          json_string_t *);
+
+/**
+ * @brief Appends a string, unescaped into the string buffer
+ */
+static result(size) json_tape_parse_string(json_tape_t *, json_context_t *,
+                                           json_string_t *);
+
+/**
+ * @brief Appends a number with {json_parse_number}
+ */
+static result(size) json_tape_parse_number(json_tape_t *, json_context_t *,
+                                           json_string_t *);
+
+/**
+ * @brief Appends an object, its children and its closing word
+ */
+static result(size) json_tape_parse_object(json_tape_t *, json_context_t *,
+                                           json_string_t *);
+
+/**
+ * @brief Appends an array, its elements and its closing word
+ */
+static result(size) json_tape_parse_array(json_tape_t *, json_context_t *,
+                                          json_string_t *);
+
+/**
+ * @brief Appends `true`, `false` or `null`
+ */
+static result(size) json_tape_parse_literal(json_tape_t *, json_context_t *,
+                                            json_string_t *);
+
+result(json_tape_ref) json_tape_parse(json_tape_t * tape,
+                                      json_string_t json_str, size_t len) {
+  json_context_t ctx;
+
+  if (json_str == NULL || len == 0) {
+    return result_err(json_tape_ref)(JSON_ERROR_EMPTY);
+  }
+
+  tape->count = 0;
+  tape->strings_size = 0;
+
+  // Unescaped strings are shorter than their quoted source, so the
+  // string buffer never grows during the parse
+  if (tape->strings_capacity < len + 1) {
+    char *strings = (char *)realloc(tape->strings, len + 1);
+    if (strings == NULL)
+      return result_err(json_tape_ref)(JSON_ERROR_EMPTY);
+
+    tape->strings = strings;
+    tape->strings_capacity = len + 1;
+  }
+
+  json_context_init(&ctx, json_str, len, NULL);
+  json_context_skip_whitespace(&ctx, &json_str);
+
+  result(size) root_result = json_tape_parse_value(tape, &ctx, &json_str);
+  json_context_release(&ctx);
+
+  if (result_is_err(size)(&root_result))
+    return result_map_err(json_tape_ref, size, &root_result);
+
+  json_tape_ref_t root = {0};
+  root.tape = tape;
+  root.index = result_unwrap(size)(&root_result);
+
+  return result_ok(json_tape_ref)(root);
+}
+
+void json_tape_free(json_tape_t * tape) {
+  free(tape->words);
+  free(tape->strings);
+  memset(tape, 0, sizeof(json_tape_t));
+}
+
+_bool json_tape_reserve(json_tape_t * tape, size_t count) {
+  if (tape->capacity - tape->count >= count)
+    return _true;
+
+  size_t capacity = tape->capacity > 0 ? tape->capacity * 2 : JSON_TAPE_SIZE;
+  while (capacity - tape->count < count)
+    capacity *= 2;
+
+  uint64_t *words =
+      (uint64_t *)realloc(tape->words, capacity * sizeof(uint64_t));
+  if (words == NULL)
+    return _false;
+
+  tape->words = words;
+  tape->capacity = capacity;
+
+  return _true;
+}
+
+size_t json_tape_skip(const json_tape_t * tape, size_t index) {
+  uint64_t word = tape->words[index];
+
+  switch (json_tape_tag(word)) {
+  case '{':
+  case '[':
+    return (size_t)(word & JSON_TAPE_INDEX_MAX);
+  case '"':
+  case 'l':
+  case 'd':
+    return index + 2;
+  default:
+    return index + 1;
+  }
+}
+
+result(size) json_tape_parse_value(json_tape_t * tape, json_context_t * ctx,
+                                   json_string_t * str_ptr) {
+  result_try(size, json_element_type, type,
+             json_guess_element_type(*str_ptr, ctx->end));
+
+  switch (type) {
+  case JSON_ELEMENT_TYPE_STRING:
+    return json_tape_parse_string(tape, ctx, str_ptr);
+  case JSON_ELEMENT_TYPE_NUMBER:
+    return json_tape_parse_number(tape, ctx, str_ptr);
+  case JSON_ELEMENT_TYPE_OBJECT:
+    return json_tape_parse_object(tape, ctx, str_ptr);
+  case JSON_ELEMENT_TYPE_ARRAY:
+    return json_tape_parse_array(tape, ctx, str_ptr);
+  case JSON_ELEMENT_TYPE_BOOLEAN:
+  case JSON_ELEMENT_TYPE_NULL:
+    return json_tape_parse_literal(tape, ctx, str_ptr);
+  default:
+    return result_err(size)(JSON_ERROR_INVALID_TYPE);
+  }
+}
+
+result(size) json_tape_parse_string(json_tape_t * tape, json_context_t * ctx,
+                                    json_string_t * str_ptr) {
+  // Skip the first '"' character
+  (*str_ptr)++;
+
+  // A zero length is either "" or a missing closing quote
+  size_t len = json_context_string_len(ctx, *str_ptr);
+  if (len == 0 && json_peek(*str_ptr, ctx->end) != '"')
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+  if (!json_tape_reserve(tape, 2))
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+  size_t offset = tape->strings_size;
+  result_try(size, size, length,
+             json_unescape_into(tape->strings + offset, *str_ptr, len));
+
+  // Skip to beyond the string
+  (*str_ptr) += len + 1;
+
+  size_t index = tape->count;
+  tape->words[index] = json_tape_word('"', offset);
+  tape->words[index + 1] = length;
+  tape->count += 2;
+  tape->strings_size += length + 1;
+
+  return result_ok(size)(index);
+}
+
+result(size) json_tape_parse_number(json_tape_t * tape, json_context_t * ctx,
+                                    json_string_t * str_ptr) {
+  json_string_t start = *str_ptr;
+
+  result_try(size, json_element_value, value,
+             json_parse_number(ctx, str_ptr));
+
+  if (*str_ptr == start || !json_tape_reserve(tape, 2))
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+  size_t index = tape->count;
+  if (value.as_number.type == JSON_NUMBER_TYPE_DOUBLE) {
+    tape->words[index] = json_tape_word('d', 0);
+    memcpy(&tape->words[index + 1], &value.as_number.value.as_double,
+           sizeof(uint64_t));
+  } else {
+    tape->words[index] = json_tape_word('l', 0);
+    tape->words[index + 1] = (uint64_t)value.as_number.value.as_long;
+  }
+  tape->count += 2;
+
+  return result_ok(size)(index);
+}
+
+result(size) json_tape_parse_object(json_tape_t * tape, json_context_t * ctx,
+                                    json_string_t * str_ptr) {
+  size_t start = tape->count;
+  size_t count = 0;
+
+  // The opening word is patched once the closing one is known
+  if (!json_tape_reserve(tape, 1))
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+  tape->count++;
+
+  // Skip the first '{' character
+  (*str_ptr)++;
+  json_context_skip_whitespace(ctx, str_ptr);
+
+  if (json_peek(*str_ptr, ctx->end) == '}') {
+    (*str_ptr)++;
+  } else {
+    for (;;) {
+      if (json_peek(*str_ptr, ctx->end) != '"')
+        return result_err(size)(JSON_ERROR_INVALID_KEY);
+
+      result(size) key_result = json_tape_parse_string(tape, ctx, str_ptr);
+      if (result_is_err(size)(&key_result))
+        return key_result;
+
+      json_context_skip_whitespace(ctx, str_ptr);
+      if (json_peek(*str_ptr, ctx->end) != ':')
+        return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+      (*str_ptr)++;
+      json_context_skip_whitespace(ctx, str_ptr);
+
+      result(size) value_result = json_tape_parse_value(tape, ctx, str_ptr);
+      if (result_is_err(size)(&value_result))
+        return value_result;
+      count++;
+
+      json_context_skip_whitespace(ctx, str_ptr);
+      const char ch = json_peek(*str_ptr, ctx->end);
+      (*str_ptr)++;
+
+      if (ch == '}')
+        break;
+      if (ch != ',')
+        return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+      json_context_skip_whitespace(ctx, str_ptr);
+    }
+  }
+
+  if (!json_tape_reserve(tape, 1) || tape->count + 1 > JSON_TAPE_INDEX_MAX)
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+  tape->words[tape->count++] = json_tape_word('}', start);
+  if (count > JSON_TAPE_COUNT_MAX)
+    count = JSON_TAPE_COUNT_MAX;
+  tape->words[start] = json_tape_word('{', (uint64_t)count << 32 | tape->count);
+
+  return result_ok(size)(start);
+}
+
+result(size) json_tape_parse_array(json_tape_t * tape, json_context_t * ctx,
+                                   json_string_t * str_ptr) {
+  size_t start = tape->count;
+  size_t count = 0;
+
+  // The opening word is patched once the closing one is known
+  if (!json_tape_reserve(tape, 1))
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+  tape->count++;
+
+  // Skip the starting '[' character
+  (*str_ptr)++;
+  json_context_skip_whitespace(ctx, str_ptr);
+
+  if (json_peek(*str_ptr, ctx->end) == ']') {
+    (*str_ptr)++;
+  } else {
+    for (;;) {
+      result(size) value_result = json_tape_parse_value(tape, ctx, str_ptr);
+      if (result_is_err(size)(&value_result))
+        return value_result;
+      count++;
+
+      json_context_skip_whitespace(ctx, str_ptr);
+      const char ch = json_peek(*str_ptr, ctx->end);
+      (*str_ptr)++;
+
+      if (ch == ']')
+        break;
+      if (ch != ',')
+        return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+      json_context_skip_whitespace(ctx, str_ptr);
+    }
+  }
+
+  if (!json_tape_reserve(tape, 1) || tape->count + 1 > JSON_TAPE_INDEX_MAX)
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+  tape->words[tape->count++] = json_tape_word(']', start);
+  if (count > JSON_TAPE_COUNT_MAX)
+    count = JSON_TAPE_COUNT_MAX;
+  tape->words[start] = json_tape_word('[', (uint64_t)count << 32 | tape->count);
+
+  return result_ok(size)(start);
+}
+
+result(size) json_tape_parse_literal(json_tape_t * tape, json_context_t * ctx,
+                                     json_string_t * str_ptr) {
+  size_t left = ctx->end - *str_ptr;
+  char tag;
+
+  if (left >= 4 && memcmp(*str_ptr, "true", 4) == 0) {
+    tag = 't';
+    (*str_ptr) += 4;
+  } else if (left >= 5 && memcmp(*str_ptr, "false", 5) == 0) {
+    tag = 'f';
+    (*str_ptr) += 5;
+  } else if (left >= 4 && memcmp(*str_ptr, "null", 4) == 0) {
+    tag = 'n';
+    (*str_ptr) += 4;
+  } else {
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+  }
+
+  if (!json_tape_reserve(tape, 1))
+    return result_err(size)(JSON_ERROR_INVALID_VALUE);
+
+  tape->words[tape->count] = json_tape_word(tag, 0);
+
+  return result_ok(size)(tape->count++);
+}
+
+json_element_type_t json_tape_type(json_tape_ref_t ref) {
+  switch (json_tape_tag(ref.tape->words[ref.index])) {
+  case '"':
+    return JSON_ELEMENT_TYPE_STRING;
+  case 'l':
+  case 'd':
+    return JSON_ELEMENT_TYPE_NUMBER;
+  case '{':
+    return JSON_ELEMENT_TYPE_OBJECT;
+  case '[':
+    return JSON_ELEMENT_TYPE_ARRAY;
+  case 't':
+  case 'f':
+    return JSON_ELEMENT_TYPE_BOOLEAN;
+  default:
+    return JSON_ELEMENT_TYPE_NULL;
+  }
+}
+
+size_t json_tape_count(json_tape_ref_t ref) {
+  uint64_t word = ref.tape->words[ref.index];
+  size_t count = (size_t)(json_tape_payload(word) >> 32);
+
+  if (count < JSON_TAPE_COUNT_MAX)
+    return count;
+
+  // Saturated, walk the children
+  count = 0;
+  json_tape_ref_t child = json_tape_first(ref);
+  while (!json_tape_is_end(child)) {
+    child = json_tape_next(child);
+    count++;
+  }
+
+  return json_tape_tag(word) == '{' ? count / 2 : count;
+}
+
+json_tape_ref_t json_tape_first(json_tape_ref_t ref) {
+  ref.index++;
+  return ref;
+}
+
+json_tape_ref_t json_tape_next(json_tape_ref_t ref) {
+  ref.index = json_tape_skip(ref.tape, ref.index);
+  return ref;
+}
+
+json_boolean_t json_tape_is_end(json_tape_ref_t ref) {
+  if (ref.index >= ref.tape->count)
+    return _true;
+
+  const char tag = json_tape_tag(ref.tape->words[ref.index]);
+  return tag == '}' || tag == ']';
+}
+
+result(json_tape_ref) json_tape_object_find(json_tape_ref_t object,
+                                            json_string_t key) {
+  if (key == NULL)
+    return result_err(json_tape_ref)(JSON_ERROR_INVALID_KEY);
+
+  return json_tape_object_find_n(object, key, strlen(key));
+}
+
+result(json_tape_ref) json_tape_object_find_n(json_tape_ref_t object,
+                                              json_string_t key, size_t len) {
+  const json_tape_t *tape = object.tape;
+
+  if (key == NULL)
+    return result_err(json_tape_ref)(JSON_ERROR_INVALID_KEY);
+  if (json_tape_tag(tape->words[object.index]) != '{')
+    return result_err(json_tape_ref)(JSON_ERROR_INVALID_TYPE);
+
+  // The keys are compared in document order, so the first of duplicate
+  // keys wins. Values are stepped over in one jump each
+  size_t close = json_tape_skip(tape, object.index) - 1;
+  size_t i = object.index + 1;
+  while (i < close) {
+    uint64_t word = tape->words[i];
+    json_string_t data = tape->strings + json_tape_payload(word);
+
+    if (tape->words[i + 1] == len && memcmp(data, key, len) == 0) {
+      json_tape_ref_t value = {0};
+      value.tape = tape;
+      value.index = i + 2;
+
+      return result_ok(json_tape_ref)(value);
+    }
+
+    i = json_tape_skip(tape, i + 2);
+  }
+
+  return result_err(json_tape_ref)(JSON_ERROR_INVALID_KEY);
+}
+
+result(json_tape_ref) json_tape_array_get(json_tape_ref_t array, size_t i) {
+  const json_tape_t *tape = array.tape;
+
+  if (json_tape_tag(tape->words[array.index]) != '[')
+    return result_err(json_tape_ref)(JSON_ERROR_INVALID_TYPE);
+
+  json_tape_ref_t element = json_tape_first(array);
+  while (!json_tape_is_end(element)) {
+    if (i-- == 0)
+      return result_ok(json_tape_ref)(element);
+
+    element = json_tape_next(element);
+  }
+
+  return result_err(json_tape_ref)(JSON_ERROR_INVALID_KEY);
+}
+
+json_string_view_t json_tape_get_string(json_tape_ref_t ref) {
+  json_string_view_t view = {0};
+  view.data = ref.tape->strings + json_tape_payload(ref.tape->words[ref.index]);
+  view.length = (size_t)ref.tape->words[ref.index + 1];
+
+  return view;
+}
+
+json_number_t json_tape_get_number(json_tape_ref_t ref) {
+  json_number_t number = {0};
+
+  if (json_tape_tag(ref.tape->words[ref.index]) == 'd') {
+    number.type = JSON_NUMBER_TYPE_DOUBLE;
+    memcpy(&number.value.as_double, &ref.tape->words[ref.index + 1],
+           sizeof(double));
+  } else {
+    number.type = JSON_NUMBER_TYPE_LONG;
+    number.value.as_long = (json_number_long_t)ref.tape->words[ref.index + 1];
+  }
+
+  return number;
+}
+
+json_boolean_t json_tape_get_boolean(json_tape_ref_t ref) {
+  return json_tape_tag(ref.tape->words[ref.index]) == 't';
+}
+
+define_result_type(json_tape_ref)
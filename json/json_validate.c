@@ -0,0 +1,797 @@
+#include "json.h"
+#include "json_internal.h"
+#include "json_simd.h"
+
+#include <string.h>
+
+/*
+ * Validation without a DOM. The tokens of each block found by the
+ * structural scanner of the index drive a small automaton, whose
+ * nesting lives in a bit stack of fixed size, while the same block is
+ * checked for control characters in strings and for UTF-8. Only the
+ * bytes of numbers, literals and escapes are looked at one by one.
+ */
+
+/**
+ * @brief What the automaton expects at the next token
+ */
+typedef enum json_validate_state_e {
+  /* The root value, a value after ':' or after ',' in an array */
+  JSON_VALIDATE_VALUE,
+  /* A value or ']', after '[' */
+  JSON_VALIDATE_FIRST_VALUE,
+  /* A key or '}', after '{' */
+  JSON_VALIDATE_FIRST_KEY,
+  /* A key, after ',' in an object */
+  JSON_VALIDATE_KEY,
+  /* The closing quote of a key */
+  JSON_VALIDATE_KEY_END,
+  /* The closing quote of a string value */
+  JSON_VALIDATE_STRING_END,
+  /* ':' after a key */
+  JSON_VALIDATE_COLON,
+  /* ',' or the closing bracket, after a value in a container */
+  JSON_VALIDATE_NEXT,
+  /* Nothing, the root value is complete */
+  JSON_VALIDATE_DONE
+} json_validate_state_t;
+
+/**
+ * @brief Grammar state carried from one block to the next
+ */
+typedef struct json_validate_grammar_s {
+  json_validate_state_t state;
+  size_t depth;
+  /* Bit `i` is set when the container at depth `i + 1` is an object */
+  uint64_t objects[JSON_VALIDATE_MAX_DEPTH / 64];
+} json_validate_grammar_t;
+
+/**
+ * @brief UTF-8 state carried from one block to the next
+ */
+typedef struct json_validate_utf8_s {
+  const unsigned char *json;
+  size_t len;
+#if defined(JSON_SIMD_AVX2)
+  /* The previous 32 bytes, whose last sequence may go on */
+  __m256i prev_input;
+  /* Non-zero when the previous 32 bytes end in a sequence */
+  __m256i prev_incomplete;
+#else
+  /* Where the sequence going on into the next block ends */
+  size_t resume;
+#endif
+} json_validate_utf8_t;
+
+/**
+ * @brief Feeds the tokens at `offset` in `tokens` to the automaton
+ *
+ * @return The offset of the first token in error, or `len`
+ */
+static size_t json_validate_tokens(json_validate_grammar_t *,
+                                   const unsigned char *, size_t, size_t,
+                                   uint64_t);
+
+/**
+ * @brief Checks the number or literal at `*offset` and that a delimiter
+ * follows it, leaving `*offset` at the first byte in error otherwise
+ */
+static _bool json_validate_scalar(const unsigned char *, size_t, size_t *);
+
+/**
+ * @brief Checks the escapes of `escaped`, characters following a
+ * backslash inside strings of the block at `offset`. `low` carries the
+ * offset of the 'u' of the low surrogate a high one was checked with
+ *
+ * @return The offset of the backslash of the first invalid escape, or
+ * `len`
+ */
+static size_t json_validate_escapes(const unsigned char *, size_t, size_t,
+                                    uint64_t, size_t *);
+
+/**
+ * @brief The code unit of the four hex digits at `offset`, or -1
+ */
+static long json_validate_hex(const unsigned char *, size_t, size_t);
+
+/**
+ * @brief Bitmask of the bytes below 0x20 of the 64 bytes at `block`
+ */
+static uint64_t json_validate_control(const unsigned char *);
+
+/**
+ * @brief Whether the 64 bytes at `block`, found at `offset`, continue
+ * the UTF-8 of the blocks before them
+ */
+static _bool json_validate_utf8_block(json_validate_utf8_t *,
+                                      const unsigned char *, size_t);
+
+/**
+ * @brief Whether no UTF-8 sequence is cut short by the end of the input
+ */
+static _bool json_validate_utf8_finish(json_validate_utf8_t *);
+
+/**
+ * @brief Finds the first invalid UTF-8 sequence at or after the block at
+ * `offset`, once the vectors have found there is one
+ *
+ * @return The offset of the first byte of the sequence
+ */
+static size_t json_validate_utf8_error(const json_validate_utf8_t *, size_t);
+
+/**
+ * @brief Checks the UTF-8 sequences that start from `*offset` up to
+ * `end`, the last one may go on up to `len`. Leaves `*offset` past the
+ * last sequence, or at the first one that is invalid
+ */
+static _bool json_validate_utf8_scan(const unsigned char *, size_t *, size_t,
+                                     size_t);
+
+json_boolean_t json_validate(json_string_t json_str, size_t len,
+                             size_t *error_offset) {
+  const unsigned char *json = (const unsigned char *)json_str;
+  json_index_carry_t carry = {0};
+  json_validate_grammar_t grammar;
+  json_validate_utf8_t utf8;
+  unsigned char tail[JSON_INDEX_BLOCK];
+  size_t error = len;
+  size_t low = 0;
+  size_t offset;
+
+  grammar.state = JSON_VALIDATE_VALUE;
+  grammar.depth = 0;
+
+  memset(&utf8, 0, sizeof(json_validate_utf8_t));
+  utf8.json = json;
+  utf8.len = len;
+
+  for (offset = 0; offset < len; offset += JSON_INDEX_BLOCK) {
+    const unsigned char *block = json + offset;
+    json_index_masks_t masks;
+
+    // Pad the last partial block with whitespace, it never emits tokens
+    if (len - offset < JSON_INDEX_BLOCK) {
+      memset(tail, ' ', JSON_INDEX_BLOCK);
+      memcpy(tail, block, len - offset);
+      block = tail;
+    }
+
+    json_index_scan(block, &carry, &masks);
+
+    // Errors inside strings and in the encoding bound the tokens still
+    // worth feeding to the automaton
+    uint64_t control = json_validate_control(block) & masks.in_string;
+    if (control != 0)
+      error = offset + json_simd_ctz(control);
+
+    uint64_t escaped = masks.escaped & masks.in_string;
+    if (escaped != 0) {
+      size_t escape = json_validate_escapes(json, len, offset, escaped, &low);
+      if (escape < error)
+        error = escape;
+    }
+
+    if (!json_validate_utf8_block(&utf8, block, offset)) {
+      size_t sequence = json_validate_utf8_error(&utf8, offset);
+      if (sequence < error)
+        error = sequence;
+    }
+
+    size_t token = json_validate_tokens(&grammar, json, len, offset,
+                                        masks.tokens);
+    if (token < error)
+      error = token;
+
+    if (error < len)
+      break;
+  }
+
+  if (error == len && !json_validate_utf8_finish(&utf8))
+    error = json_validate_utf8_error(
+        &utf8, len > JSON_INDEX_BLOCK ? len - JSON_INDEX_BLOCK : 0);
+
+  if (error == len && grammar.state == JSON_VALIDATE_DONE)
+    return _true;
+
+  if (error_offset != NULL)
+    *error_offset = error;
+
+  return _false;
+}
+
+size_t json_validate_tokens(json_validate_grammar_t * grammar,
+                            const unsigned char *json, size_t len,
+                            size_t offset, uint64_t tokens) {
+  json_validate_state_t state = grammar->state;
+
+  for (; tokens != 0; tokens &= tokens - 1) {
+    size_t position = offset + json_simd_ctz(tokens);
+    unsigned char ch = json[position];
+    _bool in_object;
+
+    switch (state) {
+    case JSON_VALIDATE_KEY_END:
+      state = JSON_VALIDATE_COLON;
+      continue;
+
+    case JSON_VALIDATE_STRING_END:
+      state = grammar->depth > 0 ? JSON_VALIDATE_NEXT : JSON_VALIDATE_DONE;
+      continue;
+
+    case JSON_VALIDATE_COLON:
+      if (ch != ':')
+        break;
+      state = JSON_VALIDATE_VALUE;
+      continue;
+
+    case JSON_VALIDATE_NEXT:
+      in_object = (grammar->objects[(grammar->depth - 1) / 64] >>
+                   ((grammar->depth - 1) % 64)) &
+                  1;
+
+      if (ch == ',') {
+        state = in_object ? JSON_VALIDATE_KEY : JSON_VALIDATE_VALUE;
+        continue;
+      }
+      if (ch != (in_object ? '}' : ']'))
+        break;
+
+      grammar->depth--;
+      state = grammar->depth > 0 ? JSON_VALIDATE_NEXT : JSON_VALIDATE_DONE;
+      continue;
+
+    case JSON_VALIDATE_FIRST_KEY:
+      if (ch == '}') {
+        grammar->depth--;
+        state = grammar->depth > 0 ? JSON_VALIDATE_NEXT : JSON_VALIDATE_DONE;
+        continue;
+      }
+      /* fallthrough */
+
+    case JSON_VALIDATE_KEY:
+      if (ch != '"')
+        break;
+
+      // Nothing inside a string is a token, the next one closes it
+      if ((tokens & (tokens - 1)) == 0) {
+        state = JSON_VALIDATE_KEY_END;
+        continue;
+      }
+      tokens &= tokens - 1;
+      state = JSON_VALIDATE_COLON;
+      continue;
+
+    case JSON_VALIDATE_FIRST_VALUE:
+      if (ch == ']') {
+        grammar->depth--;
+        state = grammar->depth > 0 ? JSON_VALIDATE_NEXT : JSON_VALIDATE_DONE;
+        continue;
+      }
+      /* fallthrough */
+
+    case JSON_VALIDATE_VALUE:
+      if (ch == '{' || ch == '[') {
+        if (grammar->depth == JSON_VALIDATE_MAX_DEPTH)
+          break;
+
+        uint64_t bit = (uint64_t)1 << (grammar->depth % 64);
+        if (ch == '{')
+          grammar->objects[grammar->depth / 64] |= bit;
+        else
+          grammar->objects[grammar->depth / 64] &= ~bit;
+
+        grammar->depth++;
+        state = ch == '{' ? JSON_VALIDATE_FIRST_KEY : JSON_VALIDATE_FIRST_VALUE;
+        continue;
+      }
+      if (ch == '"') {
+        if ((tokens & (tokens - 1)) == 0) {
+          state = JSON_VALIDATE_STRING_END;
+          continue;
+        }
+        tokens &= tokens - 1;
+        state = grammar->depth > 0 ? JSON_VALIDATE_NEXT : JSON_VALIDATE_DONE;
+        continue;
+      }
+      if (ch == '}' || ch == ']' || ch == ':' || ch == ',')
+        break;
+
+      if (!json_validate_scalar(json, len, &position))
+        return position;
+
+      state = grammar->depth > 0 ? JSON_VALIDATE_NEXT : JSON_VALIDATE_DONE;
+      continue;
+
+    case JSON_VALIDATE_DONE:
+      break;
+    }
+
+    return position;
+  }
+
+  grammar->state = state;
+  return len;
+}
+
+_bool json_validate_scalar(const unsigned char *json, size_t len,
+                           size_t *offset) {
+  size_t i = *offset;
+
+  if (json[i] == 't' || json[i] == 'f' || json[i] == 'n') {
+    const char *literal =
+        json[i] == 't' ? "true" : json[i] == 'f' ? "false" : "null";
+
+    for (; *literal != '\0'; literal++, i++) {
+      if (i == len || json[i] != (unsigned char)*literal) {
+        *offset = i;
+        return _false;
+      }
+    }
+  } else {
+    if (json[i] == '-')
+      i++;
+
+    // No leading zeros, and at least one digit in every part
+    if (i < len && json[i] == '0') {
+      i++;
+    } else {
+      if (i == len || json[i] < '1' || json[i] > '9') {
+        *offset = i;
+        return _false;
+      }
+      while (i < len && json[i] >= '0' && json[i] <= '9')
+        i++;
+    }
+
+    if (i < len && json[i] == '.') {
+      i++;
+      if (i == len || json[i] < '0' || json[i] > '9') {
+        *offset = i;
+        return _false;
+      }
+      while (i < len && json[i] >= '0' && json[i] <= '9')
+        i++;
+    }
+
+    if (i < len && (json[i] == 'e' || json[i] == 'E')) {
+      i++;
+      if (i < len && (json[i] == '+' || json[i] == '-'))
+        i++;
+      if (i == len || json[i] < '0' || json[i] > '9') {
+        *offset = i;
+        return _false;
+      }
+      while (i < len && json[i] >= '0' && json[i] <= '9')
+        i++;
+    }
+  }
+
+  *offset = i;
+  if (i == len)
+    return _true;
+
+  switch (json[i]) {
+  case ' ':
+  case '\n':
+  case '\r':
+  case '\t':
+  case '{':
+  case '}':
+  case '[':
+  case ']':
+  case ':':
+  case ',':
+  case '"':
+    return _true;
+  default:
+    return _false;
+  }
+}
+
+size_t json_validate_escapes(const unsigned char *json, size_t len,
+                             size_t offset, uint64_t escaped, size_t *low) {
+  for (; escaped != 0; escaped &= escaped - 1) {
+    size_t position = offset + json_simd_ctz(escaped);
+    long code;
+
+    // A backslash ending the input escapes the padding, the string it is
+    // in is unterminated
+    if (position >= len)
+      break;
+
+    switch (json[position]) {
+    case '"':
+    case '\\':
+    case '/':
+    case 'b':
+    case 'f':
+    case 'n':
+    case 'r':
+    case 't':
+      continue;
+
+    case 'u':
+      code = json_validate_hex(json, len, position + 1);
+      if (code < 0)
+        break;
+
+      // Surrogates only come in pairs, the high one checks the low one
+      // right after it
+      if (code >= 0xD800 && code <= 0xDBFF) {
+        code = position + 6 < len && json[position + 5] == '\\' &&
+                       json[position + 6] == 'u'
+                   ? json_validate_hex(json, len, position + 7)
+                   : -1;
+        if (code < 0xDC00 || code > 0xDFFF)
+          break;
+
+        *low = position + 6;
+      } else if (code >= 0xDC00 && code <= 0xDFFF && *low != position) {
+        break;
+      }
+      continue;
+    }
+
+    return position - 1;
+  }
+
+  return len;
+}
+
+long json_validate_hex(const unsigned char *json, size_t len, size_t offset) {
+  long code = 0;
+  size_t i;
+
+  if (len - offset < 4)
+    return -1;
+
+  for (i = offset; i < offset + 4; i++) {
+    if (json[i] >= '0' && json[i] <= '9')
+      code = code << 4 | (json[i] - '0');
+    else if (json[i] >= 'a' && json[i] <= 'f')
+      code = code << 4 | (json[i] - 'a' + 10);
+    else if (json[i] >= 'A' && json[i] <= 'F')
+      code = code << 4 | (json[i] - 'A' + 10);
+    else
+      return -1;
+  }
+
+  return code;
+}
+
+#if defined(JSON_SIMD_AVX2)
+
+/**
+ * @brief Bitmask of the bytes of a 32-byte vector below 0x20
+ */
+#define json_validate_below_space(v)                                           \
+  ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(                 \
+      _mm256_max_epu8(v, _mm256_set1_epi8(0x1F)), _mm256_set1_epi8(0x1F))))
+
+uint64_t json_validate_control(const unsigned char *block) {
+  __m256i lo = _mm256_loadu_si256((const __m256i *)block);
+  __m256i hi = _mm256_loadu_si256((const __m256i *)(block + 32));
+
+  return json_validate_below_space(lo) | json_validate_below_space(hi) << 32;
+}
+
+/*
+ * Error flags of the UTF-8 check, after "Validating UTF-8 In Less Than
+ * One Instruction Per Byte" (Keiser and Lemire). Each pair of adjacent
+ * bytes is looked up by the high nibble of the first, its low nibble
+ * and the high nibble of the second, and the three sets of flags are
+ * intersected.
+ */
+#define JSON_UTF8_TOO_SHORT (1 << 0)      /* 11______ 0_______ */
+#define JSON_UTF8_TOO_LONG (1 << 1)       /* 0_______ 10______ */
+#define JSON_UTF8_OVERLONG_3 (1 << 2)     /* 11100000 100_____ */
+#define JSON_UTF8_TOO_LARGE (1 << 3)      /* 11110100 1001____ */
+#define JSON_UTF8_SURROGATE (1 << 4)      /* 11101101 101_____ */
+#define JSON_UTF8_OVERLONG_2 (1 << 5)     /* 1100000_ 10______ */
+#define JSON_UTF8_TOO_LARGE_1000 (1 << 6) /* 11110101 1000____ */
+#define JSON_UTF8_OVERLONG_4 (1 << 6)     /* 11110000 1000____ */
+#define JSON_UTF8_TWO_CONTS (1 << 7)      /* 10______ 10______ */
+#define JSON_UTF8_CARRY                                                        \
+  (JSON_UTF8_TOO_SHORT | JSON_UTF8_TOO_LONG | JSON_UTF8_TWO_CONTS)
+
+/**
+ * @brief A 16-entry lookup table repeated in both halves of a vector
+ */
+#define json_validate_table(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)     \
+  _mm256_setr_epi8(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p, a, b, c,    \
+                   d, e, f, g, h, i, j, k, l, m, n, o, p)
+
+/**
+ * @brief The vector of the bytes `n` positions before those of `input`
+ */
+#define json_validate_prev(input, prev_input, n)                              \
+  _mm256_alignr_epi8(input,                                                    \
+                     _mm256_permute2x128_si256(prev_input, input, 0x21),       \
+                     16 - (n))
+
+/**
+ * @brief Non-zero lanes where the 32 bytes of `input` do not continue
+ * the UTF-8 of `prev_input`
+ */
+static __m256i json_validate_utf8_vector(__m256i input, __m256i prev_input) {
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  const __m256i byte_1_high_table = json_validate_table(
+      JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG,
+      JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG,
+      JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG, JSON_UTF8_TWO_CONTS,
+      JSON_UTF8_TWO_CONTS, JSON_UTF8_TWO_CONTS, JSON_UTF8_TWO_CONTS,
+      JSON_UTF8_TOO_SHORT | JSON_UTF8_OVERLONG_2, JSON_UTF8_TOO_SHORT,
+      JSON_UTF8_TOO_SHORT | JSON_UTF8_OVERLONG_3 | JSON_UTF8_SURROGATE,
+      JSON_UTF8_TOO_SHORT | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000 |
+          JSON_UTF8_OVERLONG_4);
+  const __m256i byte_1_low_table = json_validate_table(
+      JSON_UTF8_CARRY | JSON_UTF8_OVERLONG_3 | JSON_UTF8_OVERLONG_2 |
+          JSON_UTF8_OVERLONG_4,
+      JSON_UTF8_CARRY | JSON_UTF8_OVERLONG_2, JSON_UTF8_CARRY,
+      JSON_UTF8_CARRY, JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE,
+      JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+      JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+      JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+      JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+      JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+      JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+      JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+      JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+      JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000 |
+          JSON_UTF8_SURROGATE,
+      JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+      JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000);
+  const __m256i byte_2_high_table = json_validate_table(
+      JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT,
+      JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT,
+      JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT,
+      JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS |
+          JSON_UTF8_OVERLONG_3 | JSON_UTF8_TOO_LARGE_1000 |
+          JSON_UTF8_OVERLONG_4,
+      JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS |
+          JSON_UTF8_OVERLONG_3 | JSON_UTF8_TOO_LARGE,
+      JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS |
+          JSON_UTF8_SURROGATE | JSON_UTF8_TOO_LARGE,
+      JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS |
+          JSON_UTF8_SURROGATE | JSON_UTF8_TOO_LARGE,
+      JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT,
+      JSON_UTF8_TOO_SHORT);
+
+  __m256i prev1 = json_validate_prev(input, prev_input, 1);
+  __m256i byte_1_high = _mm256_shuffle_epi8(
+      byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+  __m256i byte_1_low =
+      _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, nibble));
+  __m256i byte_2_high = _mm256_shuffle_epi8(
+      byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+  __m256i special =
+      _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+  // Two continuations in a row are only right as the third or fourth
+  // byte of a sequence
+  __m256i third = _mm256_subs_epu8(json_validate_prev(input, prev_input, 2),
+                                   _mm256_set1_epi8(0xE0 - 0x80));
+  __m256i fourth = _mm256_subs_epu8(json_validate_prev(input, prev_input, 3),
+                                    _mm256_set1_epi8(0xF0 - 0x80));
+  __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                           _mm256_set1_epi8((char)0x80));
+
+  return _mm256_xor_si256(must_continue, special);
+}
+
+_bool json_validate_utf8_block(json_validate_utf8_t * utf8,
+                               const unsigned char *block, size_t offset) {
+  __m256i lo = _mm256_loadu_si256((const __m256i *)block);
+  __m256i hi = _mm256_loadu_si256((const __m256i *)(block + 32));
+  __m256i incomplete = utf8->prev_incomplete;
+
+  (void)offset;
+
+  // ASCII only has to end the sequence the previous block left open
+  if (_mm256_movemask_epi8(_mm256_or_si256(lo, hi)) == 0) {
+    utf8->prev_input = hi;
+    utf8->prev_incomplete = _mm256_setzero_si256();
+    return _mm256_testz_si256(incomplete, incomplete);
+  }
+
+  __m256i error = _mm256_or_si256(json_validate_utf8_vector(lo, utf8->prev_input),
+                                  json_validate_utf8_vector(hi, lo));
+
+  // The last three bytes may start a sequence the next block ends
+  utf8->prev_input = hi;
+  utf8->prev_incomplete = _mm256_subs_epu8(
+      hi, _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                           -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                           -1, -1, -1, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1));
+
+  return _mm256_testz_si256(error, error);
+}
+
+_bool json_validate_utf8_finish(json_validate_utf8_t * utf8) {
+  return _mm256_testz_si256(utf8->prev_incomplete, utf8->prev_incomplete);
+}
+
+#else
+
+#if defined(JSON_SIMD_SSE2)
+
+/**
+ * @brief Bitmask of the bytes of a 16-byte vector below 0x20
+ */
+#define json_validate_below_space(v)                                           \
+  ((uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(                                 \
+      _mm_max_epu8(v, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F))))
+
+uint64_t json_validate_control(const unsigned char *block) {
+  uint64_t control = 0;
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(block + i * 16));
+    control |= json_validate_below_space(v) << (i * 16);
+  }
+
+  return control;
+}
+
+/**
+ * @brief Whether the 64 bytes at `block` are all ASCII
+ */
+static _bool json_validate_ascii(const unsigned char *block) {
+  __m128i v = _mm_or_si128(
+      _mm_or_si128(_mm_loadu_si128((const __m128i *)block),
+                   _mm_loadu_si128((const __m128i *)(block + 16))),
+      _mm_or_si128(_mm_loadu_si128((const __m128i *)(block + 32)),
+                   _mm_loadu_si128((const __m128i *)(block + 48))));
+
+  return _mm_movemask_epi8(v) == 0;
+}
+
+#elif defined(JSON_SIMD_NEON)
+
+uint64_t json_validate_control(const unsigned char *block) {
+  uint64_t control = 0;
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    uint8x16_t v = vld1q_u8(block + i * 16);
+    control |= json_simd_movemask(vcleq_u8(v, vdupq_n_u8(0x1F))) << (i * 16);
+  }
+
+  return control;
+}
+
+/**
+ * @brief Whether the 64 bytes at `block` are all ASCII
+ */
+static _bool json_validate_ascii(const unsigned char *block) {
+  uint8x16_t v = vorrq_u8(vorrq_u8(vld1q_u8(block), vld1q_u8(block + 16)),
+                          vorrq_u8(vld1q_u8(block + 32), vld1q_u8(block + 48)));
+
+  return json_simd_movemask(vcgeq_u8(v, vdupq_n_u8(0x80))) == 0;
+}
+
+#else
+
+uint64_t json_validate_control(const unsigned char *block) {
+  uint64_t control = 0;
+  int i;
+
+  for (i = 0; i < JSON_INDEX_BLOCK; i++) {
+    if (block[i] < 0x20)
+      control |= (uint64_t)1 << i;
+  }
+
+  return control;
+}
+
+/**
+ * @brief Whether the 64 bytes at `block` are all ASCII
+ */
+static _bool json_validate_ascii(const unsigned char *block) {
+  unsigned char bits = 0;
+  int i;
+
+  for (i = 0; i < JSON_INDEX_BLOCK; i++)
+    bits |= block[i];
+
+  return bits < 0x80;
+}
+
+#endif
+
+_bool json_validate_utf8_block(json_validate_utf8_t * utf8,
+                               const unsigned char *block, size_t offset) {
+  // A sequence going on into an ASCII block would have been cut short
+  if (json_validate_ascii(block))
+    return _true;
+
+  size_t start = utf8->resume > offset ? utf8->resume : offset;
+  size_t end = utf8->len - offset < JSON_INDEX_BLOCK ? utf8->len
+                                                     : offset + JSON_INDEX_BLOCK;
+
+  _bool valid = json_validate_utf8_scan(utf8->json, &start, end, utf8->len);
+  utf8->resume = start;
+
+  return valid;
+}
+
+_bool json_validate_utf8_finish(json_validate_utf8_t * utf8) {
+  (void)utf8;
+  return _true;
+}
+
+#endif
+
+size_t json_validate_utf8_error(const json_validate_utf8_t * utf8,
+                                size_t offset) {
+  size_t start = offset;
+  size_t back;
+
+  // Start over from the first byte of the sequence running into the
+  // block, everything before it is known to be valid
+  for (back = 1; back <= 3 && back <= offset; back++) {
+    if ((utf8->json[offset - back] & 0xC0) != 0x80) {
+      start = offset - back;
+      break;
+    }
+  }
+
+  json_validate_utf8_scan(utf8->json, &start, utf8->len, utf8->len);
+  return start;
+}
+
+_bool json_validate_utf8_scan(const unsigned char *json, size_t *offset,
+                              size_t end, size_t len) {
+  size_t i = *offset;
+
+  while (i < end) {
+    unsigned char lead = json[i];
+    unsigned char min = 0x80;
+    unsigned char max = 0xBF;
+    size_t count;
+    size_t k;
+
+    if (lead < 0x80) {
+      i++;
+      continue;
+    }
+
+    // The second byte is narrowed to rule out overlong forms, surrogates
+    // and code points past U+10FFFF
+    if (lead >= 0xC2 && lead <= 0xDF) {
+      count = 1;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+      count = 2;
+      if (lead == 0xE0)
+        min = 0xA0;
+      else if (lead == 0xED)
+        max = 0x9F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+      count = 3;
+      if (lead == 0xF0)
+        min = 0x90;
+      else if (lead == 0xF4)
+        max = 0x8F;
+    } else {
+      *offset = i;
+      return _false;
+    }
+
+    if (len - i <= count || json[i + 1] < min || json[i + 1] > max) {
+      *offset = i;
+      return _false;
+    }
+    for (k = 2; k <= count; k++) {
+      if ((json[i + k] & 0xC0) != 0x80) {
+        *offset = i;
+        return _false;
+      }
+    }
+
+    i += count + 1;
+  }
+
+  *offset = i;
+  return _true;
+}
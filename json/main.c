@@ -3,64 +3,2914 @@
 #include <string.h>
 #include <time.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "./json.h"
 
-const char *read_file(const char *path) {
-  FILE *file = fopen(path, "r");
-  if (file == NULL) {
-    fprintf(stderr, "Expected file \"%s\" not found", path);
-    return NULL;
-  }
-  fseek(file, 0, SEEK_END);
-  long len = ftell(file);
-  fseek(file, 0, SEEK_SET);
-  char *buffer = malloc(len + 1);
+/**
+ * @brief Zero bytes readable past the end of every loaded input, so it
+ * is NUL-terminated and a scanner may load a whole vector starting at
+ * its last byte
+ */
+#define INPUT_PADDING 64
+
+/**
+ * @brief How the input file gets into memory
+ */
+typedef enum load_method_e
+{
+    LOAD_READ = 0,
+    LOAD_MMAP,
+    /* Mapped with every page faulted in up front */
+    LOAD_POPULATE,
+} load_method_t;
+
+static const char *load_methods[] = {"read", "mmap", "populate"};
+
+/**
+ * @brief An input file in memory, either read into the heap or mapped
+ */
+typedef struct input_s
+{
+    const char *data;
+    size_t len;
+    /* The whole mapping, padding included, or NULL for a heap copy */
+    void *mapping;
+    size_t mapping_size;
+} input_t;
+
+/**
+ * @brief Loads the file at `path` with `method`, followed by
+ * INPUT_PADDING zero bytes. Anything that cannot be mapped, like an
+ * empty file or a pipe, is read instead
+ */
+static int load_input(const char *path, load_method_t method, input_t *input)
+{
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    memset(input, 0, sizeof(input_t));
+    if (fd < 0)
+    {
+        fprintf(stderr, "Expected file \"%s\" not found\n", path);
+        return -1;
+    }
+    if (fstat(fd, &info) != 0)
+    {
+        fprintf(stderr, "Unable to stat \"%s\"\n", path);
+        close(fd);
+        return -1;
+    }
+
+    if (method != LOAD_READ && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        const size_t len = (size_t)info.st_size;
+        const size_t size = (len + INPUT_PADDING + page - 1) / page * page;
+        int flags = MAP_PRIVATE | MAP_FIXED;
+
+        // Reserve the padded size as zero pages and map the file over the
+        // front of it. The rest of the file's last page reads as zeros too
+        char *region = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MAP_POPULATE
+        if (method == LOAD_POPULATE)
+            flags |= MAP_POPULATE;
+#endif
+
+        if (region != MAP_FAILED && mmap(region, len, PROT_READ, flags, fd, 0) != MAP_FAILED)
+        {
+#ifdef MADV_SEQUENTIAL
+            madvise(region, len, MADV_SEQUENTIAL);
+#endif
+            close(fd);
+            input->data = region;
+            input->len = len;
+            input->mapping = region;
+            input->mapping_size = size;
+            return 0;
+        }
+
+        if (region != MAP_FAILED)
+            munmap(region, size);
+    }
+
+    size_t capacity = S_ISREG(info.st_mode) ? (size_t)info.st_size + 1 : 64 * 1024;
+    size_t len = 0;
+    char *buffer = malloc(capacity + INPUT_PADDING);
+
+    for (;;)
+    {
+        ssize_t count;
+
+        if (buffer == NULL)
+        {
+            fprintf(stderr, "Unable to allocate memory for file\n");
+            close(fd);
+            return -1;
+        }
+
+        count = read(fd, buffer + len, capacity - len);
+        if (count <= 0)
+            break;
+
+        len += (size_t)count;
+        if (len == capacity)
+        {
+            char *grown = realloc(buffer, 2 * capacity + INPUT_PADDING);
+            if (grown == NULL)
+                free(buffer);
+            buffer = grown;
+            capacity *= 2;
+        }
+    }
+    close(fd);
+
+    memset(buffer + len, 0, INPUT_PADDING);
+    input->data = buffer;
+    input->len = len;
+    return 0;
+}
+
+static void release_input(input_t *input)
+{
+    if (input->mapping != NULL)
+        munmap(input->mapping, input->mapping_size);
+    else
+        free((void *)input->data);
+
+    memset(input, 0, sizeof(input_t));
+}
+
+static const char *default_file = "..\\multidim_arr.json";
+
+/**
+ * @brief The file given on the command line, for modes that load it
+ * themselves
+ */
+static const char *input_file;
+
+/**
+ * @brief Monotonic wall clock time in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void report_error(json_error_t error)
+{
+    fprintf(stderr, "Error parsing JSON: %s\n", json_error_to_string(error));
+}
+
+/**
+ * @brief Parses once with the heap allocator, like the original benchmark
+ */
+static int bench_parse(const char *json, size_t len, int iterations)
+{
+    result(json_element) element_result = json_parse_n(json, len);
+
+    if (result_is_err(json_element)(&element_result))
+    {
+        report_error(result_unwrap_err(json_element)(&element_result));
+        return -1;
+    }
+    typed(json_element) element = result_unwrap(json_element)(&element_result);
+
+    // json_print(&element, 2);
+    json_free(&element);
+
+    return 0;
+}
+
+/**
+ * @brief Parses and frees `iterations` times through malloc/free
+ */
+static int bench_heap(const char *json, size_t len, int iterations)
+{
+    json_alloc_stats_t stats;
+    double parse_time = 0, free_time = 0;
+    int i;
+
+    json_alloc_stats_reset();
+    for (i = 0; i < iterations; i++)
+    {
+        double start = now();
+        result(json_element) element_result = json_parse_n(json, len);
+        double parsed = now();
+
+        if (result_is_err(json_element)(&element_result))
+        {
+            report_error(result_unwrap_err(json_element)(&element_result));
+            return -1;
+        }
+        typed(json_element) element = result_unwrap(json_element)(&element_result);
+        json_free(&element);
+
+        parse_time += parsed - start;
+        free_time += now() - parsed;
+    }
+    json_alloc_stats(&stats);
+
+    printf("heap:  parse %.3f ms  free %.3f ms  mallocs %lu  reallocs %lu  frees %lu  bytes %lu (per document)\n",
+           parse_time * 1e3 / iterations, free_time * 1e3 / iterations, (unsigned long)(stats.allocs / iterations),
+           (unsigned long)(stats.reallocs / iterations), (unsigned long)(stats.frees / iterations),
+           (unsigned long)(stats.bytes / iterations));
+    return 0;
+}
+
+/**
+ * @brief Parses `iterations` times into one arena, resetting it in between
+ */
+static int bench_arena(const char *json, size_t len, int iterations)
+{
+    json_parse_options_t options = {0};
+    json_arena_t arena;
+    double parse_time = 0, reset_time = 0;
+    size_t allocs = 0, bytes = 0;
+    int i;
+
+    json_arena_init(&arena, 0);
+    options.arena = &arena;
+    for (i = 0; i < iterations; i++)
+    {
+        double start = now();
+        result(json_element) element_result = json_parse_ex(json, len, &options);
+        double parsed = now();
+
+        if (result_is_err(json_element)(&element_result))
+        {
+            report_error(result_unwrap_err(json_element)(&element_result));
+            json_arena_free(&arena);
+            return -1;
+        }
+        allocs = arena.allocs;
+        bytes = arena.bytes;
+        json_arena_reset(&arena);
+
+        parse_time += parsed - start;
+        reset_time += now() - parsed;
+    }
+
+    printf("arena: parse %.3f ms  reset %.3f ms  allocations %lu  bytes %lu  chunks %lu  reserved %lu\n",
+           parse_time * 1e3 / iterations, reset_time * 1e3 / iterations, (unsigned long)allocs,
+           (unsigned long)bytes, (unsigned long)arena.chunks, (unsigned long)arena.reserved);
+    json_arena_free(&arena);
+    return 0;
+}
+
+/**
+ * @brief Parses `iterations` copies of the input in place, with heap
+ * containers. Copying the input back in is not timed
+ */
+static int bench_insitu(const char *json, size_t len, int iterations)
+{
+    json_alloc_stats_t stats;
+    double parse_time = 0, free_time = 0;
+    char *buffer = malloc(len + 1);
+    int i;
+
+    json_alloc_stats_reset();
+    for (i = 0; i < iterations; i++)
+    {
+        memcpy(buffer, json, len + 1);
+
+        double start = now();
+        result(json_element) element_result = json_parse_insitu(buffer, NULL);
+        double parsed = now();
+
+        if (result_is_err(json_element)(&element_result))
+        {
+            report_error(result_unwrap_err(json_element)(&element_result));
+            free(buffer);
+            return -1;
+        }
+        typed(json_element) element = result_unwrap(json_element)(&element_result);
+        json_free_insitu(&element);
+
+        parse_time += parsed - start;
+        free_time += now() - parsed;
+    }
+    json_alloc_stats(&stats);
+    free(buffer);
+
+    printf("insitu: parse %.3f ms  free %.3f ms  mallocs %lu  reallocs %lu  frees %lu  bytes %lu (per document)\n",
+           parse_time * 1e3 / iterations, free_time * 1e3 / iterations, (unsigned long)(stats.allocs / iterations),
+           (unsigned long)(stats.reallocs / iterations), (unsigned long)(stats.frees / iterations),
+           (unsigned long)(stats.bytes / iterations));
+    return 0;
+}
+
+/**
+ * @brief Compares the byte-at-a-time parse against stage 1 (structural
+ * indexing) followed by the index driven parse, both into an arena
+ */
+static int bench_index(const char *json, size_t len, int iterations)
+{
+    json_index_t index = {0};
+    json_arena_t arena;
+    json_parse_options_t options = {0};
+    double scan_time = 0, stage1_time = 0, indexed_time = 0;
+    int i;
+
+    json_arena_init(&arena, 0);
+    options.arena = &arena;
+
+    for (i = 0; i < iterations; i++)
+    {
+        double start = now();
+        options.index = NULL;
+        result(json_element) scanned = json_parse_ex(json, len, &options);
+        double scan_end = now();
+        json_arena_reset(&arena);
+
+        double stage1_start = now();
+        json_index_build(&index, json, len);
+        double stage1_end = now();
+
+        double indexed_start = now();
+        options.index = &index;
+        result(json_element) indexed = json_parse_ex(json, len, &options);
+        double indexed_end = now();
+        json_arena_reset(&arena);
+
+        if (result_is_err(json_element)(&scanned) || result_is_err(json_element)(&indexed))
+        {
+            report_error(result_unwrap_err(json_element)(&scanned));
+            json_index_free(&index);
+            json_arena_free(&arena);
+            return -1;
+        }
+
+        scan_time += scan_end - start;
+        stage1_time += stage1_end - stage1_start;
+        indexed_time += indexed_end - indexed_start;
+    }
+
+    printf("scan:    %.3f ms  %8.1f MB/s\n", scan_time * 1e3 / iterations, len * iterations / scan_time / 1e6);
+    printf("stage 1: %.3f ms  %8.1f MB/s  (%s, %lu tokens)\n", stage1_time * 1e3 / iterations,
+           len * iterations / stage1_time / 1e6, json_index_kernel(), (unsigned long)index.count);
+    printf("indexed: %.3f ms  %8.1f MB/s  (stage 1 + 2)\n", indexed_time * 1e3 / iterations,
+           len * iterations / indexed_time / 1e6);
+
+    json_index_free(&index);
+    json_arena_free(&arena);
+    return 0;
+}
+
+/**
+ * @brief Copies the `len` bytes of `json` without any whitespace outside
+ * of strings
+ */
+static char *minify(const char *json, size_t len)
+{
+    const char *end = json + len;
+    char *output = malloc(len + 1);
+    char *out = output;
+    _bool in_string = _false;
+
+    for (; json < end; json++)
+    {
+        if (in_string)
+        {
+            if (*json == '\\' && json + 1 < end)
+            {
+                *out++ = *json++;
+            }
+            else if (*json == '"')
+            {
+                in_string = _false;
+            }
+        }
+        else if (*json == '"')
+        {
+            in_string = _true;
+        }
+        else if (*json == ' ' || *json == '\n' || *json == '\r' || *json == '\t')
+        {
+            continue;
+        }
+
+        *out++ = *json;
+    }
+    *out = '\0';
+
+    return output;
+}
+
+/**
+ * @brief Re-indents minified JSON with one entry per line and `indent`
+ * spaces per level
+ */
+static char *prettify(const char *minified, int indent)
+{
+    size_t capacity = strlen(minified) * 4 + 64, len = 0;
+    char *output = malloc(capacity);
+    _bool in_string = _false;
+    int level = 0, i;
+
+    for (; *minified != '\0'; minified++)
+    {
+        char ch = *minified;
+
+        // The worst case adds a newline and a full indentation
+        if (capacity - len < (size_t)(indent * (level + 1) + 4))
+        {
+            capacity *= 2;
+            output = realloc(output, capacity);
+        }
+
+        if (in_string)
+        {
+            output[len++] = ch;
+            if (ch == '\\' && minified[1] != '\0')
+            {
+                output[len++] = *++minified;
+            }
+            else if (ch == '"')
+            {
+                in_string = _false;
+            }
+            continue;
+        }
+
+        if (ch == '}' || ch == ']')
+        {
+            level--;
+            output[len++] = '\n';
+            for (i = 0; i < indent * level; i++)
+            {
+                output[len++] = ' ';
+            }
+        }
+
+        output[len++] = ch;
+
+        if (ch == '"')
+        {
+            in_string = _true;
+        }
+        else if (ch == ':')
+        {
+            output[len++] = ' ';
+        }
+        else if (ch == '{' || ch == '[' || ch == ',')
+        {
+            if (ch != ',')
+            {
+                level++;
+            }
+            output[len++] = '\n';
+            for (i = 0; i < indent * level; i++)
+            {
+                output[len++] = ' ';
+            }
+        }
+    }
+    output[len] = '\0';
+
+    return output;
+}
+
+/**
+ * @brief Parses minified and pretty-printed versions of the same input
+ */
+static int bench_whitespace(const char *json, size_t len, int iterations)
+{
+    const char *names[] = {"minified", "pretty"};
+    char *inputs[2];
+    size_t v;
+
+    inputs[0] = minify(json, len);
+    inputs[1] = prettify(inputs[0], 4);
+
+    for (v = 0; v < 2; v++)
+    {
+        size_t input_len = strlen(inputs[v]);
+        double elapsed = 0;
+        int i;
+
+        for (i = 0; i < iterations; i++)
+        {
+            double start = now();
+            result(json_element) element_result = json_parse_n(inputs[v], input_len);
+            elapsed += now() - start;
+
+            if (result_is_err(json_element)(&element_result))
+            {
+                report_error(result_unwrap_err(json_element)(&element_result));
+                free(inputs[0]);
+                free(inputs[1]);
+                return -1;
+            }
+            typed(json_element) element = result_unwrap(json_element)(&element_result);
+            json_free(&element);
+        }
+
+        printf("%-8s  %9lu bytes  %8.3f ms  %8.1f MB/s\n", names[v], (unsigned long)input_len,
+               elapsed * 1e3 / iterations, input_len * iterations / elapsed / 1e6);
+    }
+
+    free(inputs[0]);
+    free(inputs[1]);
+    return 0;
+}
+
+/**
+ * @brief Builds an object nested `depth` levels deep. Every level holds a
+ * scalar entry on each side of its child, so the input grows linearly
+ * with the depth
+ */
+static char *make_nested(int depth)
+{
+    static const char open[] = "{\"id\":12345,\"name\":\"level\",\"child\":";
+    static const char close[] = ",\"tail\":[1,2,3]}";
+    size_t len = depth * (sizeof(open) - 1 + sizeof(close) - 1) + 1;
+    char *json = malloc(len + 1);
+    char *iter = json;
+    int i;
+
+    for (i = 0; i < depth; i++)
+    {
+        memcpy(iter, open, sizeof(open) - 1);
+        iter += sizeof(open) - 1;
+    }
+    *iter++ = '1';
+    for (i = 0; i < depth; i++)
+    {
+        memcpy(iter, close, sizeof(close) - 1);
+        iter += sizeof(close) - 1;
+    }
+    *iter = '\0';
+
+    return json;
+}
+
+/**
+ * @brief Parse time per input byte of synthetic nested documents. A
+ * parser that visits each byte a constant number of times stays flat
+ */
+static int bench_nested(const char *json, size_t len, int iterations)
+{
+    static const int depths[] = {1, 4, 16, 64, 256, 1024};
+    size_t d;
+
+    (void)json;
+    (void)len;
+    for (d = 0; d < sizeof(depths) / sizeof(depths[0]); d++)
+    {
+        char *nested = make_nested(depths[d]);
+        size_t nested_len = strlen(nested);
+        double elapsed = 0;
+        int i;
+
+        for (i = 0; i < iterations; i++)
+        {
+            double start = now();
+            result(json_element) element_result = json_parse(nested);
+            elapsed += now() - start;
+
+            if (result_is_err(json_element)(&element_result))
+            {
+                report_error(result_unwrap_err(json_element)(&element_result));
+                free(nested);
+                return -1;
+            }
+            typed(json_element) element = result_unwrap(json_element)(&element_result);
+            json_free(&element);
+        }
+
+        printf("depth %5d  %8lu bytes  %10.3f us  %7.2f ns/byte\n", depths[d], (unsigned long)nested_len,
+               elapsed * 1e6 / iterations, elapsed * 1e9 / iterations / nested_len);
+        free(nested);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Sums the numbers of a DOM, touching every node
+ */
+static double walk_dom(const json_element_t *element)
+{
+    double sum = 0;
+    size_t i;
+
+    switch (element->type)
+    {
+    case JSON_ELEMENT_TYPE_NUMBER:
+        if (element->value.as_number.type == JSON_NUMBER_TYPE_DOUBLE)
+            return element->value.as_number.value.as_double;
+        return (double)element->value.as_number.value.as_long;
+    case JSON_ELEMENT_TYPE_OBJECT:
+        for (i = 0; i < element->value.as_object->count; i++)
+            sum += walk_dom(element->value.as_object->shape != NULL ? &element->value.as_object->values[i]
+                                                                    : &element->value.as_object->entries[i].element);
+        return sum;
+    case JSON_ELEMENT_TYPE_ARRAY:
+        for (i = 0; i < element->value.as_array->count; i++)
+            sum += walk_dom(&element->value.as_array->elements[i]);
+        return sum;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Sums the numbers of a tape, touching every value
+ */
+static double walk_tape(json_tape_ref_t ref)
+{
+    double sum = 0;
+    json_tape_ref_t child;
+    json_number_t number;
+
+    switch (json_tape_type(ref))
+    {
+    case JSON_ELEMENT_TYPE_NUMBER:
+        number = json_tape_get_number(ref);
+        if (number.type == JSON_NUMBER_TYPE_DOUBLE)
+            return number.value.as_double;
+        return (double)number.value.as_long;
+    case JSON_ELEMENT_TYPE_OBJECT:
+        // Step over the key to each value
+        for (child = json_tape_first(ref); !json_tape_is_end(child); child = json_tape_next(child))
+        {
+            child = json_tape_next(child);
+            sum += walk_tape(child);
+        }
+        return sum;
+    case JSON_ELEMENT_TYPE_ARRAY:
+        for (child = json_tape_first(ref); !json_tape_is_end(child); child = json_tape_next(child))
+            sum += walk_tape(child);
+        return sum;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Sums the numbers of a frozen image, touching every value
+ */
+static double walk_image(json_image_ref_t ref)
+{
+    double sum = 0;
+    size_t i, count = json_image_count(ref);
+    result(json_image_ref) child;
+    result(json_number) number;
+
+    switch (json_image_type(ref))
+    {
+    case JSON_ELEMENT_TYPE_NUMBER:
+        number = json_image_get_number(ref);
+        if (result_unwrap(json_number)(&number).type == JSON_NUMBER_TYPE_DOUBLE)
+            return result_unwrap(json_number)(&number).value.as_double;
+        return (double)result_unwrap(json_number)(&number).value.as_long;
+    case JSON_ELEMENT_TYPE_OBJECT:
+        for (i = 0; i < count; i++)
+        {
+            child = json_image_object_value(ref, i);
+            if (result_is_ok(json_image_ref)(&child))
+                sum += walk_image(result_unwrap(json_image_ref)(&child));
+        }
+        return sum;
+    case JSON_ELEMENT_TYPE_ARRAY:
+        for (i = 0; i < count; i++)
+        {
+            child = json_image_array_get(ref, i);
+            if (result_is_ok(json_image_ref)(&child))
+                sum += walk_image(result_unwrap(json_image_ref)(&child));
+        }
+        return sum;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Compares building and walking the pointer DOM (in an arena)
+ * against the flat tape, both reused across iterations
+ */
+static int bench_tape(const char *json, size_t len, int iterations)
+{
+    json_parse_options_t options = {0};
+    json_arena_t arena;
+    json_tape_t tape = {0};
+    double dom_time = 0, dom_walk_time = 0, tape_time = 0, tape_walk_time = 0;
+    double dom_sum = 0, tape_sum = 0;
+    size_t dom_bytes = 0;
+    int i;
+
+    json_arena_init(&arena, 0);
+    options.arena = &arena;
+    for (i = 0; i < iterations; i++)
+    {
+        double start = now();
+        result(json_element) element_result = json_parse_ex(json, len, &options);
+        double parsed = now();
+
+        double tape_start = now();
+        result(json_tape_ref) root_result = json_tape_parse(&tape, json, len);
+        double tape_parsed = now();
+
+        if (result_is_err(json_element)(&element_result) || result_is_err(json_tape_ref)(&root_result))
+        {
+            report_error(result_is_err(json_element)(&element_result)
+                             ? result_unwrap_err(json_element)(&element_result)
+                             : result_unwrap_err(json_tape_ref)(&root_result));
+            json_arena_free(&arena);
+            json_tape_free(&tape);
+            return -1;
+        }
+        typed(json_element) element = result_unwrap(json_element)(&element_result);
+        json_tape_ref_t root = result_unwrap(json_tape_ref)(&root_result);
+
+        double walk_start = now();
+        dom_sum = walk_dom(&element);
+        double walked = now();
+        tape_sum = walk_tape(root);
+        double tape_walked = now();
+
+        dom_bytes = arena.bytes;
+        json_arena_reset(&arena);
+
+        dom_time += parsed - start;
+        tape_time += tape_parsed - tape_start;
+        dom_walk_time += walked - walk_start;
+        tape_walk_time += tape_walked - walked;
+    }
+
+    printf("dom:  parse %.3f ms  walk %.3f ms  %lu bytes  (sum %g)\n", dom_time * 1e3 / iterations,
+           dom_walk_time * 1e3 / iterations, (unsigned long)dom_bytes, dom_sum);
+    printf("tape: parse %.3f ms  walk %.3f ms  %lu bytes  (sum %g, %lu words)\n", tape_time * 1e3 / iterations,
+           tape_walk_time * 1e3 / iterations, (unsigned long)(tape.count * sizeof(uint64_t) + tape.strings_size),
+           tape_sum, (unsigned long)tape.count);
+
+    json_arena_free(&arena);
+    json_tape_free(&tape);
+    return 0;
+}
+
+/**
+ * @brief Adds a number, or the length of a string, to a checksum
+ */
+static double checksum_element(const json_element_t *element)
+{
+    if (element->type == JSON_ELEMENT_TYPE_STRING)
+        return (double)element->value.as_string.length;
+    if (element->type == JSON_ELEMENT_TYPE_NUMBER)
+        return element->value.as_number.type == JSON_NUMBER_TYPE_DOUBLE
+                   ? element->value.as_number.value.as_double
+                   : (double)element->value.as_number.value.as_long;
+    return 1;
+}
+
+/**
+ * @brief Like {checksum_element}, for an on-demand value
+ */
+static double checksum_value(json_value_t value)
+{
+    result(json_string_view) string_result = json_value_get_string(value);
+    if (result_is_ok(json_string_view)(&string_result))
+        return (double)result_unwrap(json_string_view)(&string_result).length;
+
+    result(json_number) number_result = json_value_get_number(value);
+    if (result_is_ok(json_number)(&number_result))
+    {
+        json_number_t number = result_unwrap(json_number)(&number_result);
+        return number.type == JSON_NUMBER_TYPE_DOUBLE ? number.value.as_double : (double)number.value.as_long;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reads `count` fields out of every object of a top-level array,
+ * through a full parse and through the on-demand API
+ */
+static int extract_fields(const char *json, size_t len, int iterations, const char **fields, size_t count)
+{
+    json_parse_options_t options = {0};
+    json_arena_t arena;
+    double dom_time = 0, ondemand_time = 0, dom_sum = 0, ondemand_sum = 0;
+    int i;
+    size_t f;
+
+    json_arena_init(&arena, 0);
+    options.arena = &arena;
+    for (i = 0; i < iterations; i++)
+    {
+        double start = now();
+        result(json_element) element_result = json_parse_ex(json, len, &options);
+        if (result_is_err(json_element)(&element_result))
+        {
+            report_error(result_unwrap_err(json_element)(&element_result));
+            json_arena_free(&arena);
+            return -1;
+        }
+        typed(json_element) root = result_unwrap(json_element)(&element_result);
+        size_t r;
+
+        dom_sum = 0;
+        for (r = 0; root.type == JSON_ELEMENT_TYPE_ARRAY && r < root.value.as_array->count; r++)
+        {
+            json_element_t *record = &root.value.as_array->elements[r];
+            if (record->type != JSON_ELEMENT_TYPE_OBJECT)
+                continue;
+
+            for (f = 0; f < count; f++)
+            {
+                result(json_element) field = json_object_find(record->value.as_object, fields[f]);
+                if (result_is_ok(json_element)(&field))
+                {
+                    json_element_t value = result_unwrap(json_element)(&field);
+                    dom_sum += checksum_element(&value);
+                }
+            }
+        }
+        json_arena_reset(&arena);
+        double parsed = now();
+
+        json_document_t document;
+        result(json_value) value_result = json_document_init(&document, json, len);
+        ondemand_sum = 0;
+        if (result_is_ok(json_value)(&value_result))
+            value_result = json_value_first(result_unwrap(json_value)(&value_result));
+
+        while (result_is_ok(json_value)(&value_result))
+        {
+            json_value_t record = result_unwrap(json_value)(&value_result);
+
+            for (f = 0; f < count; f++)
+            {
+                result(json_value) field = json_value_find(record, fields[f]);
+                if (result_is_ok(json_value)(&field))
+                    ondemand_sum += checksum_value(result_unwrap(json_value)(&field));
+            }
+
+            value_result = json_value_next(record);
+        }
+        json_document_free(&document);
+
+        dom_time += parsed - start;
+        ondemand_time += now() - parsed;
+    }
+
+    printf("  parse + find: %8.3f ms  %8.1f MB/s  (checksum %g)\n", dom_time * 1e3 / iterations,
+           len * iterations / dom_time / 1e6, dom_sum);
+    printf("  on demand:    %8.3f ms  %8.1f MB/s  (checksum %g)\n", ondemand_time * 1e3 / iterations,
+           len * iterations / ondemand_time / 1e6, ondemand_sum);
+
+    json_arena_free(&arena);
+    return 0;
+}
+
+/**
+ * @brief Field extraction from `big_array.json`-style records: a few
+ * fields near the start of each record, and the last one
+ */
+static int bench_ondemand(const char *json, size_t len, int iterations)
+{
+    static const char *first_fields[] = {"index", "isActive", "age"};
+    static const char *last_field[] = {"favoriteFruit"};
+
+    printf("fields index, isActive, age:\n");
+    if (extract_fields(json, len, iterations, first_fields, 3) != 0)
+        return -1;
+
+    printf("field favoriteFruit:\n");
+    return extract_fields(json, len, iterations, last_field, 1);
+}
+
+/**
+ * @brief Peak resident set size of the process so far, in KiB
+ */
+static long peak_rss(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/**
+ * @brief A `rows` x `columns` matrix of numbers, like the numeric
+ * arrays of `multidim_arr.json`. `kind` 0 gives integers, 1 short
+ * decimals and 2 doubles printed with all 17 digits
+ */
+static char *make_matrix(int rows, int columns, int kind)
+{
+    char *json = malloc((size_t)rows * columns * 26 + rows * 3 + 3);
+    char *iter = json;
+    unsigned long seed = 12345;
+    int r, c;
+
+    *iter++ = '[';
+    for (r = 0; r < rows; r++)
+    {
+        *iter++ = r > 0 ? ',' : '[';
+        if (r > 0)
+            *iter++ = '[';
+
+        for (c = 0; c < columns; c++)
+        {
+            seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+            long value = (long)((seed >> 33) % 2000000) - 1000000;
+
+            if (c > 0)
+                *iter++ = ',';
+            if (kind == 0)
+                iter += sprintf(iter, "%ld", value);
+            else if (kind == 1)
+                iter += sprintf(iter, "%.2f", value / 100.0);
+            else
+                iter += sprintf(iter, "%.17g", value / 7.0 * 1e-3);
+        }
+        *iter++ = ']';
+    }
+    *iter++ = ']';
+    *iter = '\0';
+
+    return json;
+}
+
+/**
+ * @brief Checks that numbers out of range or malformed are dropped as a
+ * whole token, leaving the `7` after them as the only element, and that
+ * the numbers around them parse to the expected value
+ */
+static int check_numbers(void)
+{
+    static const struct
+    {
+        const char *input;
+        double value;
+    } cases[] = {
+        {"[1e309,7]", 7},
+        {"[123456789012345678901234,7]", 7},
+        {"[9223372036854775808,7]", 7},
+        {"[4.9e-324,7]", 7},
+        {"[1.5e,7]", 7},
+        {"[.5]", 0.5},
+        {"[-.5]", -0.5},
+        {"[-9223372036854775808]", -9223372036854775807.0 - 1},
+    };
+    size_t c;
+
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        result(json_element) element_result = json_parse_n(cases[c].input, strlen(cases[c].input));
+        double value = 0;
+        size_t count = 0;
+
+        if (result_is_ok(json_element)(&element_result))
+        {
+            typed(json_element) element = result_unwrap(json_element)(&element_result);
+            json_array_t *array = element.value.as_array;
+            json_number_t number = array->elements[0].value.as_number;
+
+            count = array->count;
+            value = number.type == JSON_NUMBER_TYPE_DOUBLE ? number.value.as_double : (double)number.value.as_long;
+            json_free(&element);
+        }
+
+        if (count != 1 || value != cases[c].value)
+        {
+            fprintf(stderr, "%s parsed to %lu elements, the first %g, instead of %g\n", cases[c].input,
+                    (unsigned long)count, value, cases[c].value);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parses numeric matrices into an arena, next to what calling
+ * strtod on every number costs on its own, after checking the edge
+ * cases of the number parser
+ */
+static int bench_numbers(const char *json, size_t len, int iterations)
+{
+    static const char *kinds[] = {"integers", "decimals", "doubles"};
+    int kind;
+
+    (void)json;
+    (void)len;
+    if (check_numbers() != 0)
+        return -1;
+
+    for (kind = 0; kind < 3; kind++)
+    {
+        char *matrix = make_matrix(1000, 500, kind);
+        size_t matrix_len = strlen(matrix);
+        double parse_time = 0, strtod_time = 0, sum = 0;
+        json_arena_t arena;
+        int i;
+
+        json_arena_init(&arena, 0);
+        for (i = 0; i < iterations; i++)
+        {
+            double start = now();
+            result(json_element) element_result = json_parse_arena(matrix, &arena);
+            parse_time += now() - start;
+
+            if (result_is_err(json_element)(&element_result))
+            {
+                report_error(result_unwrap_err(json_element)(&element_result));
+                json_arena_free(&arena);
+                free(matrix);
+                return -1;
+            }
+            json_arena_reset(&arena);
+
+            const char *iter = matrix;
+            start = now();
+            while (*iter != '\0')
+            {
+                if (*iter == '-' || (*iter >= '0' && *iter <= '9'))
+                {
+                    char *number_end;
+                    sum += strtod(iter, &number_end);
+                    iter = number_end;
+                }
+                else
+                {
+                    iter++;
+                }
+            }
+            strtod_time += now() - start;
+        }
+        json_arena_free(&arena);
+
+        printf("%-8s  %8.3f ms  %8.1f MB/s  %6.1f M numbers/s   strtod alone %8.3f ms\n", kinds[kind],
+               parse_time * 1e3 / iterations, matrix_len * iterations / parse_time / 1e6,
+               500000.0 * iterations / parse_time / 1e6, strtod_time * 1e3 / iterations);
+        free(matrix);
+    }
+    return 0;
+}
+
+/**
+ * @brief An array of `count` strings of about 100 bytes. `kind` 0 gives
+ * plain ASCII, 1 sprinkles in `\n` and `\"`, and 2 writes accented
+ * names and emoji as `\u` escapes, surrogate pairs included
+ */
+static char *make_strings(int count, int kind)
+{
+    static const char *words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit"};
+    static const char *escapes[] = {"\\n", "\\\"", "\\t"};
+    static const char *unicode[] = {"Jos\\u00e9", "Mu\\u00f1oz", "\\u00c5ngstr\\u00f6m", "\\ud83d\\ude00", "\\u20ac5",
+                                    "\\u4e2d\\u6587"};
+    char *json = malloc((size_t)count * 160 + 3);
+    char *iter = json;
+    unsigned long seed = 12345;
+    int i;
+
+    *iter++ = '[';
+    for (i = 0; i < count; i++)
+    {
+        const char *start;
+
+        if (i > 0)
+            *iter++ = ',';
+        *iter++ = '"';
+        start = iter;
+        while (iter - start < 100)
+        {
+            seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+            unsigned long pick = seed >> 33;
+
+            if (iter > start)
+                *iter++ = ' ';
+            if (kind == 1 && pick % 4 == 0)
+                iter += sprintf(iter, "%s", escapes[pick / 4 % 3]);
+            else if (kind == 2 && pick % 3 == 0)
+                iter += sprintf(iter, "%s", unicode[pick / 3 % 6]);
+            else
+                iter += sprintf(iter, "%s", words[pick / 4 % 8]);
+        }
+        *iter++ = '"';
+    }
+    *iter++ = ']';
+    *iter = '\0';
+
+    return json;
+}
+
+/**
+ * @brief Parses arrays of strings into an arena, copying them out, and
+ * in place, where strings without escapes are not moved at all
+ */
+static int bench_strings(const char *json, size_t len, int iterations)
+{
+    static const char *kinds[] = {"plain", "escaped", "unicode"};
+    const int count = 200000;
+    int kind;
+
+    (void)json;
+    (void)len;
+    for (kind = 0; kind < 3; kind++)
+    {
+        char *strings = make_strings(count, kind);
+        size_t strings_len = strlen(strings);
+        char *copy = malloc(strings_len + 1);
+        double arena_time = 0, insitu_time = 0;
+        json_arena_t arena;
+        int i;
+
+        json_arena_init(&arena, 0);
+        for (i = 0; i < iterations; i++)
+        {
+            double start = now();
+            result(json_element) arena_result = json_parse_arena(strings, &arena);
+            arena_time += now() - start;
+            json_arena_reset(&arena);
+
+            memcpy(copy, strings, strings_len + 1);
+            start = now();
+            result(json_element) insitu_result = json_parse_insitu(copy, &arena);
+            insitu_time += now() - start;
+            json_arena_reset(&arena);
+
+            if (result_is_err(json_element)(&arena_result) || result_is_err(json_element)(&insitu_result))
+            {
+                report_error(result_is_err(json_element)(&arena_result)
+                                 ? result_unwrap_err(json_element)(&arena_result)
+                                 : result_unwrap_err(json_element)(&insitu_result));
+                json_arena_free(&arena);
+                free(copy);
+                free(strings);
+                return -1;
+            }
+        }
+        json_arena_free(&arena);
+
+        printf("%-8s  arena %8.3f ms  %8.1f MB/s   insitu %8.3f ms  %8.1f MB/s\n", kinds[kind],
+               arena_time * 1e3 / iterations, strings_len * iterations / arena_time / 1e6,
+               insitu_time * 1e3 / iterations, strings_len * iterations / insitu_time / 1e6);
+        free(copy);
+        free(strings);
+    }
+    return 0;
+}
+
+/**
+ * @brief Tallies of the events seen by the benchmark handler
+ */
+typedef struct sax_counts_s
+{
+    size_t containers;
+    size_t keys;
+    size_t scalars;
+    double sum;
+} sax_counts_t;
+
+static json_boolean_t sax_container(void *user)
+{
+    ((sax_counts_t *)user)->containers++;
+    return _true;
+}
+
+static json_boolean_t sax_key(void *user, json_string_view_t key)
+{
+    (void)key;
+    ((sax_counts_t *)user)->keys++;
+    return _true;
+}
+
+static json_boolean_t sax_string(void *user, json_string_view_t value)
+{
+    (void)value;
+    ((sax_counts_t *)user)->scalars++;
+    return _true;
+}
+
+static json_boolean_t sax_number(void *user, json_number_t value)
+{
+    sax_counts_t *counts = (sax_counts_t *)user;
+    counts->scalars++;
+    counts->sum += value.type == JSON_NUMBER_TYPE_DOUBLE ? value.value.as_double : (double)value.value.as_long;
+    return _true;
+}
+
+static json_boolean_t sax_boolean(void *user, json_boolean_t value)
+{
+    (void)value;
+    ((sax_counts_t *)user)->scalars++;
+    return _true;
+}
+
+static json_boolean_t sax_null(void *user)
+{
+    ((sax_counts_t *)user)->scalars++;
+    return _true;
+}
+
+/**
+ * @brief Compares the event parser against json_parse plus json_free.
+ * The event parser runs first, as the peak RSS only ever grows
+ */
+static int bench_sax(const char *json, size_t len, int iterations)
+{
+    static const json_sax_handler_t handler = {
+        sax_container, NULL, sax_container, NULL, sax_key, sax_string, sax_number, sax_boolean, sax_null};
+    sax_counts_t counts;
+    double sax_time = 0, dom_time = 0;
+    long baseline = peak_rss(), sax_peak, dom_peak;
+    int i;
+
+    for (i = 0; i < iterations; i++)
+    {
+        memset(&counts, 0, sizeof(counts));
+
+        double start = now();
+        result(size) end_result = json_sax_parse(json, len, &handler, &counts);
+        sax_time += now() - start;
+
+        if (result_is_err(size)(&end_result))
+        {
+            report_error(result_unwrap_err(size)(&end_result));
+            return -1;
+        }
+    }
+    sax_peak = peak_rss();
+
+    for (i = 0; i < iterations; i++)
+    {
+        double start = now();
+        result(json_element) element_result = json_parse_n(json, len);
+        if (result_is_err(json_element)(&element_result))
+        {
+            report_error(result_unwrap_err(json_element)(&element_result));
+            return -1;
+        }
+        typed(json_element) element = result_unwrap(json_element)(&element_result);
+        json_free(&element);
+        dom_time += now() - start;
+    }
+    dom_peak = peak_rss();
+
+    printf("sax:        %8.3f ms  %8.1f MB/s  peak RSS +%ld KiB  (%lu containers, %lu keys, %lu scalars)\n",
+           sax_time * 1e3 / iterations, len * iterations / sax_time / 1e6, sax_peak - baseline,
+           (unsigned long)counts.containers, (unsigned long)counts.keys, (unsigned long)counts.scalars);
+    printf("parse+free: %8.3f ms  %8.1f MB/s  peak RSS +%ld KiB\n", dom_time * 1e3 / iterations,
+           len * iterations / dom_time / 1e6, dom_peak - baseline);
+    return 0;
+}
+
+/**
+ * @brief Feeds the input to the chunked parser in pieces of growing
+ * size, as a reader would hand over what arrived, and compares it to
+ * one json_sax_parse call over the whole input
+ */
+static int bench_stream(const char *json, size_t len, int iterations)
+{
+    static const json_sax_handler_t handler = {
+        sax_container, NULL, sax_container, NULL, sax_key, sax_string, sax_number, sax_boolean, sax_null};
+    static const size_t chunk_sizes[] = {1, 16, 4096, 65536};
+    sax_counts_t counts, whole;
+    double whole_time = 0;
+    long baseline = peak_rss();
+    size_t c;
+    int i;
+
+    for (i = 0; i < iterations; i++)
+    {
+        memset(&counts, 0, sizeof(counts));
+
+        double start = now();
+        result(size) end_result = json_sax_parse(json, len, &handler, &counts);
+        whole_time += now() - start;
+
+        if (result_is_err(size)(&end_result))
+        {
+            report_error(result_unwrap_err(size)(&end_result));
+            return -1;
+        }
+    }
+
+    // Every chunk size has to see exactly the events of the whole input
+    whole = counts;
+    printf("whole:        %8.3f ms  %8.1f MB/s\n", whole_time * 1e3 / iterations, len * iterations / whole_time / 1e6);
+
+    for (c = 0; c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); c++)
+    {
+        double stream_time = 0;
+
+        for (i = 0; i < iterations; i++)
+        {
+            json_parser_t parser;
+            size_t offset;
+
+            memset(&counts, 0, sizeof(counts));
+
+            double start = now();
+            json_parser_init(&parser, &handler, &counts);
+            for (offset = 0; offset < len; offset += chunk_sizes[c])
+            {
+                size_t chunk = len - offset < chunk_sizes[c] ? len - offset : chunk_sizes[c];
+                result(size) fed_result = json_parser_feed(&parser, json + offset, chunk);
+                if (result_is_err(size)(&fed_result))
+                {
+                    break;
+                }
+            }
+            result(size) end_result = json_parser_finish(&parser);
+            json_parser_free(&parser);
+            stream_time += now() - start;
+
+            if (result_is_err(size)(&end_result))
+            {
+                report_error(result_unwrap_err(size)(&end_result));
+                return -1;
+            }
+        }
+
+        printf("chunks of %-5lu %8.3f ms  %8.1f MB/s  (%lu containers, %lu keys, %lu scalars)\n",
+               (unsigned long)chunk_sizes[c], stream_time * 1e3 / iterations, len * iterations / stream_time / 1e6,
+               (unsigned long)counts.containers, (unsigned long)counts.keys, (unsigned long)counts.scalars);
+
+        if (counts.containers != whole.containers || counts.keys != whole.keys || counts.scalars != whole.scalars ||
+            counts.sum != whole.sum)
+        {
+            fprintf(stderr, "Chunks of %lu differ from the whole input: %lu containers, %lu keys, %lu scalars, sum %g"
+                            " instead of %lu, %lu, %lu, %g\n",
+                    (unsigned long)chunk_sizes[c], (unsigned long)counts.containers, (unsigned long)counts.keys,
+                    (unsigned long)counts.scalars, counts.sum, (unsigned long)whole.containers,
+                    (unsigned long)whole.keys, (unsigned long)whole.scalars, whole.sum);
+            return -1;
+        }
+    }
+
+    printf("peak RSS +%ld KiB\n", peak_rss() - baseline);
+    return 0;
+}
+
+/**
+ * @brief Turns the elements of a top-level array into NDJSON lines and
+ * repeats them until there are at least `min_size` bytes. Input that
+ * is not an array is taken to be NDJSON already
+ */
+static char *make_ndjson(const char *json, size_t len, size_t min_size, size_t *ndjson_len)
+{
+    char *lines = malloc(len + 2);
+    size_t lines_len = 0;
+    json_document_t document;
+    result(json_value) value_result = json_document_init(&document, json, len);
+
+    if (lines == NULL)
+        return NULL;
+
+    if (result_is_ok(json_value)(&value_result) && *result_unwrap(json_value)(&value_result).ptr == '[')
+    {
+        const char *close = json + len;
+
+        while (close > json && *close != ']')
+            close--;
+        value_result = json_value_first(result_unwrap(json_value)(&value_result));
+
+        while (result_is_ok(json_value)(&value_result))
+        {
+            json_value_t element = result_unwrap(json_value)(&value_result);
+            const char *end;
+            size_t i;
+
+            value_result = json_value_next(element);
+            end = result_is_ok(json_value)(&value_result) ? result_unwrap(json_value)(&value_result).ptr : close;
+
+            // Drop the separator and the whitespace around it
+            while (end > element.ptr && (end[-1] == ',' || end[-1] == ']' || strchr(" \t\r\n", end[-1]) != NULL))
+                end--;
+
+            // Raw newlines can only be whitespace between tokens
+            for (i = 0; element.ptr + i < end; i++)
+                lines[lines_len++] = element.ptr[i] == '\n' || element.ptr[i] == '\r' ? ' ' : element.ptr[i];
+            lines[lines_len++] = '\n';
+        }
+    }
+    else
+    {
+        memcpy(lines, json, len);
+        lines_len = len;
+        if (lines_len == 0 || lines[lines_len - 1] != '\n')
+            lines[lines_len++] = '\n';
+    }
+    json_document_free(&document);
+
+    size_t copies = (min_size + lines_len - 1) / lines_len;
+    char *ndjson = malloc(copies * lines_len + 1);
+    size_t c;
+
+    if (ndjson != NULL)
+    {
+        for (c = 0; c < copies; c++)
+            memcpy(ndjson + c * lines_len, lines, lines_len);
+        ndjson[copies * lines_len] = '\0';
+        *ndjson_len = copies * lines_len;
+    }
+
+    free(lines);
+    return ndjson;
+}
+
+/**
+ * @brief Tallies of the records seen by the NDJSON benchmark
+ */
+typedef struct ndjson_counts_s
+{
+    size_t records;
+    size_t errors;
+    size_t last_offset;
+    size_t out_of_order;
+} ndjson_counts_t;
+
+static json_boolean_t ndjson_record(void *user, size_t offset, result(json_element) record)
+{
+    ndjson_counts_t *counts = (ndjson_counts_t *)user;
+
+    counts->records++;
+    if (result_is_err(json_element)(&record))
+        counts->errors++;
+    if (offset < counts->last_offset)
+        counts->out_of_order++;
+    counts->last_offset = offset;
+    return _true;
+}
+
+/**
+ * @brief Parses the records of the input as NDJSON on 1 up to as many
+ * threads as there are online cores, in order and out of order
+ */
+static int bench_ndjson(const char *json, size_t len, int iterations)
+{
+    size_t ndjson_len;
+    char *ndjson = make_ndjson(json, len, 64 * 1024 * 1024, &ndjson_len);
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = cores > 1 ? (size_t)cores : 1;
+    double base_time = 0;
+    size_t threads;
+    int ordered;
+
+    if (ndjson == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for NDJSON\n");
+        return -1;
+    }
+
+    printf("%lu bytes of NDJSON, %ld online cores\n", (unsigned long)ndjson_len, cores);
+
+    // Powers of two up to the number of cores, and that number itself
+    for (threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads)
+    {
+        for (ordered = 1; ordered >= 0; ordered--)
+        {
+            json_ndjson_options_t options = {0};
+            ndjson_counts_t counts;
+            double elapsed = 0;
+            int i;
+
+            options.threads = threads;
+            options.ordered = ordered;
+
+            for (i = 0; i < iterations; i++)
+            {
+                memset(&counts, 0, sizeof(counts));
+
+                double start = now();
+                result(size) records_result = json_ndjson_parse(ndjson, ndjson_len, &options, ndjson_record, &counts);
+                elapsed += now() - start;
+
+                if (result_is_err(size)(&records_result))
+                {
+                    report_error(result_unwrap_err(size)(&records_result));
+                    free(ndjson);
+                    return -1;
+                }
+            }
+
+            if (threads == 1 && ordered)
+                base_time = elapsed;
+
+            printf("%2lu threads %-9s %8.3f ms  %8.1f MB/s  x%.2f  (%lu records, %lu errors, %lu out of order)\n",
+                   (unsigned long)threads, ordered ? "ordered" : "unordered", elapsed * 1e3 / iterations,
+                   ndjson_len * iterations / elapsed / 1e6, base_time / elapsed, (unsigned long)counts.records,
+                   (unsigned long)counts.errors, (unsigned long)counts.out_of_order);
+        }
+
+        if (threads == max_threads)
+            break;
+    }
+
+    free(ndjson);
+    return 0;
+}
+
+/**
+ * @brief Parses the input, grown to a large top-level array, on one
+ * thread and then on 1 up to as many threads as there are online cores
+ */
+static int bench_parallel(const char *json, size_t len, int iterations)
+{
+    size_t lines_len, c;
+    char *lines = make_ndjson(json, len, 64 * 1024 * 1024, &lines_len);
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = cores > 1 ? (size_t)cores : 1;
+    json_parse_options_t options = {0};
+    json_arena_t arena;
+    double serial_time = 0;
+    size_t serial_count = 0;
+    size_t threads;
+    int i;
+
+    if (lines == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for the array\n");
+        return -1;
+    }
+
+    // One record per line, so the newlines become the commas
+    char *array = malloc(lines_len + 2);
+    if (array == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for the array\n");
+        free(lines);
+        return -1;
+    }
+    array[0] = '[';
+    for (c = 0; c < lines_len; c++)
+        array[c + 1] = lines[c] == '\n' ? ',' : lines[c];
+    array[lines_len] = ']';
+    array[lines_len + 1] = '\0';
+    free(lines);
+
+    size_t array_len = lines_len + 1;
+    printf("%lu byte array, %ld online cores\n", (unsigned long)array_len, cores);
+
+    // The first parse grows the arena, which later ones reuse
+    json_arena_init(&arena, 0);
+    options.arena = &arena;
+    json_parse_ex(array, array_len, &options);
+    json_arena_reset(&arena);
+
+    for (i = 0; i < iterations; i++)
+    {
+        double start = now();
+        result(json_element) element_result = json_parse_ex(array, array_len, &options);
+        serial_time += now() - start;
+
+        if (result_is_err(json_element)(&element_result))
+        {
+            report_error(result_unwrap_err(json_element)(&element_result));
+            json_arena_free(&arena);
+            free(array);
+            return -1;
+        }
+        serial_count = result_unwrap(json_element)(&element_result).value.as_array->count;
+        json_arena_reset(&arena);
+    }
+
+    printf("json_parse_ex        %8.3f ms  %8.1f MB/s  (%lu elements)\n", serial_time * 1e3 / iterations,
+           array_len * iterations / serial_time / 1e6, (unsigned long)serial_count);
+
+    // Powers of two up to the number of cores, and that number itself
+    for (threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads)
+    {
+        double parallel_time = 0;
+        size_t count = 0;
+
+        for (i = 0; i < iterations; i++)
+        {
+            double start = now();
+            result(json_element) element_result = json_parse_parallel(array, array_len, &arena, threads);
+            parallel_time += now() - start;
+
+            if (result_is_err(json_element)(&element_result))
+            {
+                report_error(result_unwrap_err(json_element)(&element_result));
+                json_arena_free(&arena);
+                free(array);
+                return -1;
+            }
+            count = result_unwrap(json_element)(&element_result).value.as_array->count;
+            json_arena_reset(&arena);
+        }
+
+        printf("parallel, %2lu threads %8.3f ms  %8.1f MB/s  x%.2f  (%lu elements)\n", (unsigned long)threads,
+               parallel_time * 1e3 / iterations, array_len * iterations / parallel_time / 1e6, serial_time / parallel_time,
+               (unsigned long)count);
+
+        if (threads == max_threads)
+            break;
+    }
+
+    json_arena_free(&arena);
+    free(array);
+    return 0;
+}
+
+/**
+ * @brief Makes the name of key `i` of the lookup benchmark, of varying
+ * length like the keys of real documents
+ */
+static int make_key(char *buffer, int i)
+{
+    static const char *prefixes[] = {"id", "user_name", "created_at_timestamp", "x"};
+    return sprintf(buffer, "%s_%d", prefixes[i % 4], i);
+}
+
+/**
+ * @brief Looks keys up in objects of 4 to 10k keys, all of them in a
+ * shuffled order and as many that are missing
+ */
+static int bench_lookup(const char *json, size_t len, int iterations)
+{
+    static const int sizes[] = {4, 16, 64, 256, 1024, 10000};
+    const size_t lookups = 1000000;
+    size_t s;
+
+    (void)json;
+    (void)len;
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        const int size = sizes[s];
+        char *object = malloc((size_t)size * 40 + 2);
+        char **keys = malloc(2 * (size_t)size * sizeof(char *));
+        char *iter = object;
+        double hit_time = 0, miss_time = 0, sum = 0;
+        size_t found = 0;
+        json_arena_t arena;
+        int i, k;
+
+        if (object == NULL || keys == NULL)
+        {
+            fprintf(stderr, "Unable to allocate memory for the object\n");
+            free(object);
+            free(keys);
+            return -1;
+        }
+
+        // The first half of the keys is in the object, the second is not
+        *iter++ = '{';
+        for (k = 0; k < 2 * size; k++)
+        {
+            char name[40];
+            make_key(name, k);
+            keys[k] = strdup(name);
+            if (k < size)
+                iter += sprintf(iter, "%s\"%s\":%d", k > 0 ? "," : "", name, k);
+        }
+        *iter++ = '}';
+        *iter = '\0';
+
+        // Shuffle the keys present, and the missing ones
+        unsigned long seed = 42;
+        for (k = size - 1; k > 0; k--)
+        {
+            seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+            int other = (int)((seed >> 33) % (unsigned long)(k + 1));
+            char *temp = keys[k];
+            keys[k] = keys[other];
+            keys[other] = temp;
+        }
+
+        json_arena_init(&arena, 0);
+        result(json_element) element_result = json_parse_arena(object, &arena);
+        if (result_is_err(json_element)(&element_result))
+        {
+            report_error(result_unwrap_err(json_element)(&element_result));
+            json_arena_free(&arena);
+            for (k = 0; k < 2 * size; k++)
+                free(keys[k]);
+            free(keys);
+            free(object);
+            return -1;
+        }
+        json_object_t *parsed = result_unwrap(json_element)(&element_result).value.as_object;
+
+        for (i = 0; i < iterations; i++)
+        {
+            size_t l;
+            double start = now();
+            for (l = 0; l < lookups; l++)
+            {
+                result(json_element) field = json_object_find(parsed, keys[l % size]);
+                if (result_is_ok(json_element)(&field))
+                {
+                    sum += result_unwrap(json_element)(&field).value.as_number.value.as_long;
+                    found++;
+                }
+            }
+            double hits = now();
+            for (l = 0; l < lookups; l++)
+            {
+                result(json_element) field = json_object_find(parsed, keys[size + l % size]);
+                found += result_is_ok(json_element)(&field);
+            }
+            hit_time += hits - start;
+            miss_time += now() - hits;
+        }
 
-  if (buffer == NULL) {
-    fprintf(stderr, "Unable to allocate memory for file");
-    fclose(file);
-    return NULL;
-  }
+        printf("%5d keys  hit %7.1f ns  miss %7.1f ns  (found %lu, checksum %g)\n", size,
+               hit_time * 1e9 / lookups / iterations, miss_time * 1e9 / lookups / iterations,
+               (unsigned long)found, sum);
 
-  fread(buffer, 1, len, file);
-  buffer[len] = '\0';
-  return (const char *)buffer;
+        json_arena_free(&arena);
+        for (k = 0; k < 2 * size; k++)
+            free(keys[k]);
+        free(keys);
+        free(object);
+    }
+    return 0;
 }
 
-static const char *default_file = "..\\multidim_arr.json";
+/**
+ * @brief Flush callback counting the bytes it is handed, like writing
+ * them to a file with no cost
+ */
+static json_boolean_t count_flushed(void *user, json_string_t data, size_t len)
+{
+    (void)data;
+    *(size_t *)user += len;
+    return _true;
+}
 
-int main(int argc, char **argv)
+/**
+ * @brief Serializes the parsed input compact and pretty into a reused
+ * buffer and through a flush callback, next to copying the same number
+ * of bytes with memcpy
+ */
+static int bench_serialize(const char *json, size_t len, int iterations)
 {
-    const char *file_name;
-    if (argc > 0)
+    static const char *names[] = {"compact", "pretty"};
+    json_parse_options_t options = {0};
+    json_arena_t arena;
+    json_writer_t writer;
+    int style, i;
+
+    json_arena_init(&arena, 0);
+    options.arena = &arena;
+    result(json_element) element_result = json_parse_ex(json, len, &options);
+    if (result_is_err(json_element)(&element_result))
     {
-        file_name = argv[1];
+        report_error(result_unwrap_err(json_element)(&element_result));
+        json_arena_free(&arena);
+        return -1;
     }
-    else
+    typed(json_element) element = result_unwrap(json_element)(&element_result);
+
+    for (style = 0; style < 2; style++)
     {
-        file_name = default_file;
+        const int indent = style == 0 ? 0 : 2;
+        double buffer_time = 0, flush_time = 0, copy_time = 0;
+        size_t len = 0, flushed = 0;
+
+        // The first call grows the buffer, which later ones reuse
+        json_writer_init(&writer, NULL, NULL);
+        json_serialize(&element, &writer, indent);
+
+        for (i = 0; i < iterations; i++)
+        {
+            writer.size = 0;
+            double start = now();
+            result(size) size_result = json_serialize(&element, &writer, indent);
+            buffer_time += now() - start;
+
+            if (result_is_err(size)(&size_result))
+            {
+                report_error(result_unwrap_err(size)(&size_result));
+                json_writer_free(&writer);
+                json_arena_free(&arena);
+                return -1;
+            }
+            len = result_unwrap(size)(&size_result);
+        }
+
+        char *copy = malloc(len);
+        if (copy == NULL)
+        {
+            fprintf(stderr, "Unable to allocate memory for the copy\n");
+            json_writer_free(&writer);
+            json_arena_free(&arena);
+            return -1;
+        }
+        // Touch the pages once, and compare the copy so it is kept
+        memcpy(copy, writer.data, len);
+        for (i = 0; i < iterations; i++)
+        {
+            double start = now();
+            memcpy(copy, writer.data, len);
+            copy_time += now() - start;
+        }
+        if (memcmp(copy, writer.data, len) != 0)
+            fprintf(stderr, "Copy differs\n");
+        free(copy);
+        json_writer_free(&writer);
+
+        json_writer_init(&writer, count_flushed, &flushed);
+        for (i = 0; i < iterations; i++)
+        {
+            double start = now();
+            json_serialize(&element, &writer, indent);
+            flush_time += now() - start;
+        }
+        json_writer_free(&writer);
+
+        printf("%-8s %9lu bytes  buffer %8.3f ms  %8.1f MB/s   flushed %8.3f ms  %8.1f MB/s   memcpy %8.3f ms\n",
+               names[style], (unsigned long)len, buffer_time * 1e3 / iterations,
+               len * iterations / buffer_time / 1e6, flush_time * 1e3 / iterations,
+               flushed / flush_time / 1e6, copy_time * 1e3 / iterations);
+    }
+
+    json_arena_free(&arena);
+    return 0;
+}
+
+/**
+ * @brief Parses the input with the heap allocator and into an arena,
+ * copying every key and then taking keys from one pool shared by all
+ * iterations
+ */
+static int bench_keys(const char *json, size_t len, int iterations)
+{
+    static const char *names[] = {"copied", "pooled"};
+    json_key_pool_t pool;
+    json_arena_t arena;
+    json_alloc_stats_t stats;
+    int pooled, i;
+
+    for (pooled = 0; pooled < 2; pooled++)
+    {
+        json_parse_options_t options = {0};
+        double heap_time = 0, arena_time = 0;
+        size_t arena_bytes = 0;
+
+        json_key_pool_init(&pool);
+        if (pooled)
+        {
+            options.keys = &pool;
+        }
+
+        json_alloc_stats_reset();
+        for (i = 0; i < iterations; i++)
+        {
+            double start = now();
+            result(json_element) element_result = json_parse_ex(json, len, &options);
+            heap_time += now() - start;
+
+            if (result_is_err(json_element)(&element_result))
+            {
+                report_error(result_unwrap_err(json_element)(&element_result));
+                json_key_pool_free(&pool);
+                return -1;
+            }
+            typed(json_element) element = result_unwrap(json_element)(&element_result);
+            if (pooled)
+            {
+                json_free_interned(&element);
+            }
+            else
+            {
+                json_free(&element);
+            }
+        }
+        json_alloc_stats(&stats);
+
+        json_arena_init(&arena, 0);
+        options.arena = &arena;
+        for (i = 0; i < iterations; i++)
+        {
+            double start = now();
+            result(json_element) element_result = json_parse_ex(json, len, &options);
+            arena_time += now() - start;
+
+            if (result_is_err(json_element)(&element_result))
+            {
+                report_error(result_unwrap_err(json_element)(&element_result));
+                json_arena_free(&arena);
+                json_key_pool_free(&pool);
+                return -1;
+            }
+            arena_bytes = arena.bytes;
+            json_arena_reset(&arena);
+        }
+        json_arena_free(&arena);
+
+        printf("%s: heap parse %.3f ms  mallocs %lu  bytes %lu   arena parse %.3f ms  bytes %lu   pool keys %lu  bytes %lu\n",
+               names[pooled], heap_time * 1e3 / iterations, (unsigned long)(stats.allocs / iterations),
+               (unsigned long)(stats.bytes / iterations), arena_time * 1e3 / iterations,
+               (unsigned long)arena_bytes, (unsigned long)pool.count, (unsigned long)pool.arena.bytes);
+        json_key_pool_free(&pool);
     }
 
-    const char *json = read_file(file_name);
+    return 0;
+}
+
+/**
+ * @brief An array of `count` records with the same eight keys, like a
+ * table exported row by row
+ */
+static char *make_records(int count)
+{
+    char *json = malloc((size_t)count * 200 + 3);
+    char *iter = json;
+    int i;
+
     if (json == NULL)
+        return NULL;
+
+    *iter++ = '[';
+    for (i = 0; i < count; i++)
+    {
+        iter += sprintf(iter,
+                        "%s{\"id\":%d,\"name\":\"user_%d\",\"email\":\"user_%d@example.com\",\"active\":%s,"
+                        "\"score\":%d.5,\"group\":\"g%d\",\"tags\":[\"a\",\"b\"],\"balance\":%d}",
+                        i > 0 ? "," : "", i, i, i, i % 2 ? "true" : "false", i % 100, i % 7, i * 3);
+    }
+    *iter++ = ']';
+    *iter = '\0';
+    return json;
+}
+
+/**
+ * @brief Parses 100k identical records into an arena with copied keys,
+ * pooled keys and shapes, then reads four fields of every record by
+ * name and, with shapes, through a position looked up once per shape.
+ * Every way of reading them has to give the same checksum
+ */
+static int bench_shapes(const char *json, size_t len, int iterations)
+{
+    static const char *names[] = {"copied", "pooled", "shapes"};
+    static const char *fields[] = {"id", "score", "group", "balance"};
+    const int records = 100000;
+    const size_t field_count = sizeof(fields) / sizeof(fields[0]);
+    char *input = make_records(records);
+    size_t input_len;
+    double expected = 0;
+    int config, i;
+
+    (void)json;
+    (void)len;
+    if (input == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for the records\n");
+        return -1;
+    }
+    input_len = strlen(input);
+
+    for (config = 0; config < 3; config++)
+    {
+        json_parse_options_t options = {0};
+        json_key_pool_t pool;
+        json_shape_table_t shapes;
+        json_arena_t arena;
+        double parse_time = 0, find_time = 0, slot_time = 0, sum = 0, slot_sum = 0;
+        size_t bytes = 0, found = 0;
+
+        json_key_pool_init(&pool);
+        json_shape_table_init(&shapes);
+        json_arena_init(&arena, 0);
+        options.arena = &arena;
+        if (config == 1)
+            options.keys = &pool;
+        if (config == 2)
+            options.shapes = &shapes;
+
+        for (i = 0; i < iterations; i++)
+        {
+            json_arena_reset(&arena);
+            double start = now();
+            result(json_element) element_result = json_parse_ex(input, input_len, &options);
+            double parsed = now();
+
+            if (result_is_err(json_element)(&element_result))
+            {
+                report_error(result_unwrap_err(json_element)(&element_result));
+                json_arena_free(&arena);
+                json_shape_table_free(&shapes);
+                json_key_pool_free(&pool);
+                free(input);
+                return -1;
+            }
+            json_array_t *array = result_unwrap(json_element)(&element_result).value.as_array;
+            size_t r, f;
+
+            for (r = 0; r < array->count; r++)
+            {
+                for (f = 0; f < field_count; f++)
+                {
+                    result(json_element) field = json_object_find(array->elements[r].value.as_object, fields[f]);
+                    if (result_is_ok(json_element)(&field))
+                    {
+                        typed(json_element) value = result_unwrap(json_element)(&field);
+                        sum += checksum_element(&value);
+                        found++;
+                    }
+                }
+            }
+            double found_all = now();
+
+            // One shape check per record, then a load per field
+            if (config == 2)
+            {
+                const json_shape_t *shape = NULL;
+                size_t slots[sizeof(fields) / sizeof(fields[0])];
+
+                for (r = 0; r < array->count; r++)
+                {
+                    const json_object_t *record = array->elements[r].value.as_object;
+                    if (record->shape != shape)
+                    {
+                        shape = record->shape;
+                        for (f = 0; f < field_count; f++)
+                        {
+                            result(size) slot = json_shape_find(shape, fields[f], strlen(fields[f]));
+                            slots[f] = result_unwrap(size)(&slot);
+                        }
+                    }
+                    for (f = 0; f < field_count; f++)
+                        slot_sum += checksum_element(&record->values[slots[f]]);
+                }
+            }
+
+            parse_time += parsed - start;
+            find_time += found_all - parsed;
+            slot_time += now() - found_all;
+            bytes = arena.bytes;
+        }
+
+        printf("%s: parse %.3f ms  bytes %lu (%.1f per record)  find %.1f ns",
+               names[config], parse_time * 1e3 / iterations, (unsigned long)bytes,
+               (double)bytes / records, find_time * 1e9 / iterations / records / field_count);
+        if (config == 2)
+            printf("  shape slot %.1f ns  shapes %lu", slot_time * 1e9 / iterations / records / field_count,
+                   (unsigned long)shapes.count);
+        printf("  (found %lu, checksum %g)\n", (unsigned long)found, sum);
+
+        json_arena_free(&arena);
+        json_shape_table_free(&shapes);
+        json_key_pool_free(&pool);
+
+        if (config == 0)
+            expected = sum;
+        if (sum != expected || (config == 2 && slot_sum != expected))
+        {
+            fprintf(stderr, "%s: checksum %g, through shape slots %g, instead of %g\n", names[config], sum,
+                    slot_sum, expected);
+            free(input);
+            return -1;
+        }
+    }
+
+    free(input);
+    return 0;
+}
+
+/**
+ * @brief Reads /friends/2/name and /balance out of every record of a
+ * top-level array: with a `json_object_find` per level and with compiled
+ * paths, from a DOM and from the raw text, and finally as absolute
+ * paths /N/friends/2/name and /N/balance resolved in a single pass
+ */
+static int bench_paths(const char *json, size_t len, int iterations)
+{
+    static const char *relative[] = {"/friends/2/name", "/balance"};
+    json_path_t paths[2];
+    json_path_t *absolute;
+    json_value_t *values;
+    json_parse_options_t options = {0};
+    json_arena_t arena;
+    double times[6] = {0}, sums[6] = {0};
+    size_t records = 0, r;
+    int i, p;
+
+    json_arena_init(&arena, 0);
+    options.arena = &arena;
+    for (p = 0; p < 2; p++)
+    {
+        result(json_path) path_result = json_path_compile(relative[p]);
+        paths[p] = result_unwrap(json_path)(&path_result);
+    }
+
+    result(json_element) element_result = json_parse_ex(json, len, &options);
+    if (result_is_err(json_element)(&element_result))
+    {
+        report_error(result_unwrap_err(json_element)(&element_result));
+        json_path_free(&paths[0]);
+        json_path_free(&paths[1]);
+        json_arena_free(&arena);
+        return -1;
+    }
+    typed(json_element) root = result_unwrap(json_element)(&element_result);
+    if (root.type != JSON_ELEMENT_TYPE_ARRAY)
+    {
+        fprintf(stderr, "Expected an array of records\n");
+        json_path_free(&paths[0]);
+        json_path_free(&paths[1]);
+        json_arena_free(&arena);
+        return -1;
+    }
+    records = root.value.as_array->count;
+
+    absolute = malloc(2 * records * sizeof(json_path_t));
+    values = malloc(2 * records * sizeof(json_value_t));
+    if (absolute == NULL || values == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for the paths\n");
+        free(absolute);
+        free(values);
+        json_path_free(&paths[0]);
+        json_path_free(&paths[1]);
+        json_arena_free(&arena);
+        return -1;
+    }
+    double start = now();
+    for (r = 0; r < records; r++)
+    {
+        char pointer[64];
+        for (p = 0; p < 2; p++)
+        {
+            sprintf(pointer, "/%lu%s", (unsigned long)r, relative[p]);
+            result(json_path) path_result = json_path_compile(pointer);
+            absolute[2 * r + p] = result_unwrap(json_path)(&path_result);
+        }
+    }
+    double compile_time = now() - start;
+
+    for (i = 0; i < iterations; i++)
+    {
+        json_document_t document;
+        result(json_value) document_result = json_document_init(&document, json, len);
+        json_value_t document_root = result_unwrap(json_value)(&document_result);
+        double marks[7];
+
+        marks[0] = now();
+        for (r = 0; r < records; r++)
+        {
+            json_element_t *record = &root.value.as_array->elements[r];
+            result(json_element) field = json_object_find(record->value.as_object, "friends");
+            if (result_is_ok(json_element)(&field) &&
+                result_unwrap(json_element)(&field).type == JSON_ELEMENT_TYPE_ARRAY &&
+                result_unwrap(json_element)(&field).value.as_array->count > 2)
+            {
+                json_element_t friend = result_unwrap(json_element)(&field).value.as_array->elements[2];
+                field = json_object_find(friend.value.as_object, "name");
+                if (result_is_ok(json_element)(&field))
+                {
+                    json_element_t value = result_unwrap(json_element)(&field);
+                    sums[0] += checksum_element(&value);
+                }
+            }
+            field = json_object_find(record->value.as_object, "balance");
+            if (result_is_ok(json_element)(&field))
+            {
+                json_element_t value = result_unwrap(json_element)(&field);
+                sums[0] += checksum_element(&value);
+            }
+        }
+
+        marks[1] = now();
+        for (r = 0; r < records; r++)
+        {
+            for (p = 0; p < 2; p++)
+            {
+                result(json_element) field = json_path_find(&root.value.as_array->elements[r], &paths[p]);
+                if (result_is_ok(json_element)(&field))
+                {
+                    json_element_t value = result_unwrap(json_element)(&field);
+                    sums[1] += checksum_element(&value);
+                }
+            }
+        }
+
+        marks[2] = now();
+        result(json_value) record_result = json_value_first(document_root);
+        while (result_is_ok(json_value)(&record_result))
+        {
+            json_value_t record = result_unwrap(json_value)(&record_result);
+            result(json_value) field = json_value_find(record, "friends");
+            if (result_is_ok(json_value)(&field))
+                field = json_value_at(result_unwrap(json_value)(&field), 2);
+            if (result_is_ok(json_value)(&field))
+                field = json_value_find(result_unwrap(json_value)(&field), "name");
+            if (result_is_ok(json_value)(&field))
+                sums[2] += checksum_value(result_unwrap(json_value)(&field));
+            field = json_value_find(record, "balance");
+            if (result_is_ok(json_value)(&field))
+                sums[2] += checksum_value(result_unwrap(json_value)(&field));
+            record_result = json_value_next(record);
+        }
+
+        marks[3] = now();
+        record_result = json_value_first(document_root);
+        while (result_is_ok(json_value)(&record_result))
+        {
+            json_value_t record = result_unwrap(json_value)(&record_result);
+            for (p = 0; p < 2; p++)
+            {
+                result(json_value) field = json_path_find_value(record, &paths[p]);
+                if (result_is_ok(json_value)(&field))
+                    sums[3] += checksum_value(result_unwrap(json_value)(&field));
+            }
+            record_result = json_value_next(record);
+        }
+
+        marks[4] = now();
+        record_result = json_value_first(document_root);
+        while (result_is_ok(json_value)(&record_result))
+        {
+            json_value_t record = result_unwrap(json_value)(&record_result);
+            json_value_t fields[2];
+            json_path_find_values(record, paths, 2, fields);
+            for (p = 0; p < 2; p++)
+            {
+                if (fields[p].ptr != NULL)
+                    sums[4] += checksum_value(fields[p]);
+            }
+            record_result = json_value_next(record);
+        }
+
+        marks[5] = now();
+        json_path_find_values(document_root, absolute, 2 * records, values);
+        for (r = 0; r < 2 * records; r++)
+        {
+            if (values[r].ptr != NULL)
+                sums[5] += checksum_value(values[r]);
+        }
+        marks[6] = now();
+
+        for (p = 0; p < 6; p++)
+            times[p] += marks[p + 1] - marks[p];
+        json_document_free(&document);
+    }
+
+    {
+        static const char *names[] = {"dom, find per level", "dom, compiled paths", "raw, find per level",
+                                      "raw, compiled paths", "raw, batched per record", "raw, one pass over all"};
+        for (p = 0; p < 6; p++)
+            printf("%-24s %8.3f ms  (checksum %g)\n", names[p], times[p] * 1e3 / iterations, sums[p] / iterations);
+        printf("compiling %lu pointers: %.3f ms\n", (unsigned long)(2 * records), compile_time * 1e3);
+    }
+
+    for (r = 0; r < 2 * records; r++)
+        json_path_free(&absolute[r]);
+    free(absolute);
+    free(values);
+    json_path_free(&paths[0]);
+    json_path_free(&paths[1]);
+    json_arena_free(&arena);
+    return 0;
+}
+
+/**
+ * @brief Reads five scalar fields out of every record of the input,
+ * one NDJSON line at a time: parsed into an arena or the heap and then
+ * looked up, and extracted straight from the text
+ */
+static int bench_extract(const char *json, size_t len, int iterations)
+{
+    static const char *names[] = {"index", "isActive", "balance", "age", "favoriteFruit"};
+    const size_t field_count = sizeof(names) / sizeof(names[0]);
+    json_field_t out[sizeof(names) / sizeof(names[0])];
+    json_alloc_stats_t stats;
+    json_arena_t arena;
+    double times[3] = {0}, sums[3] = {0};
+    size_t lines_len, records = 0, mallocs = 0;
+    int i, mode;
+    size_t f;
+
+    char *lines = make_ndjson(json, len, 1, &lines_len);
+    if (lines == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for the lines\n");
+        return -1;
+    }
+
+    result(json_fields) fields_result = json_fields_compile(names, field_count);
+    if (result_is_err(json_fields)(&fields_result))
+    {
+        report_error(result_unwrap_err(json_fields)(&fields_result));
+        free(lines);
+        return -1;
+    }
+    json_fields_t fields = result_unwrap(json_fields)(&fields_result);
+
+    json_arena_init(&arena, 0);
+    for (i = 0; i < iterations; i++)
+    {
+        for (mode = 0; mode < 3; mode++)
+        {
+            const char *line = lines;
+            double start = now();
+
+            json_alloc_stats_reset();
+            records = 0;
+            while (line < lines + lines_len)
+            {
+                const char *newline = memchr(line, '\n', lines + lines_len - line);
+                size_t len = newline - line;
+
+                if (mode == 2)
+                {
+                    result(size) found = json_extract(line, len, &fields, out);
+                    for (f = 0; result_is_ok(size)(&found) && f < field_count; f++)
+                    {
+                        if (out[f].found)
+                            sums[mode] += out[f].type == JSON_ELEMENT_TYPE_STRING ? (double)out[f].value.as_string.length : 1;
+                    }
+                }
+                else
+                {
+                    json_parse_options_t options = {0};
+                    if (mode == 0)
+                        options.arena = &arena;
+
+                    result(json_element) element_result = json_parse_ex(line, len, &options);
+                    if (result_is_ok(json_element)(&element_result))
+                    {
+                        typed(json_element) record = result_unwrap(json_element)(&element_result);
+                        for (f = 0; f < field_count; f++)
+                        {
+                            result(json_element) field = json_object_find(record.value.as_object, names[f]);
+                            if (result_is_ok(json_element)(&field))
+                                sums[mode] += result_unwrap(json_element)(&field).type == JSON_ELEMENT_TYPE_STRING
+                                                  ? (double)result_unwrap(json_element)(&field).value.as_string.length
+                                                  : 1;
+                        }
+                        if (mode == 0)
+                            json_arena_reset(&arena);
+                        else
+                            json_free(&record);
+                    }
+                }
+
+                records++;
+                line = newline + 1;
+            }
+            times[mode] += now() - start;
+
+            json_alloc_stats(&stats);
+            if (mode == 1)
+                mallocs = stats.allocs;
+        }
+    }
+
     {
+        static const char *modes[] = {"arena parse + find", "heap parse + find", "json_extract"};
+        for (mode = 0; mode < 3; mode++)
+            printf("%-20s %8.3f ms  %8.1f MB/s  %6.0f ns per record  (checksum %g)\n", modes[mode],
+                   times[mode] * 1e3 / iterations, lines_len * iterations / times[mode] / 1e6,
+                   times[mode] * 1e9 / iterations / records, sums[mode] / iterations);
+        printf("%lu records, heap parse mallocs %lu per record, json_extract none\n", (unsigned long)records,
+               (unsigned long)(mallocs / records));
+    }
+
+    json_arena_free(&arena);
+    json_fields_free(&fields);
+    free(lines);
+    return 0;
+}
+
+/**
+ * @brief Repeats the elements of a top-level array until there are at
+ * least `min_size` bytes, as one minified array
+ */
+static char *make_array(const char *json, size_t len, size_t min_size, size_t *array_len)
+{
+    size_t lines_len = 0;
+    char *lines = make_ndjson(json, len, min_size, &lines_len);
+    char *array;
+    size_t i;
+
+    if (lines == NULL)
+        return NULL;
+
+    array = malloc(lines_len + 2);
+    if (array != NULL)
+    {
+        // Lines end in a newline, which becomes the separator
+        array[0] = '[';
+        for (i = 0; i < lines_len; i++)
+            array[i + 1] = lines[i] == '\n' ? ',' : lines[i];
+        array[lines_len] = ']';
+        array[lines_len + 1] = '\0';
+        *array_len = lines_len + 1;
+    }
+
+    free(lines);
+    return array;
+}
+
+/**
+ * @brief Scales the input array up to about 100 MB and compares parsing
+ * its text into an arena with decoding its binary encoding, copied into
+ * the arena and pointing into the encoded buffer
+ */
+static int bench_binary(const char *json, size_t len, int iterations)
+{
+    static const char *names[] = {"text parse", "binary decode", "binary decode insitu"};
+    json_parse_options_t options = {0};
+    json_arena_t arena;
+    json_writer_t writer, text;
+    size_t array_len = 0, encoded_len = 0;
+    double encode_time = 0;
+    int mode, i;
+
+    char *array = make_array(json, len, 100 * 1024 * 1024, &array_len);
+    if (array == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for the array\n");
         return -1;
     }
 
-    result(json_element) element_result = json_parse(json);
+    json_arena_init(&arena, 0);
+    options.arena = &arena;
+    result(json_element) element_result = json_parse_ex(array, array_len, &options);
+    if (result_is_err(json_element)(&element_result))
+    {
+        report_error(result_unwrap_err(json_element)(&element_result));
+        json_arena_free(&arena);
+        free(array);
+        return -1;
+    }
+    typed(json_element) element = result_unwrap(json_element)(&element_result);
+
+    // The first call grows the buffer, which later ones reuse
+    json_writer_init(&writer, NULL, NULL);
+    json_encode(&element, &writer);
+    for (i = 0; i < iterations; i++)
+    {
+        writer.size = 0;
+        double start = now();
+        result(size) size_result = json_encode(&element, &writer);
+        encode_time += now() - start;
+
+        if (result_is_err(size)(&size_result))
+        {
+            report_error(result_unwrap_err(size)(&size_result));
+            json_writer_free(&writer);
+            json_arena_free(&arena);
+            free(array);
+            return -1;
+        }
+        encoded_len = result_unwrap(size)(&size_result);
+    }
+
+    // Kept to check that every decode serializes back to the input
+    json_writer_init(&text, NULL, NULL);
+    json_serialize(&element, &text, 0);
+
+    printf("%lu bytes of text, %lu bytes encoded (%.1f%%), encode %8.3f ms  %8.1f MB/s\n", (unsigned long)array_len,
+           (unsigned long)encoded_len, encoded_len * 100.0 / array_len, encode_time * 1e3 / iterations,
+           encoded_len * iterations / encode_time / 1e6);
+
+    for (mode = 0; mode < 3; mode++)
+    {
+        json_writer_t check;
+        double time = 0;
+        _bool same = _false;
+
+        options.insitu = mode == 2;
+        for (i = 0; i < iterations; i++)
+        {
+            json_arena_reset(&arena);
+            double start = now();
+            if (mode == 0)
+                element_result = json_parse_ex(array, array_len, &options);
+            else
+                element_result = json_decode(writer.data, encoded_len, &options);
+            time += now() - start;
+
+            if (result_is_err(json_element)(&element_result))
+            {
+                report_error(result_unwrap_err(json_element)(&element_result));
+                json_writer_free(&text);
+                json_writer_free(&writer);
+                json_arena_free(&arena);
+                free(array);
+                return -1;
+            }
+        }
+
+        element = result_unwrap(json_element)(&element_result);
+        json_writer_init(&check, NULL, NULL);
+        json_serialize(&element, &check, 0);
+        same = check.size == text.size && memcmp(check.data, text.data, text.size) == 0;
+        json_writer_free(&check);
+
+        printf("%-22s %8.3f ms  %8.1f MB/s of text%s\n", names[mode], time * 1e3 / iterations,
+               array_len * iterations / time / 1e6, same ? "" : "   (differs)");
+    }
+
+    json_writer_free(&text);
+    json_writer_free(&writer);
+    json_arena_free(&arena);
+    free(array);
+    return 0;
+}
+
+/**
+ * @brief Scales the input array up to about 100 MB, writes it as a
+ * frozen image and compares getting at the data through the text, the
+ * binary encoding and the image: the time until the first lookup, then
+ * a lookup in every record and a walk over all values
+ */
+static int bench_image(const char *json, size_t len, int iterations)
+{
+    static const char *names[] = {"text parse", "binary decode", "image open"};
+    json_parse_options_t options = {0};
+    json_shape_table_t shapes;
+    json_arena_t arena, scratch;
+    json_writer_t encoded, image_data;
+    json_image_t image;
+    size_t array_len = 0, records, r;
+    double write_time = 0, find_time[2] = {0, 0}, walk_time[2] = {0, 0}, sums[4] = {0, 0, 0, 0};
+    int mode, i;
 
-    free((void *)json);
+    char *array = make_array(json, len, 100 * 1024 * 1024, &array_len);
+    if (array == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for the array\n");
+        return -1;
+    }
 
+    // Shapes let the image share one key index between the records
+    json_shape_table_init(&shapes);
+    json_arena_init(&arena, 0);
+    json_arena_init(&scratch, 0);
+    options.arena = &arena;
+    options.shapes = &shapes;
+    result(json_element) element_result = json_parse_ex(array, array_len, &options);
     if (result_is_err(json_element)(&element_result))
     {
-        typed(json_error) error = result_unwrap_err(json_element)(&element_result);
-        fprintf(stderr, "Error parsing JSON: %s\n", json_error_to_string(error));
+        report_error(result_unwrap_err(json_element)(&element_result));
+        json_arena_free(&scratch);
+        json_arena_free(&arena);
+        json_shape_table_free(&shapes);
+        free(array);
         return -1;
     }
     typed(json_element) element = result_unwrap(json_element)(&element_result);
+    records = element.value.as_array->count;
 
-    // json_print(&element, 2);
-    json_free(&element);
+    json_writer_init(&encoded, NULL, NULL);
+    json_encode(&element, &encoded);
+
+    // The first call grows the buffer, which later ones reuse
+    json_writer_init(&image_data, NULL, NULL);
+    json_image_write(&element, &image_data);
+    for (i = 0; i < iterations; i++)
+    {
+        image_data.size = 0;
+        double start = now();
+        json_image_write(&element, &image_data);
+        write_time += now() - start;
+    }
+
+    printf("%lu records, %lu bytes of text, %lu encoded, %lu in the image, written in %.3f ms\n", (unsigned long)records,
+           (unsigned long)array_len, (unsigned long)encoded.size, (unsigned long)image_data.size,
+           write_time * 1e3 / iterations);
+
+    // ******* Until the last record's "age" can be read *******
+    options.shapes = NULL;
+    options.arena = &scratch;
+    for (mode = 0; mode < 3; mode++)
+    {
+        double time = 0;
+        _bool found = _false;
+
+        for (i = 0; i < iterations; i++)
+        {
+            json_arena_reset(&scratch);
+            double start = now();
+            if (mode == 2)
+            {
+                result(json_image_ref) root_result = json_image_open(&image, image_data.data, image_data.size);
+                if (result_is_ok(json_image_ref)(&root_result))
+                {
+                    result(json_image_ref) record =
+                        json_image_array_get(result_unwrap(json_image_ref)(&root_result), records - 1);
+                    result(json_image_ref) age = json_image_object_find(result_unwrap(json_image_ref)(&record), "age");
+                    found = result_is_ok(json_image_ref)(&age);
+                }
+            }
+            else
+            {
+                element_result = mode == 0 ? json_parse_ex(array, array_len, &options)
+                                           : json_decode(encoded.data, encoded.size, &options);
+                if (result_is_ok(json_element)(&element_result))
+                {
+                    json_array_t *root = result_unwrap(json_element)(&element_result).value.as_array;
+                    result(json_element) age =
+                        json_object_find(root->elements[records - 1].value.as_object, "age");
+                    found = result_is_ok(json_element)(&age);
+                }
+            }
+            time += now() - start;
+        }
+
+        printf("%-14s %12.6f ms to the first lookup%s\n", names[mode], time * 1e3 / iterations,
+               found ? "" : "   (not found)");
+    }
+    json_arena_free(&scratch);
+
+    // ******* Lookups and walks over the shaped DOM and the image *******
+    result(json_image_ref) root_result = json_image_open(&image, image_data.data, image_data.size);
+    json_image_ref_t root = result_unwrap(json_image_ref)(&root_result);
+    for (i = 0; i < iterations; i++)
+    {
+        double start = now();
+        for (r = 0; r < records; r++)
+        {
+            result(json_element) age = json_object_find(element.value.as_array->elements[r].value.as_object, "age");
+            if (result_is_ok(json_element)(&age))
+                sums[0] += result_unwrap(json_element)(&age).value.as_number.value.as_long;
+        }
+        find_time[0] += now() - start;
+
+        start = now();
+        for (r = 0; r < records; r++)
+        {
+            result(json_image_ref) record = json_image_array_get(root, r);
+            result(json_image_ref) age = json_image_object_find(result_unwrap(json_image_ref)(&record), "age");
+            if (result_is_ok(json_image_ref)(&age))
+            {
+                result(json_number) number = json_image_get_number(result_unwrap(json_image_ref)(&age));
+                sums[1] += result_unwrap(json_number)(&number).value.as_long;
+            }
+        }
+        find_time[1] += now() - start;
+
+        start = now();
+        sums[2] += walk_dom(&element);
+        walk_time[0] += now() - start;
+
+        start = now();
+        sums[3] += walk_image(root);
+        walk_time[1] += now() - start;
+    }
+
+    printf("find \"age\" in every record   dom %8.3f ms  image %8.3f ms%s\n", find_time[0] * 1e3 / iterations,
+           find_time[1] * 1e3 / iterations, sums[0] == sums[1] ? "" : "   (sums differ)");
+    printf("walk every value              dom %8.3f ms  image %8.3f ms%s\n", walk_time[0] * 1e3 / iterations,
+           walk_time[1] * 1e3 / iterations, sums[2] == sums[3] ? "" : "   (sums differ)");
+
+    json_writer_free(&image_data);
+    json_writer_free(&encoded);
+    json_arena_free(&arena);
+    json_shape_table_free(&shapes);
+    free(array);
+    return 0;
+}
+
+/**
+ * @brief Memory of the process that is not backed by a file, in bytes
+ */
+static size_t private_memory(void)
+{
+    unsigned long size = 0, resident = 0, shared = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    if (statm == NULL)
+        return 0;
+    if (fscanf(statm, "%lu %lu %lu", &size, &resident, &shared) != 3)
+        resident = shared = 0;
+    fclose(statm);
+
+    return (resident - shared) * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * @brief Loads the input file with each method and parses the loaded
+ * bytes into an arena, reporting the time of both and how much of the
+ * input ends up in private memory rather than the shared page cache
+ */
+static int bench_load(const char *json, size_t len, int iterations)
+{
+    json_parse_options_t options = {0};
+    json_arena_t arena;
+    input_t input;
+    int method, i;
+
+    (void)json;
+    (void)len;
+    json_arena_init(&arena, 0);
+    options.arena = &arena;
+
+    for (method = LOAD_READ; method <= LOAD_POPULATE; method++)
+    {
+        double load_time = 0, parse_time = 0;
+        size_t copied = 0;
+
+        for (i = 0; i < iterations; i++)
+        {
+            const size_t before = private_memory();
+            double start = now();
+            if (load_input(input_file, (load_method_t)method, &input) != 0)
+            {
+                json_arena_free(&arena);
+                return -1;
+            }
+            double loaded = now();
+            copied = private_memory() - before;
+
+            result(json_element) element_result = json_parse_ex(input.data, input.len, &options);
+            parse_time += now() - loaded;
+            load_time += loaded - start;
+
+            release_input(&input);
+            json_arena_reset(&arena);
+            if (result_is_err(json_element)(&element_result))
+            {
+                report_error(result_unwrap_err(json_element)(&element_result));
+                json_arena_free(&arena);
+                return -1;
+            }
+        }
+
+        printf("%-9s load %8.3f ms  parse %8.3f ms  private memory after loading %8.1f MB\n", load_methods[method],
+               load_time * 1e3 / iterations, parse_time * 1e3 / iterations, copied / 1e6);
+    }
+
+    json_arena_free(&arena);
+    return 0;
+}
+
+/**
+ * @brief Validates the input and compares it with reading every byte,
+ * with the structural index alone and with a parse into an arena
+ */
+static int bench_validate(const char *json, size_t len, int iterations)
+{
+    json_parse_options_t options = {0};
+    json_index_t index = {0};
+    json_alloc_stats_t stats;
+    json_arena_t arena;
+    double read_time = 0, index_time = 0, validate_time = 0, parse_time = 0;
+    size_t error_offset = 0;
+    int i;
+
+    json_arena_init(&arena, 0);
+    options.arena = &arena;
+
+    for (i = 0; i < iterations; i++)
+    {
+        double start = now();
+        const void *volatile found = memchr(json, 0x01, len);
+        double read_end = now();
+        (void)found;
+
+        double index_start = now();
+        json_index_build(&index, json, len);
+        double index_end = now();
+
+        json_alloc_stats_reset();
+        double validate_start = now();
+        json_boolean_t valid = json_validate(json, len, &error_offset);
+        double validate_end = now();
+        json_alloc_stats(&stats);
 
+        double parse_start = now();
+        result(json_element) element_result = json_parse_ex(json, len, &options);
+        double parse_end = now();
+        json_arena_reset(&arena);
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid JSON at offset %lu\n", (unsigned long)error_offset);
+            json_index_free(&index);
+            json_arena_free(&arena);
+            return -1;
+        }
+        if (result_is_err(json_element)(&element_result))
+        {
+            report_error(result_unwrap_err(json_element)(&element_result));
+            json_index_free(&index);
+            json_arena_free(&arena);
+            return -1;
+        }
+
+        read_time += read_end - start;
+        index_time += index_end - index_start;
+        validate_time += validate_end - validate_start;
+        parse_time += parse_end - parse_start;
+    }
+
+    printf("memchr:   %8.3f ms  %8.1f MB/s\n", read_time * 1e3 / iterations, len * iterations / read_time / 1e6);
+    printf("index:    %8.3f ms  %8.1f MB/s  (%s)\n", index_time * 1e3 / iterations,
+           len * iterations / index_time / 1e6, json_index_kernel());
+    printf("validate: %8.3f ms  %8.1f MB/s  (%lu allocations)\n", validate_time * 1e3 / iterations,
+           len * iterations / validate_time / 1e6, (unsigned long)(stats.allocs + stats.reallocs));
+    printf("parse:    %8.3f ms  %8.1f MB/s  (arena)\n", parse_time * 1e3 / iterations,
+           len * iterations / parse_time / 1e6);
+
+    json_index_free(&index);
+    json_arena_free(&arena);
     return 0;
 }
+
+typedef struct benchmark_s
+{
+    const char *name;
+    int (*run)(const char *json, size_t len, int iterations);
+    _bool needs_input;
+} benchmark_t;
+
+static const benchmark_t benchmarks[] = {
+    {"parse", bench_parse, _true},
+    {"heap", bench_heap, _true},
+    {"arena", bench_arena, _true},
+    {"insitu", bench_insitu, _true},
+    {"index", bench_index, _true},
+    {"whitespace", bench_whitespace, _true},
+    {"nested", bench_nested, _false},
+    {"tape", bench_tape, _true},
+    {"ondemand", bench_ondemand, _true},
+    {"numbers", bench_numbers, _false},
+    {"strings", bench_strings, _false},
+    {"sax", bench_sax, _true},
+    {"stream", bench_stream, _true},
+    {"ndjson", bench_ndjson, _true},
+    {"parallel", bench_parallel, _true},
+    {"serialize", bench_serialize, _true},
+    {"lookup", bench_lookup, _false},
+    {"keys", bench_keys, _true},
+    {"shapes", bench_shapes, _false},
+    {"paths", bench_paths, _true},
+    {"extract", bench_extract, _true},
+    {"binary", bench_binary, _true},
+    {"image", bench_image, _true},
+    {"load", bench_load, _false},
+    {"validate", bench_validate, _true},
+};
+
+/**
+ * Usage: json_benchmark [file] [mode] [iterations] [read|mmap|populate]
+ *
+ * Synthetic modes like `nested` ignore the file, pass `-` for it. The
+ * file is mapped with its pages faulted in up front unless another
+ * way of loading it is given
+ */
+int main(int argc, char **argv)
+{
+    const char *file_name;
+    if (argc > 1)
+    {
+        file_name = argv[1];
+    }
+    else
+    {
+        file_name = default_file;
+    }
+
+    const char *mode = argc > 2 ? argv[2] : "parse";
+    int iterations = argc > 3 ? atoi(argv[3]) : 1;
+    if (iterations < 1)
+    {
+        iterations = 1;
+    }
+
+    const char *method_name = argc > 4 ? argv[4] : "populate";
+    load_method_t method = LOAD_READ;
+    while (strcmp(load_methods[method], method_name) != 0)
+    {
+        if (method == LOAD_POPULATE)
+        {
+            fprintf(stderr, "Unknown load method \"%s\"\n", method_name);
+            return -1;
+        }
+        method++;
+    }
+    input_file = file_name;
+
+    const benchmark_t *benchmark = NULL;
+    size_t i;
+    for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    {
+        if (strcmp(benchmarks[i].name, mode) == 0)
+        {
+            benchmark = &benchmarks[i];
+        }
+    }
+
+    if (benchmark == NULL)
+    {
+        fprintf(stderr, "Unknown mode \"%s\"\n", mode);
+        return -1;
+    }
+
+    input_t input = {0};
+    if (benchmark->needs_input && load_input(file_name, method, &input) != 0)
+    {
+        return -1;
+    }
+
+    int status = benchmark->run(input.data, input.len, iterations);
+
+    release_input(&input);
+
+    return status;
+}